@@ -0,0 +1,239 @@
+// Tokenizer throughput benchmark.
+//
+// Usage: mini_lisp_bench [--size=MB] [--seed=N] [--repeat=N] [--corpus=NAME]
+//                        [--scan=scalar|sse2|avx2]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./char_class.h"
+#include "./corpus.h"
+#include "./parallel_tokenizer.h"
+#include "./stream_tokenizer.h"
+#include "./tokenizer.h"
+
+namespace {
+
+std::atomic<std::size_t> allocationCount{0};
+
+void* countedAllocate(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* countedAllocate(std::size_t size, std::align_val_t alignment) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a multiple of the alignment.
+    size = (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1);
+#ifdef _WIN32
+    auto p = _aligned_malloc(size, align);
+#else
+    auto p = std::aligned_alloc(align, size);
+#endif
+    if (p) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void alignedFree(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+}  // namespace
+
+// Every replaceable allocation function is counted, as the library may call
+// the array and aligned forms directly.
+void* operator new(std::size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return countedAllocate(size, alignment);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    alignedFree(p);
+}
+
+namespace {
+
+struct Options {
+    std::size_t size = 8 << 20;
+    std::uint64_t seed = 42;
+    int repeat = 5;
+    std::string corpus;
+    std::string scan;
+};
+
+// Runs the tokenizer over the source and returns the number of tokens.
+using Method = std::function<std::size_t(const std::string& source)>;
+
+struct NamedMethod {
+    const char* name;
+    Method run;
+};
+
+const NamedMethod METHODS[]{
+    {"tokenize", [](const std::string& source) { return Tokenizer::tokenize(source).size(); }},
+    {"borrowed",
+     [](const std::string& source) { return Tokenizer::tokenizeBorrowed(source).size(); }},
+    {"flat", [](const std::string& source) { return Tokenizer::tokenizeFlat(source).size(); }},
+    {"stream",
+     [](const std::string& source) {
+         std::istringstream in(source);
+         StreamTokenizer tokenizer(in);
+         std::size_t count = 0;
+         while (tokenizer.next()) {
+             count++;
+         }
+         return count;
+     }},
+    {"parallel-flat",
+     [](const std::string& source) {
+         return ParallelTokenizer::tokenizeFlat(source).size();
+     }},
+};
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        auto value = [&](std::string_view prefix) -> const char* {
+            return arg.starts_with(prefix) ? argv[i] + prefix.size() : nullptr;
+        };
+        if (auto v = value("--size=")) {
+            options.size = std::strtoull(v, nullptr, 10) << 20;
+        } else if (auto v = value("--seed=")) {
+            options.seed = std::strtoull(v, nullptr, 10);
+        } else if (auto v = value("--repeat=")) {
+            options.repeat = std::max(1, std::atoi(v));
+        } else if (auto v = value("--corpus=")) {
+            options.corpus = v;
+        } else if (auto v = value("--scan=")) {
+            options.scan = v;
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+const char* scanLevelName(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::SCALAR: return "scalar";
+        case ScanLevel::SSE2: return "sse2";
+        case ScanLevel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    auto options = parseOptions(argc, argv);
+    if (!options.scan.empty()) {
+        std::optional<ScanLevel> level;
+        for (auto candidate : {ScanLevel::SCALAR, ScanLevel::SSE2, ScanLevel::AVX2}) {
+            if (options.scan == scanLevelName(candidate)) {
+                level = candidate;
+            }
+        }
+        if (!level) {
+            std::cerr << "Unknown scan level " << options.scan << std::endl;
+            return 2;
+        }
+        if (setScanLevel(*level) != *level) {
+            std::cerr << "Scan level " << options.scan << " is not supported on this CPU"
+                      << std::endl;
+            return 2;
+        }
+    }
+#ifndef NDEBUG
+    std::printf("warning: assertions enabled, build with CMAKE_BUILD_TYPE=Release\n");
+#endif
+    std::printf("scan level %s, seed %llu, %d runs (best)\n\n",
+                scanLevelName(scanKernels().level),
+                static_cast<unsigned long long>(options.seed), options.repeat);
+    std::printf("%-12s %-14s %10s %10s %12s\n", "corpus", "method", "MB/s", "Mtok/s",
+                "allocs/tok");
+    for (auto kind : ALL_CORPORA) {
+        if (!options.corpus.empty() && options.corpus != corpusName(kind)) {
+            continue;
+        }
+        auto source = generateCorpus(kind, options.size, options.seed);
+        for (const auto& method : METHODS) {
+            double best = 1e300;
+            std::size_t tokens = 0;
+            std::size_t allocations = 0;
+            for (int i = 0; i < options.repeat; i++) {
+                auto before = allocationCount.load();
+                auto start = std::chrono::steady_clock::now();
+                tokens = method.run(source);
+                auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                                   .count();
+                allocations = allocationCount.load() - before;
+                best = std::min(best, seconds);
+            }
+            std::printf("%-12s %-14s %10.1f %10.2f %12.3f\n", corpusName(kind), method.name,
+                        source.size() / best / 1e6, tokens / best / 1e6,
+                        tokens ? static_cast<double>(allocations) / tokens : 0.0);
+        }
+    }
+}
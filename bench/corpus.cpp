@@ -0,0 +1,151 @@
+#include "./corpus.h"
+
+#include <string_view>
+
+namespace {
+
+// splitmix64; std::*_distribution results differ between standard
+// libraries, so the corpora use this instead.
+class Random {
+private:
+    std::uint64_t state;
+
+public:
+    explicit Random(std::uint64_t seed) : state{seed} {}
+
+    std::uint64_t next() {
+        auto z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    std::size_t below(std::size_t n) {
+        return next() % n;
+    }
+    template <typename T, std::size_t N>
+    const T& pick(const T (&items)[N]) {
+        return items[below(N)];
+    }
+};
+
+constexpr std::string_view IDENTIFIER_CHARS = "abcdefghijklmnopqrstuvwxyz-?!*<>=/";
+constexpr std::string_view WORDS[]{"lambda", "define", "car",   "cdr",   "cons", "list",
+                                   "map",    "filter", "fold",  "let",   "if",   "cond",
+                                   "else",   "null?",  "pair?", "apply", "+",    "-"};
+
+void appendIdentifier(std::string& out, Random& random) {
+    if (random.below(2) == 0) {
+        out += random.pick(WORDS);
+        return;
+    }
+    out += IDENTIFIER_CHARS[random.below(26)];
+    for (auto length = random.below(16); length > 0; length--) {
+        out += IDENTIFIER_CHARS[random.below(IDENTIFIER_CHARS.size())];
+    }
+}
+
+void appendNumber(std::string& out, Random& random) {
+    switch (random.below(4)) {
+        case 0: out += std::to_string(random.below(1000)); break;
+        case 1: out += "-" + std::to_string(random.next() >> 20); break;
+        case 2:
+            out += std::to_string(random.below(100000)) + "." + std::to_string(random.below(1000));
+            break;
+        default: out += std::to_string(random.below(10)) + "e-" + std::to_string(random.below(30));
+    }
+}
+
+void appendString(std::string& out, Random& random) {
+    out += '"';
+    for (auto length = random.below(40) + 4; length > 0; length--) {
+        switch (random.below(12)) {
+            case 0: out += "\\\""; break;
+            case 1: out += "\\n"; break;
+            case 2: out += "\\\\"; break;
+            default: out += static_cast<char>('a' + random.below(26));
+        }
+    }
+    out += '"';
+}
+
+void appendNested(std::string& out, Random& random) {
+    auto depth = random.below(200) + 1;
+    for (std::size_t i = 0; i < depth; i++) {
+        out += '(';
+        if (random.below(3) == 0) {
+            appendIdentifier(out, random);
+            out += ' ';
+        }
+    }
+    appendNumber(out, random);
+    out.append(depth, ')');
+}
+
+void appendForm(CorpusKind kind, std::string& out, Random& random) {
+    switch (kind) {
+        case CorpusKind::IDENTIFIERS:
+            out += "(define (";
+            for (auto count = random.below(6) + 2; count > 0; count--) {
+                appendIdentifier(out, random);
+                out += ' ';
+            }
+            out += ") (";
+            for (auto count = random.below(10) + 2; count > 0; count--) {
+                appendIdentifier(out, random);
+                out += ' ';
+            }
+            out += "))";
+            break;
+        case CorpusKind::NUMBERS:
+            out += "(list";
+            for (auto count = random.below(16) + 4; count > 0; count--) {
+                out += ' ';
+                appendNumber(out, random);
+            }
+            out += ')';
+            break;
+        case CorpusKind::STRINGS:
+            out += "(display ";
+            appendString(out, random);
+            out += ' ';
+            appendString(out, random);
+            out += ')';
+            break;
+        case CorpusKind::COMMENTS:
+            for (auto count = random.below(4) + 1; count > 0; count--) {
+                out += ";; ";
+                for (auto words = random.below(12) + 2; words > 0; words--) {
+                    appendIdentifier(out, random);
+                    out += ' ';
+                }
+                out += '\n';
+            }
+            out += "(f x) ; trailing comment";
+            break;
+        case CorpusKind::NESTED: appendNested(out, random); break;
+    }
+    out += '\n';
+}
+
+}  // namespace
+
+const char* corpusName(CorpusKind kind) {
+    switch (kind) {
+        case CorpusKind::IDENTIFIERS: return "identifiers";
+        case CorpusKind::NUMBERS: return "numbers";
+        case CorpusKind::STRINGS: return "strings";
+        case CorpusKind::COMMENTS: return "comments";
+        case CorpusKind::NESTED: return "nested";
+    }
+    return "unknown";
+}
+
+std::string generateCorpus(CorpusKind kind, std::size_t size, std::uint64_t seed) {
+    Random random(seed ^ (static_cast<std::uint64_t>(kind) << 56));
+    std::string out;
+    out.reserve(size + 4096);
+    while (out.size() < size) {
+        appendForm(kind, out, random);
+    }
+    return out;
+}
@@ -0,0 +1,27 @@
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class CorpusKind {
+    IDENTIFIERS,
+    NUMBERS,
+    STRINGS,
+    COMMENTS,
+    NESTED,
+};
+
+inline constexpr CorpusKind ALL_CORPORA[]{
+    CorpusKind::IDENTIFIERS, CorpusKind::NUMBERS, CorpusKind::STRINGS,
+    CorpusKind::COMMENTS,    CorpusKind::NESTED,
+};
+
+const char* corpusName(CorpusKind kind);
+
+// Generates about `size` bytes of Lisp source. The output depends only on
+// the arguments, not on the platform or standard library.
+std::string generateCorpus(CorpusKind kind, std::size_t size, std::uint64_t seed);
+
+#endif
@@ -0,0 +1,40 @@
+#include "./arena.h"
+
+#include <cstring>
+
+void* Arena::allocateSlow(std::size_t size, std::size_t align) {
+    if (size + align > chunkSize / 4) {
+        largeChunks.push_back(std::make_unique_for_overwrite<std::byte[]>(size + align));
+        largeBytes += size + align;
+        used += size;
+        auto address = reinterpret_cast<std::uintptr_t>(largeChunks.back().get());
+        return reinterpret_cast<void*>((address + align - 1) & ~(align - 1));
+    }
+    if (cursor) {
+        current++;
+    }
+    if (current == chunks.size()) {
+        chunks.push_back(std::make_unique_for_overwrite<std::byte[]>(chunkSize));
+    }
+    cursor = chunks[current].get();
+    limit = cursor + chunkSize;
+    return allocate(size, align);
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    auto data = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(data, text.data(), text.size());
+    return {data, text.size()};
+}
+
+void Arena::reset() {
+    largeChunks.clear();
+    largeBytes = 0;
+    current = 0;
+    cursor = chunks.empty() ? nullptr : chunks.front().get();
+    limit = cursor ? cursor + chunkSize : nullptr;
+    used = 0;
+}
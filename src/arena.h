@@ -0,0 +1,77 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator. Objects are never freed individually; everything is
+// released at once by reset() or the destructor, so only trivially
+// destructible types may be placed in it.
+class Arena {
+private:
+    std::size_t chunkSize;
+    std::vector<std::unique_ptr<std::byte[]>> chunks;
+    std::size_t current{0};
+    // Requests too big for a chunk are allocated on their own.
+    std::vector<std::unique_ptr<std::byte[]>> largeChunks;
+    std::size_t largeBytes{0};
+    std::byte* cursor{nullptr};
+    std::byte* limit{nullptr};
+    std::size_t used{0};
+
+    void* allocateSlow(std::size_t size, std::size_t align);
+
+public:
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit Arena(std::size_t chunkSize = DEFAULT_CHUNK_SIZE) : chunkSize{chunkSize} {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(std::size_t size, std::size_t align = alignof(std::max_align_t)) {
+        auto address = reinterpret_cast<std::uintptr_t>(cursor);
+        auto aligned = (address + align - 1) & ~(align - 1);
+        if (cursor && aligned + size <= reinterpret_cast<std::uintptr_t>(limit)) {
+            cursor = reinterpret_cast<std::byte*>(aligned + size);
+            used += size;
+            return reinterpret_cast<void*>(aligned);
+        }
+        return allocateSlow(size, align);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+    }
+    // An array of count value-initialized elements.
+    template <typename T>
+    std::span<T> makeArray(std::size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        auto data = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_value_construct_n(data, count);
+        return {data, count};
+    }
+
+    std::string_view copy(std::string_view text);
+
+    // Frees everything allocated so far in one step. Regular chunks are kept
+    // and reused by later allocations.
+    void reset();
+
+    std::size_t bytesUsed() const {
+        return used;
+    }
+    std::size_t bytesReserved() const {
+        return chunks.size() * chunkSize + largeBytes;
+    }
+};
+
+#endif
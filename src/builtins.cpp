@@ -0,0 +1,1222 @@
+#include "./builtins.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "./error.h"
+#include "./forms.h"
+#include "./interpreter.h"
+#include "./vector_kernels.h"
+
+namespace {
+
+void checkArity(const char* name, std::size_t count, std::size_t min, std::size_t max) {
+    if (count < min) {
+        throw LispError(std::string("Too few arguments to ") + name);
+    }
+    if (count > max) {
+        throw LispError(std::string("Too many arguments to ") + name);
+    }
+}
+
+Value checkNumber(const char* name, Value value) {
+    if (!value.isNumber()) {
+        throw LispError(std::string(name) + ": expected a number, got " + value.toString());
+    }
+    return value;
+}
+
+Pair* checkPair(const char* name, Value value) {
+    if (!value.isPair()) {
+        throw LispError(std::string(name) + ": expected a pair, got " + value.toString());
+    }
+    return value.asPair();
+}
+
+// Walks a proper list, throwing if it is improper. The list is rooted, so f
+// may allocate.
+template <typename F>
+void forEach(Interpreter& interpreter, const char* name, Value list, F&& f) {
+    Root cursor(interpreter.getHeap(), list);
+    for (; cursor.get().isPair(); cursor = cursor.get().asPair()->cdr) {
+        f(cursor.get().asPair()->car);
+    }
+    if (!cursor.get().isNil()) {
+        throw LispError(std::string(name) + ": expected a list");
+    }
+}
+
+// Builds a list front to back.
+class ListBuilder {
+private:
+    Interpreter& interpreter;
+    Root head;
+    Root tail;
+
+    void link(Value next) {
+        auto pair = tail.get().asPair();
+        pair->cdr = next;
+        interpreter.getHeap().writeBarrier(pair, &pair->cdr);
+    }
+
+public:
+    explicit ListBuilder(Interpreter& interpreter)
+        : interpreter{interpreter}, head{interpreter.getHeap()}, tail{interpreter.getHeap()} {}
+
+    void add(Value value) {
+        auto pair = interpreter.cons(value, Value());
+        if (tail.get().isPair()) {
+            link(pair);
+        } else {
+            head = pair;
+        }
+        tail = pair;
+    }
+    Value finish(Value last = Value()) {
+        if (!tail.get().isPair()) {
+            return last;
+        }
+        link(last);
+        return head;
+    }
+};
+
+bool fitsFixnum(std::int64_t value) {
+    return value >= Value::FIXNUM_MIN && value <= Value::FIXNUM_MAX;
+}
+
+// Sets result to a * b if it is a fixnum.
+bool multiplyFixnum(std::int64_t a, std::int64_t b, std::int64_t& result) {
+    if (a != 0 && std::abs(b) > Value::FIXNUM_MAX / std::abs(a)) {
+        return false;
+    }
+    result = a * b;
+    return fitsFixnum(result);
+}
+
+// Integer operands stay exact until a result leaves the fixnum range.
+Value add(Interpreter&, const Value* args, std::size_t count) {
+    std::int64_t exact = 0;
+    double inexact = 0;
+    bool isExact = true;
+    for (std::size_t i = 0; i < count; i++) {
+        auto x = checkNumber("+", args[i]);
+        if (isExact && x.isInteger() && fitsFixnum(exact + x.asInteger())) {
+            exact += x.asInteger();
+            continue;
+        }
+        if (isExact) {
+            inexact = static_cast<double>(exact);
+            isExact = false;
+        }
+        inexact += x.asDouble();
+    }
+    return isExact ? Value::fromInteger(exact) : Value::fromNumber(inexact);
+}
+
+Value subtract(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("-", count, 1, 2);
+    auto a = count == 1 ? Value::fromInteger(0) : checkNumber("-", args[0]);
+    auto b = checkNumber("-", args[count - 1]);
+    if (a.isInteger() && b.isInteger()) {
+        return Value::fromInteger(a.asInteger() - b.asInteger());
+    }
+    return Value::fromNumber(a.asDouble() - b.asDouble());
+}
+
+Value multiply(Interpreter&, const Value* args, std::size_t count) {
+    std::int64_t exact = 1;
+    double inexact = 1;
+    bool isExact = true;
+    for (std::size_t i = 0; i < count; i++) {
+        auto x = checkNumber("*", args[i]);
+        std::int64_t product;
+        if (isExact && x.isInteger() && multiplyFixnum(exact, x.asInteger(), product)) {
+            exact = product;
+            continue;
+        }
+        if (isExact) {
+            inexact = static_cast<double>(exact);
+            isExact = false;
+        }
+        inexact *= x.asDouble();
+    }
+    return isExact ? Value::fromInteger(exact) : Value::fromNumber(inexact);
+}
+
+Value divide(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("/", count, 1, 2);
+    auto a = count == 1 ? Value::fromInteger(1) : checkNumber("/", args[0]);
+    auto b = checkNumber("/", args[count - 1]);
+    if (b.isInteger() && b.asInteger() == 0) {
+        throw LispError("Division by zero");
+    }
+    if (a.isInteger() && b.isInteger() && a.asInteger() % b.asInteger() == 0) {
+        return Value::fromInteger(a.asInteger() / b.asInteger());
+    }
+    return Value::fromNumber(a.asDouble() / b.asDouble());
+}
+
+Value absolute(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("abs", count, 1, 1);
+    auto x = checkNumber("abs", args[0]);
+    if (x.isInteger()) {
+        return Value::fromInteger(std::abs(x.asInteger()));
+    }
+    return Value::fromNumber(std::fabs(x.asNumber()));
+}
+
+Value expt(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("expt", count, 2, 2);
+    auto base = checkNumber("expt", args[0]);
+    auto exponent = checkNumber("expt", args[1]);
+    if (base.isInteger() && exponent.isInteger() && exponent.asInteger() >= 0) {
+        std::int64_t result = 1;
+        auto square = base.asInteger();
+        bool exact = true;
+        for (auto n = exponent.asInteger(); n > 0 && exact; n >>= 1) {
+            if (n & 1) {
+                exact = multiplyFixnum(result, square, result);
+            }
+            if (n > 1 && exact) {
+                exact = multiplyFixnum(square, square, square);
+            }
+        }
+        if (exact) {
+            return Value::fromInteger(result);
+        }
+    }
+    return Value::fromNumber(std::pow(base.asDouble(), exponent.asDouble()));
+}
+
+// Shared by modulo and remainder, which differ only in the sign of the result.
+template <bool FLOOR>
+Value integerDivision(const char* name, const Value* args, std::size_t count) {
+    checkArity(name, count, 2, 2);
+    auto a = checkNumber(name, args[0]);
+    auto b = checkNumber(name, args[1]);
+    if (a.isInteger() && b.isInteger()) {
+        if (b.asInteger() == 0) {
+            throw LispError("Division by zero");
+        }
+        auto result = a.asInteger() % b.asInteger();
+        if (FLOOR && result != 0 && (result < 0) != (b.asInteger() < 0)) {
+            result += b.asInteger();
+        }
+        return Value::fromInteger(result);
+    }
+    auto result = std::fmod(a.asDouble(), b.asDouble());
+    if (FLOOR && result != 0 && (result < 0) != (b.asDouble() < 0)) {
+        result += b.asDouble();
+    }
+    return Value::fromNumber(result);
+}
+
+Value moduloOf(Interpreter&, const Value* args, std::size_t count) {
+    return integerDivision<true>("modulo", args, count);
+}
+
+Value remainderOf(Interpreter&, const Value* args, std::size_t count) {
+    return integerDivision<false>("remainder", args, count);
+}
+
+template <typename Compare>
+Value compare(const char* name, const Value* args, std::size_t count, Compare compare) {
+    checkArity(name, count, 2, 2);
+    auto a = checkNumber(name, args[0]);
+    auto b = checkNumber(name, args[1]);
+    if (a.isInteger() && b.isInteger()) {
+        return Value::fromBoolean(compare(a.asInteger(), b.asInteger()));
+    }
+    return Value::fromBoolean(compare(a.asDouble(), b.asDouble()));
+}
+
+Value equalNumber(Interpreter&, const Value* args, std::size_t count) {
+    return compare("=", args, count, [](auto a, auto b) { return a == b; });
+}
+
+Value less(Interpreter&, const Value* args, std::size_t count) {
+    return compare("<", args, count, [](auto a, auto b) { return a < b; });
+}
+
+Value greater(Interpreter&, const Value* args, std::size_t count) {
+    return compare(">", args, count, [](auto a, auto b) { return a > b; });
+}
+
+Value lessOrEqual(Interpreter&, const Value* args, std::size_t count) {
+    return compare("<=", args, count, [](auto a, auto b) { return a <= b; });
+}
+
+Value greaterOrEqual(Interpreter&, const Value* args, std::size_t count) {
+    return compare(">=", args, count, [](auto a, auto b) { return a >= b; });
+}
+
+bool isIntegral(Value value) {
+    return value.isInteger() || (value.isNumeric() && std::trunc(value.asNumber()) == value.asNumber());
+}
+
+Value isEven(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("even?", count, 1, 1);
+    if (!isIntegral(checkNumber("even?", args[0]))) {
+        throw LispError("even?: expected an integer");
+    }
+    return Value::fromBoolean(std::fmod(args[0].asDouble(), 2) == 0);
+}
+
+Value isOdd(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("odd?", count, 1, 1);
+    if (!isIntegral(checkNumber("odd?", args[0]))) {
+        throw LispError("odd?: expected an integer");
+    }
+    return Value::fromBoolean(std::fmod(args[0].asDouble(), 2) != 0);
+}
+
+Value isZero(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("zero?", count, 1, 1);
+    return Value::fromBoolean(checkNumber("zero?", args[0]).asDouble() == 0);
+}
+
+Value logicalNot(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("not", count, 1, 1);
+    return Value::fromBoolean(args[0].isFalse());
+}
+
+bool isEqv(Value a, Value b) {
+    if (a.isString() && b.isString()) {
+        return a.asString()->text == b.asString()->text;
+    }
+    return a == b;
+}
+
+bool isEqual(Value a, Value b) {
+    while (a.isPair() && b.isPair()) {
+        if (!isEqual(a.asPair()->car, b.asPair()->car)) {
+            return false;
+        }
+        a = a.asPair()->cdr;
+        b = b.asPair()->cdr;
+    }
+    if (a.isNumber() && b.isNumber()) {
+        return a.asDouble() == b.asDouble();
+    }
+    if (a.isObject(ObjectType::F64VECTOR) && b.isObject(ObjectType::F64VECTOR)) {
+        auto x = static_cast<F64Vector*>(a.asObject());
+        auto y = static_cast<F64Vector*>(b.asObject());
+        return x->length == y->length && std::equal(x->data(), x->data() + x->length, y->data());
+    }
+    return isEqv(a, b);
+}
+
+Value eq(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("eq?", count, 2, 2);
+    return Value::fromBoolean(args[0] == args[1]);
+}
+
+Value equal(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("equal?", count, 2, 2);
+    return Value::fromBoolean(isEqual(args[0], args[1]));
+}
+
+template <bool (*PREDICATE)(Value)>
+Value typePredicate(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("type predicate", count, 1, 1);
+    return Value::fromBoolean(PREDICATE(args[0]));
+}
+
+bool isAtom(Value value) {
+    return !value.isPair() && !value.isProcedure();
+}
+
+bool isList(Value value) {
+    while (value.isPair()) {
+        value = value.asPair()->cdr;
+    }
+    return value.isNil();
+}
+
+std::size_t listLength(Value list) {
+    std::size_t length = 0;
+    for (; list.isPair(); list = list.asPair()->cdr) {
+        length++;
+    }
+    return length;
+}
+
+Value car(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("car", count, 1, 1);
+    return checkPair("car", args[0])->car;
+}
+
+Value cdr(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("cdr", count, 1, 1);
+    return checkPair("cdr", args[0])->cdr;
+}
+
+Value cons(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("cons", count, 2, 2);
+    return interpreter.cons(args[0], args[1]);
+}
+
+Value setCar(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("set-car!", count, 2, 2);
+    checkPair("set-car!", args[0]);
+    interpreter.setCar(args[0], args[1]);
+    return Value();
+}
+
+Value setCdr(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("set-cdr!", count, 2, 2);
+    checkPair("set-cdr!", args[0]);
+    interpreter.setCdr(args[0], args[1]);
+    return Value();
+}
+
+Value list(Interpreter& interpreter, const Value* args, std::size_t count) {
+    Value result;
+    for (auto i = count; i > 0; i--) {
+        result = interpreter.cons(args[i - 1], result);
+    }
+    return result;
+}
+
+Value length(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("length", count, 1, 1);
+    std::int64_t length = 0;
+    forEach(interpreter, "length", args[0], [&](Value) { length++; });
+    return Value::fromInteger(length);
+}
+
+Value append(Interpreter& interpreter, const Value* args, std::size_t count) {
+    if (count == 0) {
+        return Value();
+    }
+    ListBuilder result(interpreter);
+    for (std::size_t i = 0; i + 1 < count; i++) {
+        forEach(interpreter, "append", args[i], [&](Value item) { result.add(item); });
+    }
+    return result.finish(args[count - 1]);
+}
+
+// Procedures are called with args[0] each time, since a collection during a
+// call may move it.
+Value map(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("map", count, 2, 2);
+    ListBuilder result(interpreter);
+    forEach(interpreter, "map", args[1],
+            [&](Value item) { result.add(interpreter.call(args[0], {item})); });
+    return result.finish();
+}
+
+Value filter(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("filter", count, 2, 2);
+    ListBuilder result(interpreter);
+    forEach(interpreter, "filter", args[1], [&](Value item) {
+        Root kept(interpreter.getHeap(), item);
+        if (interpreter.call(args[0], {item}).isTrue()) {
+            result.add(kept);
+        }
+    });
+    return result.finish();
+}
+
+Value reduce(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("reduce", count, 2, 2);
+    auto list = checkPair("reduce", args[1]);
+    Root result(interpreter.getHeap(), list->car);
+    forEach(interpreter, "reduce", list->cdr,
+            [&](Value item) { result = interpreter.call(args[0], {result, item}); });
+    return result;
+}
+
+// Arguments live in the value stack, where a builtin may overwrite them. The
+// stream builtins keep their place in a stream there rather than holding on
+// to its head, so that what they have walked past can be collected.
+Value* writable(const Value* args) {
+    return const_cast<Value*>(args);
+}
+
+std::int64_t checkCount(const char* name, Value value) {
+    if (!value.isInteger() || value.asInteger() < 0) {
+        throw LispError(std::string(name) + ": expected a non-negative integer, got " +
+                        value.toString());
+    }
+    return value.asInteger();
+}
+
+// Forcing anything but a promise gives it back. Forcing a promise again from
+// within its own forcing can finish first, and then its value stands.
+Value force(Interpreter& interpreter, Value value) {
+    if (!value.isObject(ObjectType::PROMISE)) {
+        return value;
+    }
+    auto promise = static_cast<Promise*>(value.asObject());
+    if (!promise->value.isUnbound()) {
+        return promise->value;
+    }
+    Root root(interpreter.getHeap(), value);
+    auto result = interpreter.callWithList(promise->proc, promise->args);
+    promise = static_cast<Promise*>(root.get().asObject());
+    if (promise->value.isUnbound()) {
+        promise->value = result;
+        interpreter.getHeap().writeBarrier(promise, &promise->value);
+        promise->proc = Value();
+        promise->args = Value();
+    }
+    return promise->value;
+}
+
+Value streamCdr(Interpreter& interpreter, const char* name, Value stream) {
+    return force(interpreter, checkPair(name, stream)->cdr);
+}
+
+// A stream of head followed by what proc, a builtin, gives for args.
+Value lazyCons(Interpreter& interpreter, Value head, Value proc, ListBuilder& args) {
+    Root headRoot(interpreter.getHeap(), head);
+    Root tail(interpreter.getHeap(), interpreter.makePromise(proc, args.finish()));
+    return interpreter.cons(headRoot, tail);
+}
+
+Value makeDelayed(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("delay", count, 1, 1);
+    return interpreter.makePromise(args[0], Value());
+}
+
+Value consStream(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("cons-stream", count, 2, 2);
+    Root tail(interpreter.getHeap(), interpreter.makePromise(args[1], Value()));
+    return interpreter.cons(args[0], tail);
+}
+
+Value forcePromise(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("force", count, 1, 1);
+    return force(interpreter, args[0]);
+}
+
+// A promise already forced to the value given, unless that is a promise.
+Value makePromise(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("make-promise", count, 1, 1);
+    if (args[0].isObject(ObjectType::PROMISE)) {
+        return args[0];
+    }
+    auto promise = interpreter.makePromise(Value(), Value());
+    static_cast<Promise*>(promise.asObject())->value = args[0];
+    return promise;
+}
+
+Value streamCar(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("stream-car", count, 1, 1);
+    return checkPair("stream-car", args[0])->car;
+}
+
+Value streamCdrOf(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-cdr", count, 1, 1);
+    return streamCdr(interpreter, "stream-cdr", args[0]);
+}
+
+bool isStreamPair(Value value) {
+    return value.isPair() && value.asPair()->cdr.isObject(ObjectType::PROMISE);
+}
+
+Value streamTail(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-tail", count, 2, 2);
+    auto stream = writable(args);
+    for (auto n = checkCount("stream-tail", args[1]); n > 0; n--) {
+        *stream = streamCdr(interpreter, "stream-tail", *stream);
+    }
+    return *stream;
+}
+
+Value streamRef(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-ref", count, 2, 2);
+    auto stream = writable(args);
+    for (auto n = checkCount("stream-ref", args[1]); n > 0; n--) {
+        *stream = streamCdr(interpreter, "stream-ref", *stream);
+    }
+    return checkPair("stream-ref", *stream)->car;
+}
+
+// The list of the first n elements, forcing no tail past them.
+Value streamHead(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-head", count, 2, 2);
+    auto stream = writable(args);
+    ListBuilder result(interpreter);
+    for (auto n = checkCount("stream-head", args[1]); n > 0; n--) {
+        result.add(checkPair("stream-head", *stream)->car);
+        if (n > 1) {
+            *stream = streamCdr(interpreter, "stream-head", *stream);
+        }
+    }
+    return result.finish();
+}
+
+// The list of every element, or of at most the count given.
+Value streamToList(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream->list", count, 1, 2);
+    auto limit = count == 2 ? checkCount("stream->list", args[1]) : INT64_MAX;
+    auto stream = writable(args);
+    ListBuilder result(interpreter);
+    for (; limit > 0 && !stream->isNil(); limit--) {
+        result.add(checkPair("stream->list", *stream)->car);
+        if (limit > 1) {
+            *stream = streamCdr(interpreter, "stream->list", *stream);
+        }
+    }
+    return result.finish();
+}
+
+Value streamForEach(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-for-each", count, 2, 2);
+    auto stream = writable(args) + 1;
+    while (!stream->isNil()) {
+        interpreter.call(args[0], {checkPair("stream-for-each", *stream)->car});
+        *stream = streamCdr(interpreter, "stream-for-each", *stream);
+    }
+    return Value();
+}
+
+Value streamMap(Interpreter& interpreter, const Value* args, std::size_t count);
+Value streamFilter(Interpreter& interpreter, const Value* args, std::size_t count);
+Value streamEnumerateInterval(Interpreter& interpreter, const Value* args, std::size_t count);
+
+// What the promises of the streams the builtins above make call to go on.
+// Like every builtin, they live outside the heap.
+Builtin STREAM_MAP{"stream-map", streamMap};
+Builtin STREAM_FILTER{"stream-filter", streamFilter};
+Builtin STREAM_ENUMERATE_INTERVAL{"stream-enumerate-interval", streamEnumerateInterval};
+
+// Streams may also be given as the promises of them, as the rest of a stream
+// made here is, so that it is only forced when needed.
+Value streamMap(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-map", count, 2, SIZE_MAX);
+    auto streams = writable(args);
+    for (std::size_t i = 1; i < count; i++) {
+        streams[i] = force(interpreter, streams[i]);
+        if (streams[i].isNil()) {
+            return Value();
+        }
+        checkPair("stream-map", streams[i]);
+    }
+    ListBuilder cars(interpreter);
+    for (std::size_t i = 1; i < count; i++) {
+        cars.add(streams[i].asPair()->car);
+    }
+    auto head = interpreter.callWithList(args[0], cars.finish());
+    Root headRoot(interpreter.getHeap(), head);
+    ListBuilder rest(interpreter);
+    rest.add(args[0]);
+    for (std::size_t i = 1; i < count; i++) {
+        rest.add(streams[i].asPair()->cdr);
+    }
+    return lazyCons(interpreter, headRoot, Value::fromObject(&STREAM_MAP), rest);
+}
+
+Value streamFilter(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-filter", count, 2, 2);
+    auto stream = writable(args) + 1;
+    for (*stream = force(interpreter, *stream); !stream->isNil();
+         *stream = streamCdr(interpreter, "stream-filter", *stream)) {
+        auto item = checkPair("stream-filter", *stream)->car;
+        if (interpreter.call(args[0], {item}).isTrue()) {
+            ListBuilder rest(interpreter);
+            rest.add(args[0]);
+            rest.add(stream->asPair()->cdr);
+            return lazyCons(interpreter, stream->asPair()->car,
+                            Value::fromObject(&STREAM_FILTER), rest);
+        }
+    }
+    return Value();
+}
+
+// The numbers from low up to high, by one.
+Value streamEnumerateInterval(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("stream-enumerate-interval", count, 2, 2);
+    auto low = checkNumber("stream-enumerate-interval", args[0]);
+    auto high = checkNumber("stream-enumerate-interval", args[1]);
+    if (low.asDouble() > high.asDouble()) {
+        return Value();
+    }
+    auto next = low.isInteger() ? Value::fromInteger(low.asInteger() + 1)
+                                : Value::fromNumber(low.asNumber() + 1);
+    ListBuilder rest(interpreter);
+    rest.add(next);
+    rest.add(args[1]);
+    return lazyCons(interpreter, low, Value::fromObject(&STREAM_ENUMERATE_INTERVAL), rest);
+}
+
+F64Vector* checkF64Vector(const char* name, Value value) {
+    if (!value.isObject(ObjectType::F64VECTOR)) {
+        throw LispError(std::string(name) + ": expected an f64vector, got " + value.toString());
+    }
+    return static_cast<F64Vector*>(value.asObject());
+}
+
+std::uint64_t checkIndex(const char* name, Value vector, Value index) {
+    auto length = checkF64Vector(name, vector)->length;
+    if (!index.isInteger() || index.asInteger() < 0 ||
+        static_cast<std::uint64_t>(index.asInteger()) >= length) {
+        throw LispError(std::string(name) + ": index out of range: " + index.toString());
+    }
+    return index.asInteger();
+}
+
+// Checks that the f64vectors in args all have the same length, returning it.
+std::uint64_t checkLengths(const char* name, const Value* args, std::size_t count) {
+    auto length = checkF64Vector(name, args[0])->length;
+    for (std::size_t i = 1; i < count; i++) {
+        if (checkF64Vector(name, args[i])->length != length) {
+            throw LispError(std::string(name) + ": f64vectors differ in length");
+        }
+    }
+    return length;
+}
+
+Value makeF64Vector(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("make-f64vector", count, 1, 2);
+    auto length = checkCount("make-f64vector", args[0]);
+    auto fill = count == 2 ? checkNumber("make-f64vector", args[1]).asDouble() : 0.0;
+    auto result = interpreter.makeF64Vector(length);
+    auto vector = static_cast<F64Vector*>(result.asObject());
+    std::fill_n(vector->data(), length, fill);
+    return result;
+}
+
+Value f64vector(Interpreter& interpreter, const Value* args, std::size_t count) {
+    for (std::size_t i = 0; i < count; i++) {
+        checkNumber("f64vector", args[i]);
+    }
+    auto result = interpreter.makeF64Vector(count);
+    auto data = static_cast<F64Vector*>(result.asObject())->data();
+    for (std::size_t i = 0; i < count; i++) {
+        data[i] = args[i].asDouble();
+    }
+    return result;
+}
+
+Value f64vectorLength(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("f64vector-length", count, 1, 1);
+    return Value::fromInteger(checkF64Vector("f64vector-length", args[0])->length);
+}
+
+Value f64vectorRef(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("f64vector-ref", count, 2, 2);
+    auto i = checkIndex("f64vector-ref", args[0], args[1]);
+    return Value::fromNumber(static_cast<F64Vector*>(args[0].asObject())->data()[i]);
+}
+
+Value f64vectorSet(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("f64vector-set!", count, 3, 3);
+    auto i = checkIndex("f64vector-set!", args[0], args[1]);
+    auto x = checkNumber("f64vector-set!", args[2]);
+    static_cast<F64Vector*>(args[0].asObject())->data()[i] = x.asDouble();
+    return Value();
+}
+
+Value listToF64Vector(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("list->f64vector", count, 1, 1);
+    std::uint64_t length = 0;
+    forEach(interpreter, "list->f64vector", args[0], [&](Value x) {
+        checkNumber("list->f64vector", x);
+        length++;
+    });
+    auto result = interpreter.makeF64Vector(length);
+    auto data = static_cast<F64Vector*>(result.asObject())->data();
+    for (auto list = args[0]; list.isPair(); list = list.asPair()->cdr) {
+        *data++ = list.asPair()->car.asDouble();
+    }
+    return result;
+}
+
+Value f64vectorToList(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("f64vector->list", count, 1, 1);
+    Root result(interpreter.getHeap());
+    for (auto i = checkF64Vector("f64vector->list", args[0])->length; i > 0; i--) {
+        auto x = static_cast<F64Vector*>(args[0].asObject())->data()[i - 1];
+        result = interpreter.cons(Value::fromNumber(x), result);
+    }
+    return result;
+}
+
+Value vectorSum(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("vector-sum", count, 1, 1);
+    auto vector = checkF64Vector("vector-sum", args[0]);
+    return Value::fromNumber(vectorKernels().sum(vector->data(), vector->length));
+}
+
+Value vectorDot(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("vector-dot", count, 2, 2);
+    auto length = checkLengths("vector-dot", args, 2);
+    auto a = static_cast<F64Vector*>(args[0].asObject())->data();
+    auto b = static_cast<F64Vector*>(args[1].asObject())->data();
+    return Value::fromNumber(vectorKernels().dot(a, b, length));
+}
+
+Value vectorAdd(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("vector-add", count, 2, 2);
+    auto length = checkLengths("vector-add", args, 2);
+    auto result = interpreter.makeF64Vector(length);
+    vectorKernels().add(static_cast<F64Vector*>(args[0].asObject())->data(),
+                        static_cast<F64Vector*>(args[1].asObject())->data(),
+                        static_cast<F64Vector*>(result.asObject())->data(), length);
+    return result;
+}
+
+Value vectorScale(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("vector-scale", count, 2, 2);
+    auto length = checkF64Vector("vector-scale", args[0])->length;
+    auto k = checkNumber("vector-scale", args[1]).asDouble();
+    auto result = interpreter.makeF64Vector(length);
+    vectorKernels().scale(static_cast<F64Vector*>(args[0].asObject())->data(), k,
+                          static_cast<F64Vector*>(result.asObject())->data(), length);
+    return result;
+}
+
+// Turns a procedure into an ArithmeticKernel, if its body is one expression
+// of +, -, * and / and abs, applied through their global names to its
+// parameters, numbers, and lets of those. The kernel gives each element what
+// a call would: parameters are always inexact, so every operation on them is
+// the double one, and only the exact part that + and * accumulate first from
+// constants, or a constant divisor of exact 0, needs care. The rest of the
+// expression, free of parameters, is worked out by calling the builtins.
+class KernelCompiler {
+private:
+    using Op = ArithmeticKernel::Op;
+    using Code = std::vector<ArithmeticKernel::Instruction>;
+
+    // An expression compiled: its code, or when it has no parameters in it,
+    // no code and its value.
+    struct Compiled {
+        Code code;
+        Value value;
+
+        bool isConstant() const {
+            return code.empty();
+        }
+    };
+
+    Interpreter& interpreter;
+    Root proc;
+    // The names bound by the procedure and lets, innermost last.
+    std::vector<std::pair<SymbolId, Compiled>> scope;
+
+    static void emit(Code& code, const Compiled& operand) {
+        if (operand.isConstant()) {
+            code.push_back({Op::CONSTANT, 0, operand.value.asDouble()});
+        } else {
+            code.insert(code.end(), operand.code.begin(), operand.code.end());
+        }
+    }
+
+    // The value of a name the procedure does not bind, if it can be told.
+    std::optional<Value> lookupFree(SymbolId name) {
+        Value value = Value::unbound();
+        if (proc.get().isObject(ObjectType::LAMBDA)) {
+            auto env = EvalEnv::fromValue(static_cast<Lambda*>(proc.get().asObject())->env);
+            for (; env; env = env->getParent()) {
+                if (auto slot = env->find(name)) {
+                    return slot->isUnbound() ? std::nullopt : std::optional(*slot);
+                }
+            }
+            value = *interpreter.globalCell(name);
+        } else {
+            // Any other name is a variable of an enclosing procedure.
+            auto prototype = static_cast<Closure*>(proc.get().asObject())->prototype;
+            for (auto& global : prototype->globals) {
+                if (global.name == name) {
+                    value = *global.cell;
+                }
+            }
+        }
+        if (value.isUnbound()) {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    std::optional<Compiled> compileGuard(Value args) {
+        if (!isList(args) || listLength(args) != 3) {
+            return std::nullopt;
+        }
+        bool holds = true;
+        for (auto conditions = args.asPair()->car; conditions.isPair();
+             conditions = conditions.asPair()->cdr) {
+            auto condition = conditions.asPair()->car.asPair();
+            holds = holds && *interpreter.globalCell(condition->car.asSymbol()) == condition->cdr;
+        }
+        auto rest = args.asPair()->cdr.asPair();
+        return compile(holds ? rest->car : rest->cdr.asPair()->car);
+    }
+
+    std::optional<Compiled> compileLet(Value args) {
+        if (!isList(args) || listLength(args) != 2 || !isList(args.asPair()->car)) {
+            return std::nullopt;
+        }
+        std::vector<std::pair<SymbolId, Compiled>> bindings;
+        for (auto list = args.asPair()->car; list.isPair(); list = list.asPair()->cdr) {
+            auto binding = list.asPair()->car;
+            if (!isList(binding) || listLength(binding) != 2 ||
+                !binding.asPair()->car.isSymbol()) {
+                return std::nullopt;
+            }
+            auto init = compile(binding.asPair()->cdr.asPair()->car);
+            if (!init) {
+                return std::nullopt;
+            }
+            bindings.emplace_back(binding.asPair()->car.asSymbol(), std::move(*init));
+        }
+        auto depth = scope.size();
+        scope.insert(scope.end(), bindings.begin(), bindings.end());
+        auto result = compile(args.asPair()->cdr.asPair()->car);
+        scope.resize(depth);
+        return result;
+    }
+
+    std::optional<Compiled> compileCall(Value op, const std::vector<Compiled>& operands) {
+        auto function = static_cast<Builtin*>(op.asObject())->function;
+        auto count = operands.size();
+        Compiled result;
+        auto& code = result.code;
+        if (function == add || function == multiply) {
+            // As add and multiply do, accumulate exactly while operands are
+            // integers, then go on in doubles from there.
+            bool isAdd = function == add;
+            std::int64_t exact = isAdd ? 0 : 1;
+            bool isExact = true;
+            for (auto& operand : operands) {
+                if (isExact && operand.isConstant() && operand.value.isInteger()) {
+                    auto x = operand.value.asInteger();
+                    std::int64_t next = exact + x;
+                    if (isAdd ? fitsFixnum(next) : multiplyFixnum(exact, x, next)) {
+                        exact = next;
+                        continue;
+                    }
+                }
+                if (isExact) {
+                    code.push_back({Op::CONSTANT, 0, static_cast<double>(exact)});
+                    isExact = false;
+                }
+                emit(code, operand);
+                code.push_back({isAdd ? Op::ADD : Op::MULTIPLY});
+            }
+            return result;
+        }
+        if (function == absolute) {
+            if (count != 1) {
+                return std::nullopt;
+            }
+            emit(code, operands[0]);
+            code.push_back({Op::ABS});
+            return result;
+        }
+        if (count < 1 || count > 2) {
+            return std::nullopt;
+        }
+        auto& divisor = operands[count - 1];
+        if (function == divide && divisor.isConstant() && divisor.value.isInteger() &&
+            divisor.value.asInteger() == 0) {
+            return std::nullopt;
+        }
+        // (- x) is (- 0 x), and (/ x) is (/ 1 x).
+        auto identity = Compiled{{}, Value::fromInteger(function == divide ? 1 : 0)};
+        emit(code, count == 1 ? identity : operands[0]);
+        emit(code, divisor);
+        code.push_back({function == divide ? Op::DIVIDE : Op::SUBTRACT});
+        return result;
+    }
+
+    std::optional<Compiled> compile(Value expr) {
+        if (expr.isNumber()) {
+            return Compiled{{}, expr};
+        }
+        if (expr.isSymbol()) {
+            for (auto it = scope.rbegin(); it != scope.rend(); ++it) {
+                if (it->first == expr.asSymbol()) {
+                    return it->second;
+                }
+            }
+            auto value = lookupFree(expr.asSymbol());
+            if (!value || !value->isNumber()) {
+                return std::nullopt;
+            }
+            return Compiled{{}, *value};
+        }
+        if (!expr.isPair() || !expr.asPair()->car.isSymbol() || !isList(expr)) {
+            return std::nullopt;
+        }
+        auto name = expr.asPair()->car.asSymbol();
+        auto args = expr.asPair()->cdr;
+        if (name == keywords().guard) {
+            return compileGuard(args);
+        }
+        if (name == keywords().let) {
+            return compileLet(args);
+        }
+        if (findSpecialForm(name)) {
+            return std::nullopt;
+        }
+        for (auto& binding : scope) {
+            if (binding.first == name) {
+                return std::nullopt;
+            }
+        }
+        auto op = lookupFree(name);
+        if (!op || !op->isObject(ObjectType::BUILTIN)) {
+            return std::nullopt;
+        }
+        auto function = static_cast<Builtin*>(op->asObject())->function;
+        if (function != add && function != subtract && function != multiply &&
+            function != divide && function != absolute) {
+            return std::nullopt;
+        }
+        std::vector<Compiled> operands;
+        bool constant = true;
+        for (; args.isPair(); args = args.asPair()->cdr) {
+            auto operand = compile(args.asPair()->car);
+            if (!operand) {
+                return std::nullopt;
+            }
+            constant = constant && operand->isConstant();
+            operands.push_back(std::move(*operand));
+        }
+        if (constant) {
+            ListBuilder values(interpreter);
+            for (auto& operand : operands) {
+                values.add(operand.value);
+            }
+            return Compiled{{}, interpreter.callWithList(*op, values.finish())};
+        }
+        return compileCall(*op, operands);
+    }
+
+public:
+    KernelCompiler(Interpreter& interpreter, Value proc)
+        : interpreter{interpreter}, proc{interpreter.getHeap(), proc} {}
+
+    // A kernel of arity inputs, if proc takes that many and can be one.
+    std::optional<ArithmeticKernel> compileProcedure(std::size_t arity) {
+        Value params;
+        Value body;
+        if (proc.get().isObject(ObjectType::LAMBDA)) {
+            auto lambda = static_cast<Lambda*>(proc.get().asObject());
+            params = lambda->params;
+            body = lambda->source;
+        } else if (proc.get().isObject(ObjectType::CLOSURE)) {
+            auto prototype = static_cast<Closure*>(proc.get().asObject())->prototype;
+            params = prototype->params;
+            body = prototype->body;
+        } else {
+            return std::nullopt;
+        }
+        if (!isList(params) || listLength(params) != arity || !body.isPair() ||
+            !body.asPair()->cdr.isNil()) {
+            return std::nullopt;
+        }
+        for (std::uint32_t i = 0; params.isPair(); params = params.asPair()->cdr, i++) {
+            scope.emplace_back(params.asPair()->car.asSymbol(),
+                               Compiled{{{Op::INPUT, i, 0}}, Value()});
+        }
+        auto result = compile(body.asPair()->car);
+        if (!result) {
+            return std::nullopt;
+        }
+        Code code;
+        emit(code, *result);
+        return ArithmeticKernel(std::move(code));
+    }
+};
+
+// With a procedure the KernelCompiler can handle, runs as its kernel, and
+// otherwise calls it for each element.
+Value vectorMap(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("vector-map", count, 2, SIZE_MAX);
+    auto length = checkLengths("vector-map", args + 1, count - 1);
+    std::optional<ArithmeticKernel> kernel;
+    if (length > 0) {
+        kernel = KernelCompiler(interpreter, args[0]).compileProcedure(count - 1);
+    }
+    Root result(interpreter.getHeap(), interpreter.makeF64Vector(length));
+    auto data = [&](Value vector) {
+        return static_cast<F64Vector*>(vector.asObject())->data();
+    };
+    if (kernel) {
+        std::vector<const double*> inputs;
+        for (std::size_t i = 1; i < count; i++) {
+            inputs.push_back(data(args[i]));
+        }
+        kernel->run(inputs.data(), data(result), length);
+        return result;
+    }
+    for (std::uint64_t i = 0; i < length; i++) {
+        Value y;
+        if (count == 2) {
+            y = interpreter.call(args[0], {Value::fromNumber(data(args[1])[i])});
+        } else {
+            ListBuilder xs(interpreter);
+            for (std::size_t j = 1; j < count; j++) {
+                xs.add(Value::fromNumber(data(args[j])[i]));
+            }
+            y = interpreter.callWithList(args[0], xs.finish());
+        }
+        data(result)[i] = checkNumber("vector-map", y).asDouble();
+    }
+    return result;
+}
+
+Value eval(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("eval", count, 1, 1);
+    return interpreter.eval(interpreter.copyToCode(args[0]));
+}
+
+void displayValue(Value value) {
+    if (value.isString()) {
+        std::cout << value.asString()->text;
+    } else {
+        std::cout << value.toString();
+    }
+}
+
+Value display(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("display", count, 1, 1);
+    displayValue(args[0]);
+    return Value();
+}
+
+Value displayln(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("displayln", count, 1, 1);
+    displayValue(args[0]);
+    std::cout << '\n';
+    return Value();
+}
+
+Value newline(Interpreter&, const Value*, std::size_t count) {
+    checkArity("newline", count, 0, 0);
+    std::cout << '\n';
+    return Value();
+}
+
+Value print(Interpreter&, const Value* args, std::size_t count) {
+    for (std::size_t i = 0; i < count; i++) {
+        std::cout << args[i].toString() << '\n';
+    }
+    return Value();
+}
+
+Value error(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("error", count, 0, 1);
+    if (count == 0) {
+        throw LispError("Error");
+    }
+    throw LispError(args[0].isString() ? std::string(args[0].asString()->text)
+                                       : args[0].toString());
+}
+
+Value exitProgram(Interpreter&, const Value* args, std::size_t count) {
+    checkArity("exit", count, 0, 1);
+    std::cout.flush();
+    std::exit(count == 0 ? 0 : static_cast<int>(checkNumber("exit", args[0]).asDouble()));
+}
+
+struct BuiltinEntry {
+    const char* name;
+    BuiltinFunction function;
+};
+
+constexpr BuiltinEntry BUILTINS[] = {
+    {"+", add},
+    {"-", subtract},
+    {"*", multiply},
+    {"/", divide},
+    {"abs", absolute},
+    {"expt", expt},
+    {"modulo", moduloOf},
+    {"remainder", remainderOf},
+    {"=", equalNumber},
+    {"<", less},
+    {">", greater},
+    {"<=", lessOrEqual},
+    {">=", greaterOrEqual},
+    {"even?", isEven},
+    {"odd?", isOdd},
+    {"zero?", isZero},
+    {"not", logicalNot},
+    {"eq?", eq},
+    {"equal?", equal},
+    {"atom?", typePredicate<isAtom>},
+    {"boolean?", typePredicate<[](Value v) { return v.isBoolean(); }>},
+    {"integer?", typePredicate<isIntegral>},
+    {"number?", typePredicate<[](Value v) { return v.isNumber(); }>},
+    {"list?", typePredicate<isList>},
+    {"null?", typePredicate<[](Value v) { return v.isNil(); }>},
+    {"pair?", typePredicate<[](Value v) { return v.isPair(); }>},
+    {"procedure?", typePredicate<[](Value v) { return v.isProcedure(); }>},
+    {"string?", typePredicate<[](Value v) { return v.isString(); }>},
+    {"symbol?", typePredicate<[](Value v) { return v.isSymbol(); }>},
+    {"car", car},
+    {"cdr", cdr},
+    {"cons", cons},
+    {"set-car!", setCar},
+    {"set-cdr!", setCdr},
+    {"list", list},
+    {"length", length},
+    {"append", append},
+    {"map", map},
+    {"filter", filter},
+    {"reduce", reduce},
+    {"apply", applyProcedure},
+    {"eval", eval},
+    {"force", forcePromise},
+    {"make-promise", makePromise},
+    {"promise?", typePredicate<[](Value v) { return v.isObject(ObjectType::PROMISE); }>},
+    {"#%make-promise", makeDelayed},
+    {"#%cons-stream", consStream},
+    {"stream-car", streamCar},
+    {"stream-cdr", streamCdrOf},
+    {"stream-pair?", typePredicate<isStreamPair>},
+    {"stream-null?", typePredicate<[](Value v) { return v.isNil(); }>},
+    {"stream-ref", streamRef},
+    {"stream-tail", streamTail},
+    {"stream-head", streamHead},
+    {"stream->list", streamToList},
+    {"stream-for-each", streamForEach},
+    {"stream-map", streamMap},
+    {"stream-filter", streamFilter},
+    {"stream-enumerate-interval", streamEnumerateInterval},
+    {"make-f64vector", makeF64Vector},
+    {"f64vector", f64vector},
+    {"f64vector?", typePredicate<[](Value v) { return v.isObject(ObjectType::F64VECTOR); }>},
+    {"f64vector-length", f64vectorLength},
+    {"f64vector-ref", f64vectorRef},
+    {"f64vector-set!", f64vectorSet},
+    {"list->f64vector", listToF64Vector},
+    {"f64vector->list", f64vectorToList},
+    {"vector-sum", vectorSum},
+    {"vector-dot", vectorDot},
+    {"vector-add", vectorAdd},
+    {"vector-scale", vectorScale},
+    {"vector-map", vectorMap},
+    {"display", display},
+    {"displayln", displayln},
+    {"newline", newline},
+    {"print", print},
+    {"error", error},
+    {"exit", exitProgram},
+};
+
+}  // namespace
+
+Value applyProcedure(Interpreter& interpreter, const Value* args, std::size_t count) {
+    checkArity("apply", count, 2, 2);
+    return interpreter.callWithList(args[0], args[1]);
+}
+
+void addBuiltins(Interpreter& interpreter) {
+    auto& symbols = SymbolTable::global();
+    for (auto& entry : BUILTINS) {
+        auto builtin = interpreter.getCodeArena().make<Builtin>(entry.name, entry.function);
+        interpreter.define(symbols.intern(entry.name), Value::fromObject(builtin), nullptr);
+    }
+    interpreter.define(symbols.intern("the-empty-stream"), Value(), nullptr);
+}
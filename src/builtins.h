@@ -0,0 +1,17 @@
+#ifndef BUILTINS_H
+#define BUILTINS_H
+
+#include <cstddef>
+
+#include "./value.h"
+
+class Interpreter;
+
+// Binds every builtin procedure in the interpreter's global table.
+void addBuiltins(Interpreter& interpreter);
+
+// The apply builtin. The VM spreads calls to it itself, so that a tail call
+// through apply replaces the caller's activation too.
+Value applyProcedure(Interpreter& interpreter, const Value* args, std::size_t count);
+
+#endif
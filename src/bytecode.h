@@ -0,0 +1,187 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <span>
+
+#include "./value.h"
+
+// Instructions of the VM, which works on the interpreter's value stack.
+// Each is an opcode byte followed by its operands, 32 bits each, unaligned
+// and in native byte order:
+//
+//     CONSTANT index            push constants[index]
+//     NIL                       push ()
+//     LOAD_LOCAL depth, slot,   push a slot of the frame depth frames out;
+//                symbol         symbol names it for errors
+//     LOAD_STACK slot, symbol   push a stack slot of the current activation
+//     LOAD_GLOBAL index         push the value of globals[index].cell
+//     DEFINE_LOCAL slot         store the top in a slot of the current frame,
+//                               and make the top ()
+//     DEFINE_STACK slot         the same, for a stack slot
+//     DEFINE_GLOBAL symbol      bind the global variable to the top, which
+//                               becomes ()
+//     POP                       drop the top
+//     JUMP offset               jumps are relative to the next instruction
+//     JUMP_IF_FALSE offset      pop, and jump if it was #f
+//     JUMP_IF_FALSE_OR_POP off  jump if the top is #f, else pop it
+//     JUMP_IF_TRUE_OR_POP off   jump if the top is not #f, else pop it
+//     CLOSURE index             push a closure of children[index]
+//     CALL count, site          call the procedure below count arguments;
+//                               site indexes callSites, or is NO_CALL_SITE
+//     TAIL_CALL count, site     the same, replacing the current activation
+//     RETURN                    return the top from the current call
+//     ENTER count, size         pop count values into the first slots of a
+//                               new frame of size slots
+//     LEAVE                     return to the enclosing frame
+//     ENTER_STACK first, count, pop count values into the stack slots from
+//                 size          first, leaving the rest of size slots unbound
+//     LIST count                pop a tail and count items below it, and
+//                               push the list of the items ending in it
+//     ADD global                pop two numbers and push their sum; the
+//                               others below work the same way
+//     JUMP_UNLESS_LESS global,  pop two numbers, and jump unless the first is
+//                      offset   less; the others below work the same way
+//     JUMP_UNLESS_GLOBAL global, jump unless globals[global].cell holds the
+//                        offset  value expected
+//
+// The arithmetic instructions stand for two-operand calls of the builtin
+// bound to globals[global] when compiled. They run inline on fixnums and
+// doubles while the global still holds that builtin, and otherwise call
+// whatever it holds.
+#define MINI_LISP_OPCODES(X)     \
+    X(CONSTANT)                  \
+    X(NIL)                       \
+    X(LOAD_LOCAL)                \
+    X(LOAD_STACK)                \
+    X(LOAD_GLOBAL)               \
+    X(DEFINE_LOCAL)              \
+    X(DEFINE_STACK)              \
+    X(DEFINE_GLOBAL)             \
+    X(POP)                       \
+    X(JUMP)                      \
+    X(JUMP_IF_FALSE)             \
+    X(JUMP_IF_FALSE_OR_POP)      \
+    X(JUMP_IF_TRUE_OR_POP)       \
+    X(CLOSURE)                   \
+    X(CALL)                      \
+    X(TAIL_CALL)                 \
+    X(RETURN)                    \
+    X(ENTER)                     \
+    X(LEAVE)                     \
+    X(ENTER_STACK)               \
+    X(LIST)                      \
+    X(ADD)                       \
+    X(SUBTRACT)                  \
+    X(MULTIPLY)                  \
+    X(DIVIDE)                    \
+    X(LESS)                      \
+    X(GREATER)                   \
+    X(NUMBER_EQUAL)              \
+    X(LESS_EQUAL)                \
+    X(GREATER_EQUAL)             \
+    X(JUMP_UNLESS_LESS)          \
+    X(JUMP_UNLESS_GREATER)       \
+    X(JUMP_UNLESS_NUMBER_EQUAL)  \
+    X(JUMP_UNLESS_LESS_EQUAL)    \
+    X(JUMP_UNLESS_GREATER_EQUAL) \
+    X(JUMP_UNLESS_GLOBAL)
+
+enum class Opcode : std::uint8_t {
+#define MINI_LISP_OPCODE_ENUM(name) name,
+    MINI_LISP_OPCODES(MINI_LISP_OPCODE_ENUM)
+#undef MINI_LISP_OPCODE_ENUM
+};
+
+template <typename T>
+T readOperand(const std::uint8_t* at) {
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    return value;
+}
+
+struct Prototype;
+struct NativeCode;
+
+// A reference to a global variable, linked to its cell when compiled. Cells
+// never move, and a redefinition stores into the same cell.
+struct GlobalRef {
+    Value* cell;
+    SymbolId name;
+    // For an arithmetic instruction, the builtin it stands for, and for
+    // JUMP_UNLESS_GLOBAL, the value it checks for.
+    Value expected;
+};
+
+constexpr std::uint32_t NO_CALL_SITE = UINT32_MAX;
+
+// An inline cache for a call whose operator is a global variable. It is
+// valid while the interpreter's global epoch, which every global define
+// advances, still equals epoch; the cell then holds the procedure it was
+// filled from. It is only filled when the call needs no arity check, with
+// the prototype for a closure or the function for a builtin.
+struct CallSite {
+    Value* cell;
+    std::uint64_t epoch{0};
+    const Prototype* prototype{nullptr};
+    BuiltinFunction builtin{nullptr};
+};
+
+// A compiled lambda body, or a top-level form compiled as a procedure of no
+// parameters. Lives in the code arena.
+struct Prototype {
+    std::span<const std::uint8_t> code;
+    std::span<Value> constants;
+    std::span<const Prototype*> children;
+    std::span<const GlobalRef> globals;
+    std::span<CallSite> callSites;
+    // The parameters and body compiled, for the optimizer to inline; the body
+    // is () for a top-level form.
+    Value params;
+    Value body;
+    std::uint32_t required{0};
+    bool variadic{false};
+    // Slots for the parameters, then the body's internal defines, when they
+    // live in a frame. With none, a call makes no frame and runs in the
+    // closure's.
+    std::uint32_t frameSize{0};
+    // Stack slots each activation reserves above its base: those for the
+    // parameters and defines when they do not live in a frame, then those for
+    // the lets in the body that do not either.
+    std::uint32_t stackSlots{0};
+    // How often it has been called, up to the VM's JIT threshold, and its
+    // native code once it is hot.
+    mutable std::uint32_t calls{0};
+    mutable const NativeCode* native{nullptr};
+};
+
+// The variables of one call or let in the VM, resolved by the compiler to
+// slots. Slots not yet defined are unbound.
+struct Frame : Object {
+    Value parent;
+
+    Frame(Value parent, std::uint32_t size)
+        : Object(ObjectType::FRAME, sizeOf(size)), parent{parent} {
+        std::fill_n(slots(), size, Value::unbound());
+    }
+
+    static std::uint32_t sizeOf(std::uint32_t size) {
+        return static_cast<std::uint32_t>(sizeof(Frame) + sizeof(Value) * size);
+    }
+    Value* slots() {
+        return reinterpret_cast<Value*>(this + 1);
+    }
+};
+
+// A procedure compiled for the VM.
+struct Closure : Object {
+    const Prototype* prototype;
+    Value env;
+
+    Closure(const Prototype* prototype, Value env)
+        : Object(ObjectType::CLOSURE, sizeof(Closure)), prototype{prototype}, env{env} {}
+};
+
+#endif
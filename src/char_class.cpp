@@ -0,0 +1,269 @@
+#include "./char_class.h"
+
+#include <atomic>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MINI_LISP_SCAN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+/**********
+ * SCALAR *
+ **********/
+
+const char* skipSpaceScalar(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+const char* findTokenEndScalar(const char* p, const char* end) {
+    while (p < end && !isTokenEnd(*p)) {
+        p++;
+    }
+    return p;
+}
+
+const char* findLineEndScalar(const char* p, const char* end) {
+    auto found = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return found ? found : end;
+}
+
+const char* findStringSpecialScalar(const char* p, const char* end) {
+    while (p < end && *p != '"' && *p != '\\') {
+        p++;
+    }
+    return p;
+}
+
+#ifdef MINI_LISP_SCAN_X86
+
+/********
+ * SSE2 *
+ ********/
+
+// Lanes holding '\t'..'\r' or ' '.
+inline __m128i spaceLanes(__m128i x) {
+    auto shifted = _mm_sub_epi8(x, _mm_set1_epi8('\t'));
+    auto inRange = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+    return _mm_or_si128(inRange, _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')));
+}
+
+// Lanes holding whitespace or one of ( ) ' ` , "
+inline __m128i tokenEndLanes(__m128i x) {
+    // '\'', '(' and ')' are adjacent.
+    auto shifted = _mm_sub_epi8(x, _mm_set1_epi8('\''));
+    auto quoteOrParen = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(2)), shifted);
+    auto others = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(',')),
+                                            _mm_cmpeq_epi8(x, _mm_set1_epi8('"'))),
+                               _mm_cmpeq_epi8(x, _mm_set1_epi8('`')));
+    return _mm_or_si128(spaceLanes(x), _mm_or_si128(quoteOrParen, others));
+}
+
+inline __m128i load16(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+const char* skipSpaceSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        unsigned mask = ~_mm_movemask_epi8(spaceLanes(load16(p))) & 0xFFFF;
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return skipSpaceScalar(p, end);
+}
+
+const char* findTokenEndSse2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        unsigned mask = _mm_movemask_epi8(tokenEndLanes(load16(p)));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return findTokenEndScalar(p, end);
+}
+
+const char* findLineEndSse2(const char* p, const char* end) {
+    auto newline = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(load16(p), newline));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return findLineEndScalar(p, end);
+}
+
+const char* findStringSpecialSse2(const char* p, const char* end) {
+    auto quote = _mm_set1_epi8('"');
+    auto backslash = _mm_set1_epi8('\\');
+    for (; end - p >= 16; p += 16) {
+        auto x = load16(p);
+        unsigned mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return findStringSpecialScalar(p, end);
+}
+
+/********
+ * AVX2 *
+ ********/
+
+TARGET_AVX2 inline __m256i spaceLanes(__m256i x) {
+    auto shifted = _mm256_sub_epi8(x, _mm256_set1_epi8('\t'));
+    auto inRange =
+        _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8('\r' - '\t')), shifted);
+    return _mm256_or_si256(inRange, _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')));
+}
+
+TARGET_AVX2 inline __m256i tokenEndLanes(__m256i x) {
+    auto shifted = _mm256_sub_epi8(x, _mm256_set1_epi8('\''));
+    auto quoteOrParen = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(2)), shifted);
+    auto others = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(',')),
+                                                  _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'))),
+                                  _mm256_cmpeq_epi8(x, _mm256_set1_epi8('`')));
+    return _mm256_or_si256(spaceLanes(x), _mm256_or_si256(quoteOrParen, others));
+}
+
+TARGET_AVX2 inline __m256i load32(const char* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+TARGET_AVX2 const char* skipSpaceAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(spaceLanes(load32(p))));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return skipSpaceSse2(p, end);
+}
+
+TARGET_AVX2 const char* findTokenEndAvx2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        unsigned mask = _mm256_movemask_epi8(tokenEndLanes(load32(p)));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return findTokenEndSse2(p, end);
+}
+
+TARGET_AVX2 const char* findLineEndAvx2(const char* p, const char* end) {
+    auto newline = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(load32(p), newline));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return findLineEndSse2(p, end);
+}
+
+TARGET_AVX2 const char* findStringSpecialAvx2(const char* p, const char* end) {
+    auto quote = _mm256_set1_epi8('"');
+    auto backslash = _mm256_set1_epi8('\\');
+    for (; end - p >= 32; p += 32) {
+        auto x = load32(p);
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(x, quote), _mm256_cmpeq_epi8(x, backslash)));
+        if (mask) {
+            return p + std::countr_zero(mask);
+        }
+    }
+    return findStringSpecialSse2(p, end);
+}
+
+bool cpuHasAvx2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osSavesAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (!osSavesAvx) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+const ScanKernels SCALAR_KERNELS{
+    ScanLevel::SCALAR, skipSpaceScalar, findTokenEndScalar,
+    findLineEndScalar, findStringSpecialScalar,
+};
+
+#ifdef MINI_LISP_SCAN_X86
+const ScanKernels SSE2_KERNELS{
+    ScanLevel::SSE2, skipSpaceSse2, findTokenEndSse2, findLineEndSse2, findStringSpecialSse2,
+};
+
+const ScanKernels AVX2_KERNELS{
+    ScanLevel::AVX2, skipSpaceAvx2, findTokenEndAvx2, findLineEndAvx2, findStringSpecialAvx2,
+};
+#endif
+
+const ScanKernels& kernelsFor(ScanLevel level) {
+    switch (level) {
+#ifdef MINI_LISP_SCAN_X86
+        case ScanLevel::AVX2: return AVX2_KERNELS;
+        case ScanLevel::SSE2: return SSE2_KERNELS;
+#endif
+        default: return SCALAR_KERNELS;
+    }
+}
+
+std::atomic<const ScanKernels*> currentKernels{nullptr};
+
+}  // namespace
+
+ScanLevel detectScanLevel() {
+#ifdef MINI_LISP_SCAN_X86
+    return cpuHasAvx2() ? ScanLevel::AVX2 : ScanLevel::SSE2;
+#else
+    return ScanLevel::SCALAR;
+#endif
+}
+
+const ScanKernels& scanKernels() {
+    auto kernels = currentKernels.load(std::memory_order_relaxed);
+    if (!kernels) {
+        kernels = &kernelsFor(detectScanLevel());
+        currentKernels.store(kernels, std::memory_order_relaxed);
+    }
+    return *kernels;
+}
+
+ScanLevel setScanLevel(ScanLevel level) {
+    if (level > detectScanLevel()) {
+        level = detectScanLevel();
+    }
+    auto& kernels = kernelsFor(level);
+    currentKernels.store(&kernels, std::memory_order_relaxed);
+    return kernels.level;
+}
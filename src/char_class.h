@@ -0,0 +1,89 @@
+#ifndef CHAR_CLASS_H
+#define CHAR_CLASS_H
+
+#include <array>
+#include <cstdint>
+
+// Locale-independent character classes used by the tokenizer.
+enum CharClass : std::uint8_t {
+    CHAR_SPACE = 1,      // ' ', '\t', '\n', '\v', '\f', '\r'
+    CHAR_DELIMITER = 2,  // ( ) ' ` , "
+    CHAR_DIGIT = 4,
+};
+
+inline constexpr auto CHAR_CLASS = [] {
+    std::array<std::uint8_t, 256> table{};
+    for (unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+        table[c] |= CHAR_SPACE;
+    }
+    for (unsigned char c : {'(', ')', '\'', '`', ',', '"'}) {
+        table[c] |= CHAR_DELIMITER;
+    }
+    for (unsigned char c = '0'; c <= '9'; c++) {
+        table[c] |= CHAR_DIGIT;
+    }
+    return table;
+}();
+
+inline bool isSpace(char c) {
+    return CHAR_CLASS[static_cast<unsigned char>(c)] & CHAR_SPACE;
+}
+
+inline bool isTokenEnd(char c) {
+    return CHAR_CLASS[static_cast<unsigned char>(c)] & (CHAR_SPACE | CHAR_DELIMITER);
+}
+
+inline bool isDigit(char c) {
+    return CHAR_CLASS[static_cast<unsigned char>(c)] & CHAR_DIGIT;
+}
+
+enum class ScanLevel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// Each kernel scans [p, end) and returns the first position matching its
+// condition, or `end`.
+struct ScanKernels {
+    ScanLevel level;
+    // First character that is not whitespace.
+    const char* (*skipSpace)(const char* p, const char* end);
+    // First whitespace or delimiter, i.e. the end of an identifier or number.
+    const char* (*findTokenEnd)(const char* p, const char* end);
+    // First '\n', i.e. the end of a comment.
+    const char* (*findLineEnd)(const char* p, const char* end);
+    // First '"' or '\\' inside a string literal.
+    const char* (*findStringSpecial)(const char* p, const char* end);
+};
+
+// Tokens and gaps between them are usually short, so the first few bytes are
+// classified inline and only longer runs are handed to the vector kernel.
+inline constexpr int INLINE_SCAN_BYTES = 8;
+
+inline const char* skipSpace(const ScanKernels& kernels, const char* p, const char* end) {
+    auto limit = end - p > INLINE_SCAN_BYTES ? p + INLINE_SCAN_BYTES : end;
+    while (p < limit && isSpace(*p)) {
+        p++;
+    }
+    return p == limit && p < end ? kernels.skipSpace(p, end) : p;
+}
+
+inline const char* findTokenEnd(const ScanKernels& kernels, const char* p, const char* end) {
+    auto limit = end - p > INLINE_SCAN_BYTES ? p + INLINE_SCAN_BYTES : end;
+    while (p < limit && !isTokenEnd(*p)) {
+        p++;
+    }
+    return p == limit && p < end ? kernels.findTokenEnd(p, end) : p;
+}
+
+// The best level this CPU supports.
+ScanLevel detectScanLevel();
+
+const ScanKernels& scanKernels();
+
+// Selects the kernels used from now on, clamped to what the CPU supports.
+// Returns the level actually selected.
+ScanLevel setScanLevel(ScanLevel level);
+
+#endif
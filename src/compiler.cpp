@@ -0,0 +1,647 @@
+#include "./compiler.h"
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include "./error.h"
+#include "./forms.h"
+#include "./interpreter.h"
+
+namespace {
+
+Value first(Value list) {
+    return list.asPair()->car;
+}
+
+Value rest(Value list) {
+    return list.asPair()->cdr;
+}
+
+Value second(Value list) {
+    return first(rest(list));
+}
+
+std::uint32_t lengthOf(Value list) {
+    std::uint32_t length = 0;
+    for (; list.isPair(); list = rest(list)) {
+        length++;
+    }
+    return length;
+}
+
+// Whether tmpl has an unquote at the nesting level of the template itself,
+// and so needs building at run time.
+bool hasUnquote(Value tmpl, int level) {
+    auto& names = keywords();
+    if (isForm(tmpl, names.unquote)) {
+        return level == 1 || hasUnquote(second(tmpl), level - 1);
+    }
+    if (isForm(tmpl, names.quasiquote)) {
+        return hasUnquote(second(tmpl), level + 1);
+    }
+    for (; tmpl.isPair(); tmpl = rest(tmpl)) {
+        if (isForm(tmpl, names.unquote) || isForm(tmpl, names.quasiquote)) {
+            return hasUnquote(tmpl, level);
+        }
+        if (hasUnquote(first(tmpl), level)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+const Prototype* Compiler::compileTopLevel(Interpreter& interpreter, Value expr) {
+    Compiler compiler(interpreter);
+    compiler.compile(expr, true);
+    compiler.emit(Opcode::RETURN);
+    auto prototype = compiler.finish();
+    prototype->stackSlots = compiler.stackSlots;
+    return prototype;
+}
+
+Prototype* Compiler::finish() {
+    auto& arena = interpreter.getCodeArena();
+    auto prototype = arena.make<Prototype>();
+    auto codeCopy = arena.makeArray<std::uint8_t>(code.size());
+    std::copy(code.begin(), code.end(), codeCopy.begin());
+    prototype->code = codeCopy;
+    prototype->constants = arena.makeArray<Value>(constants.size());
+    for (std::size_t i = 0; i < constants.size(); i++) {
+        prototype->constants[i] = constants[i];
+        interpreter.addCodeRoot(&prototype->constants[i]);
+    }
+    prototype->children = arena.makeArray<const Prototype*>(children.size());
+    std::copy(children.begin(), children.end(), prototype->children.begin());
+    auto globalsCopy = arena.makeArray<GlobalRef>(globals.size());
+    for (std::size_t i = 0; i < globals.size(); i++) {
+        globalsCopy[i] = globals[i];
+        interpreter.addCodeRoot(&globalsCopy[i].expected);
+    }
+    prototype->globals = globalsCopy;
+    prototype->callSites = arena.makeArray<CallSite>(callSites.size());
+    std::copy(callSites.begin(), callSites.end(), prototype->callSites.begin());
+    return prototype;
+}
+
+void Compiler::emit(Opcode op, std::uint32_t operand) {
+    emit(op);
+    emitOperand(operand);
+}
+
+void Compiler::emitOperand(std::uint32_t operand) {
+    auto at = code.size();
+    code.resize(at + sizeof(operand));
+    std::memcpy(&code[at], &operand, sizeof(operand));
+}
+
+void Compiler::emitConstant(Value value) {
+    if (value.isNil()) {
+        emit(Opcode::NIL);
+        return;
+    }
+    emit(Opcode::CONSTANT, static_cast<std::uint32_t>(constants.size()));
+    constants.push_back(value);
+}
+
+std::size_t Compiler::emitJump(Opcode op) {
+    emit(op);
+    auto at = code.size();
+    emitOperand(0);
+    return at;
+}
+
+void Compiler::patchJump(std::size_t at) {
+    auto offset = static_cast<std::int32_t>(code.size() - (at + sizeof(std::int32_t)));
+    std::memcpy(&code[at], &offset, sizeof(offset));
+}
+
+// Quasiquote templates are scanned whole, as their unquotes are evaluated.
+// A name bound again inside expr still counts, which at worst keeps a scope
+// on the heap that need not be.
+bool Compiler::refersTo(Value expr, const std::vector<SymbolId>& scope) {
+    if (expr.isSymbol()) {
+        return std::find(scope.begin(), scope.end(), expr.asSymbol()) != scope.end();
+    }
+    if (!expr.isPair()) {
+        return false;
+    }
+    interpreter.checkNativeStack();
+    if (first(expr) == Value::fromSymbol(keywords().quote)) {
+        return false;
+    }
+    for (; expr.isPair(); expr = rest(expr)) {
+        if (refersTo(first(expr), scope)) {
+            return true;
+        }
+    }
+    return refersTo(expr, scope);
+}
+
+bool Compiler::captures(Value expr, const std::vector<SymbolId>& scope) {
+    if (!expr.isPair()) {
+        return false;
+    }
+    interpreter.checkNativeStack();
+    auto& names = keywords();
+    auto head = first(expr);
+    auto args = rest(expr);
+    if (head == Value::fromSymbol(names.quote)) {
+        return false;
+    }
+    if (head == Value::fromSymbol(names.delay)) {
+        return refersTo(args, scope);
+    }
+    if (head == Value::fromSymbol(names.consStream) && args.isPair()) {
+        return captures(first(args), scope) || refersTo(rest(args), scope);
+    }
+    Value params;
+    Value body;
+    if (head == Value::fromSymbol(names.lambda) && args.isPair()) {
+        params = first(args);
+        body = rest(args);
+    } else if (head == Value::fromSymbol(names.define) && args.isPair() &&
+               first(args).isPair()) {
+        params = rest(first(args));
+        body = rest(args);
+    } else {
+        for (; expr.isPair(); expr = rest(expr)) {
+            if (captures(first(expr), scope)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // The names the lambda binds itself hide those outside.
+    std::vector<SymbolId> bound;
+    for (; params.isPair(); params = rest(params)) {
+        if (first(params).isSymbol()) {
+            bound.push_back(first(params).asSymbol());
+        }
+    }
+    if (params.isSymbol()) {
+        bound.push_back(params.asSymbol());
+    }
+    collectDefines(interpreter, body, bound);
+    std::vector<SymbolId> free;
+    for (auto name : scope) {
+        if (std::find(bound.begin(), bound.end(), name) == bound.end()) {
+            free.push_back(name);
+        }
+    }
+    return !free.empty() && refersTo(body, free);
+}
+
+// The innermost scope binding name wins, and within a scope the last slot
+// for it, as a later binding of a name replaces an earlier one. Depths count
+// only the scopes with a frame.
+std::optional<Compiler::Local> Compiler::resolve(SymbolId name) const {
+    std::uint32_t depth = 0;
+    for (auto compiler = this; compiler; compiler = compiler->enclosing) {
+        for (auto scope = compiler->scopes.rbegin(); scope != compiler->scopes.rend(); ++scope) {
+            auto& scopeNames = scope->names;
+            if (scopeNames.empty()) {
+                continue;
+            }
+            auto found = std::find(scopeNames.rbegin(), scopeNames.rend(), name);
+            if (found != scopeNames.rend()) {
+                auto slot = static_cast<std::uint32_t>(scopeNames.rend() - found - 1);
+                return scope->onStack ? Local{true, 0, scope->first + slot}
+                                      : Local{false, depth, slot};
+            }
+            if (!scope->onStack) {
+                depth++;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+void Compiler::compileVariable(SymbolId name) {
+    if (auto local = resolve(name)) {
+        if (local->onStack) {
+            emit(Opcode::LOAD_STACK, local->slot);
+        } else {
+            emit(Opcode::LOAD_LOCAL, local->depth);
+            emitOperand(local->slot);
+        }
+        emitOperand(name);
+        return;
+    }
+    emit(Opcode::LOAD_GLOBAL, static_cast<std::uint32_t>(globals.size()));
+    globals.push_back({interpreter.globalCell(name), name, Value()});
+}
+
+void Compiler::compile(Value expr, bool tail) {
+    switch (expr.getType()) {
+        case ValueType::SYMBOL: compileVariable(expr.asSymbol()); return;
+        case ValueType::PAIR: break;
+        case ValueType::NIL: throw LispError("Evaluating nil is prohibited");
+        default: emitConstant(expr); return;
+    }
+    interpreter.checkNativeStack();
+    auto head = first(expr);
+    if (head.isSymbol()) {
+        if (auto form = findForm(head.asSymbol())) {
+            (this->*form)(rest(expr), tail);
+            return;
+        }
+    }
+    compileCall(expr, tail);
+}
+
+void Compiler::compileBody(Value body, bool tail) {
+    if (body.isNil()) {
+        emit(Opcode::NIL);
+        return;
+    }
+    for (; rest(body).isPair(); body = rest(body)) {
+        compile(first(body), false);
+        emit(Opcode::POP);
+    }
+    compile(first(body), tail);
+}
+
+void Compiler::compileCall(Value expr, bool tail) {
+    if (auto op = findArithmetic(expr)) {
+        compileArithmetic(expr, *op);
+        return;
+    }
+    auto args = rest(expr);
+    while (args.isPair()) {
+        args = rest(args);
+    }
+    if (!args.isNil()) {
+        throw LispError("Malformed procedure call");
+    }
+    auto op = first(expr);
+    compile(op, false);
+    for (args = rest(expr); args.isPair(); args = rest(args)) {
+        compile(first(args), false);
+    }
+    emit(tail ? Opcode::TAIL_CALL : Opcode::CALL, lengthOf(rest(expr)));
+    if (op.isSymbol() && !resolve(op.asSymbol())) {
+        emitOperand(static_cast<std::uint32_t>(callSites.size()));
+        callSites.push_back({interpreter.globalCell(op.asSymbol())});
+    } else {
+        emitOperand(NO_CALL_SITE);
+    }
+}
+
+std::optional<Opcode> Compiler::findArithmetic(Value expr) {
+    static const std::unordered_map<SymbolId, Opcode> ARITHMETIC = [] {
+        auto& symbols = SymbolTable::global();
+        return std::unordered_map<SymbolId, Opcode>{
+            {symbols.intern("+"), Opcode::ADD},
+            {symbols.intern("-"), Opcode::SUBTRACT},
+            {symbols.intern("*"), Opcode::MULTIPLY},
+            {symbols.intern("/"), Opcode::DIVIDE},
+            {symbols.intern("<"), Opcode::LESS},
+            {symbols.intern(">"), Opcode::GREATER},
+            {symbols.intern("="), Opcode::NUMBER_EQUAL},
+            {symbols.intern("<="), Opcode::LESS_EQUAL},
+            {symbols.intern(">="), Opcode::GREATER_EQUAL},
+        };
+    }();
+    if (!expr.isPair() || !first(expr).isSymbol() || lengthOf(rest(expr)) != 2 ||
+        !rest(rest(rest(expr))).isNil()) {
+        return std::nullopt;
+    }
+    auto name = first(expr).asSymbol();
+    auto it = ARITHMETIC.find(name);
+    if (it == ARITHMETIC.end() || resolve(name)) {
+        return std::nullopt;
+    }
+    auto cell = interpreter.globalCell(name);
+    if (!cell->isObject(ObjectType::BUILTIN) ||
+        static_cast<Builtin*>(cell->asObject())->name != SymbolTable::global().name(name)) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void Compiler::compileArithmetic(Value expr, Opcode op) {
+    compile(second(expr), false);
+    compile(second(rest(expr)), false);
+    auto name = first(expr).asSymbol();
+    auto cell = interpreter.globalCell(name);
+    emit(op, static_cast<std::uint32_t>(globals.size()));
+    globals.push_back({cell, name, *cell});
+}
+
+// Comparisons branch on their result directly rather than pushing it.
+std::size_t Compiler::compileTest(Value test) {
+    auto op = findArithmetic(test);
+    std::optional<Opcode> branch;
+    switch (op.value_or(Opcode::ADD)) {
+        case Opcode::LESS: branch = Opcode::JUMP_UNLESS_LESS; break;
+        case Opcode::GREATER: branch = Opcode::JUMP_UNLESS_GREATER; break;
+        case Opcode::NUMBER_EQUAL: branch = Opcode::JUMP_UNLESS_NUMBER_EQUAL; break;
+        case Opcode::LESS_EQUAL: branch = Opcode::JUMP_UNLESS_LESS_EQUAL; break;
+        case Opcode::GREATER_EQUAL: branch = Opcode::JUMP_UNLESS_GREATER_EQUAL; break;
+        default: break;
+    }
+    if (!branch) {
+        compile(test, false);
+        return emitJump(Opcode::JUMP_IF_FALSE);
+    }
+    compileArithmetic(test, *branch);
+    auto at = code.size();
+    emitOperand(0);
+    return at;
+}
+
+// Builds a copy of tmpl with each (unquote x) at the same nesting level
+// replaced by the value of x. Parts without one are shared with tmpl.
+void Compiler::compileTemplate(Value tmpl, int level) {
+    auto& names = keywords();
+    if (!hasUnquote(tmpl, level)) {
+        emitConstant(tmpl);
+        return;
+    }
+    if (isForm(tmpl, names.unquote) && level == 1) {
+        compile(second(tmpl), false);
+        return;
+    }
+    interpreter.checkNativeStack();
+    if (isForm(tmpl, names.unquote) || isForm(tmpl, names.quasiquote)) {
+        emitConstant(first(tmpl));
+        compileTemplate(second(tmpl), isForm(tmpl, names.unquote) ? level - 1 : level + 1);
+        emit(Opcode::NIL);
+        emit(Opcode::LIST, 2);
+        return;
+    }
+    std::uint32_t count = 0;
+    for (; tmpl.isPair() && !isForm(tmpl, names.unquote) && !isForm(tmpl, names.quasiquote);
+         tmpl = rest(tmpl)) {
+        compileTemplate(first(tmpl), level);
+        count++;
+    }
+    compileTemplate(tmpl, level);
+    emit(Opcode::LIST, count);
+}
+
+void Compiler::compileLambda(Value params, Value body) {
+    checkParams(params);
+    std::vector<SymbolId> scope;
+    auto param = params;
+    for (; param.isPair(); param = rest(param)) {
+        scope.push_back(first(param).asSymbol());
+    }
+    auto required = static_cast<std::uint32_t>(scope.size());
+    if (param.isSymbol()) {
+        scope.push_back(param.asSymbol());
+    }
+    collectDefines(interpreter, body, scope);
+    auto size = static_cast<std::uint32_t>(scope.size());
+    bool onStack = !captures(body, scope);
+
+    Compiler compiler(interpreter, this);
+    compiler.scopes.push_back({std::move(scope), onStack, 0});
+    if (onStack) {
+        compiler.nextStackSlot = compiler.stackSlots = size;
+    }
+    compiler.compileBody(body, true);
+    compiler.emit(Opcode::RETURN);
+    auto prototype = compiler.finish();
+    prototype->params = params;
+    prototype->body = body;
+    prototype->required = required;
+    prototype->variadic = param.isSymbol();
+    prototype->frameSize = onStack ? 0 : size;
+    prototype->stackSlots = compiler.stackSlots;
+    emit(Opcode::CLOSURE, static_cast<std::uint32_t>(children.size()));
+    children.push_back(prototype);
+}
+
+void Compiler::compileDefinition(SymbolId name) {
+    if (scopes.empty()) {
+        emit(Opcode::DEFINE_GLOBAL, name);
+        return;
+    }
+    // Every define in a body was found by collectDefines(), except those nested
+    // in a quasiquote.
+    auto& scope = scopes.back();
+    auto found = std::find(scope.names.rbegin(), scope.names.rend(), name);
+    if (found == scope.names.rend()) {
+        throw LispError("Malformed define");
+    }
+    auto slot = static_cast<std::uint32_t>(scope.names.rend() - found - 1);
+    if (scope.onStack) {
+        emit(Opcode::DEFINE_STACK, scope.first + slot);
+    } else {
+        emit(Opcode::DEFINE_LOCAL, slot);
+    }
+}
+
+void Compiler::quoteForm(Value args, bool) {
+    checkOperands("quote", args, 1, 1);
+    emitConstant(first(args));
+}
+
+void Compiler::quasiquoteForm(Value args, bool) {
+    checkOperands("quasiquote", args, 1, 1);
+    compileTemplate(first(args), 1);
+}
+
+void Compiler::ifForm(Value args, bool tail) {
+    checkOperands("if", args, 2, 3);
+    auto otherwise = compileTest(first(args));
+    compile(second(args), tail);
+    auto end = emitJump(Opcode::JUMP);
+    patchJump(otherwise);
+    auto alternative = rest(rest(args));
+    if (alternative.isNil()) {
+        emit(Opcode::NIL);
+    } else {
+        compile(first(alternative), tail);
+    }
+    patchJump(end);
+}
+
+void Compiler::andForm(Value args, bool tail) {
+    checkOperands("and", args, 0, std::numeric_limits<std::size_t>::max());
+    if (args.isNil()) {
+        emitConstant(Value::fromBoolean(true));
+        return;
+    }
+    std::vector<std::size_t> ends;
+    for (; rest(args).isPair(); args = rest(args)) {
+        compile(first(args), false);
+        ends.push_back(emitJump(Opcode::JUMP_IF_FALSE_OR_POP));
+    }
+    compile(first(args), tail);
+    for (auto end : ends) {
+        patchJump(end);
+    }
+}
+
+void Compiler::orForm(Value args, bool tail) {
+    checkOperands("or", args, 0, std::numeric_limits<std::size_t>::max());
+    if (args.isNil()) {
+        emitConstant(Value::fromBoolean(false));
+        return;
+    }
+    std::vector<std::size_t> ends;
+    for (; rest(args).isPair(); args = rest(args)) {
+        compile(first(args), false);
+        ends.push_back(emitJump(Opcode::JUMP_IF_TRUE_OR_POP));
+    }
+    compile(first(args), tail);
+    for (auto end : ends) {
+        patchJump(end);
+    }
+}
+
+void Compiler::lambdaForm(Value args, bool) {
+    checkOperands("lambda", args, 2, std::numeric_limits<std::size_t>::max());
+    compileLambda(first(args), rest(args));
+}
+
+void Compiler::defineForm(Value args, bool) {
+    checkOperands("define", args, 2, std::numeric_limits<std::size_t>::max());
+    auto target = first(args);
+    if (target.isPair()) {
+        if (!first(target).isSymbol()) {
+            throw LispError("Malformed define");
+        }
+        compileLambda(rest(target), rest(args));
+        compileDefinition(first(target).asSymbol());
+    } else if (target.isSymbol()) {
+        checkOperands("define", args, 2, 2);
+        compile(second(args), false);
+        compileDefinition(target.asSymbol());
+    } else {
+        throw LispError("Malformed define");
+    }
+}
+
+void Compiler::condForm(Value args, bool tail) {
+    checkOperands("cond", args, 0, std::numeric_limits<std::size_t>::max());
+    std::vector<std::size_t> ends;
+    for (; args.isPair(); args = rest(args)) {
+        auto clause = first(args);
+        checkOperands("cond clause", clause, 1, std::numeric_limits<std::size_t>::max());
+        auto test = first(clause);
+        if (test == Value::fromSymbol(keywords().elseKeyword)) {
+            compileBody(rest(clause), tail);
+            ends.push_back(emitJump(Opcode::JUMP));
+            continue;
+        }
+        if (rest(clause).isNil()) {
+            compile(test, false);
+            ends.push_back(emitJump(Opcode::JUMP_IF_TRUE_OR_POP));
+            continue;
+        }
+        auto next = compileTest(test);
+        compileBody(rest(clause), tail);
+        ends.push_back(emitJump(Opcode::JUMP));
+        patchJump(next);
+    }
+    emit(Opcode::NIL);
+    for (auto end : ends) {
+        patchJump(end);
+    }
+}
+
+void Compiler::beginForm(Value args, bool tail) {
+    checkOperands("begin", args, 0, std::numeric_limits<std::size_t>::max());
+    compileBody(args, tail);
+}
+
+void Compiler::letForm(Value args, bool tail) {
+    checkOperands("let", args, 2, std::numeric_limits<std::size_t>::max());
+    auto bindings = first(args);
+    checkOperands("let", bindings, 0, std::numeric_limits<std::size_t>::max());
+    std::vector<SymbolId> scope;
+    for (; bindings.isPair(); bindings = rest(bindings)) {
+        checkOperands("let binding", first(bindings), 2, 2);
+        if (!first(first(bindings)).isSymbol()) {
+            throw LispError("Malformed let binding");
+        }
+        compile(second(first(bindings)), false);
+        scope.push_back(first(first(bindings)).asSymbol());
+    }
+    auto count = static_cast<std::uint32_t>(scope.size());
+    collectDefines(interpreter, rest(args), scope);
+    auto size = static_cast<std::uint32_t>(scope.size());
+
+    // The slots of a let on the stack are free again after its body.
+    bool onStack = !captures(rest(args), scope);
+    auto firstSlot = nextStackSlot;
+    bool hasFrame = size > 0 && !onStack;
+    if (size > 0 && onStack) {
+        nextStackSlot += size;
+        stackSlots = std::max(stackSlots, nextStackSlot);
+        emit(Opcode::ENTER_STACK, firstSlot);
+        emitOperand(count);
+        emitOperand(size);
+    } else if (hasFrame) {
+        emit(Opcode::ENTER, count);
+        emitOperand(size);
+    }
+    scopes.push_back({std::move(scope), onStack, firstSlot});
+    compileBody(rest(args), tail);
+    scopes.pop_back();
+    nextStackSlot = firstSlot;
+    if (hasFrame) {
+        emit(Opcode::LEAVE);
+    }
+}
+
+void Compiler::delayForm(Value args, bool tail) {
+    compile(expandDelay(interpreter, args), tail);
+}
+
+void Compiler::consStreamForm(Value args, bool tail) {
+    compile(expandConsStream(interpreter, args), tail);
+}
+
+void Compiler::guardForm(Value args, bool tail) {
+    checkOperands("guard", args, 3, 3);
+    checkOperands("guard", first(args), 0, std::numeric_limits<std::size_t>::max());
+    std::vector<std::size_t> failed;
+    for (auto conditions = first(args); conditions.isPair(); conditions = rest(conditions)) {
+        auto condition = first(conditions);
+        if (!condition.isPair() || !first(condition).isSymbol()) {
+            throw LispError("Malformed guard");
+        }
+        auto name = first(condition).asSymbol();
+        emit(Opcode::JUMP_UNLESS_GLOBAL, static_cast<std::uint32_t>(globals.size()));
+        globals.push_back({interpreter.globalCell(name), name, rest(condition)});
+        failed.push_back(code.size());
+        emitOperand(0);
+    }
+    compile(second(args), tail);
+    auto end = emitJump(Opcode::JUMP);
+    for (auto at : failed) {
+        patchJump(at);
+    }
+    compile(second(rest(args)), tail);
+    patchJump(end);
+}
+
+Compiler::FormCompiler Compiler::findForm(SymbolId name) {
+    static const std::unordered_map<SymbolId, FormCompiler> FORMS = [] {
+        auto& symbols = SymbolTable::global();
+        return std::unordered_map<SymbolId, FormCompiler>{
+            {symbols.intern("quote"), &Compiler::quoteForm},
+            {symbols.intern("quasiquote"), &Compiler::quasiquoteForm},
+            {symbols.intern("if"), &Compiler::ifForm},
+            {symbols.intern("and"), &Compiler::andForm},
+            {symbols.intern("or"), &Compiler::orForm},
+            {symbols.intern("lambda"), &Compiler::lambdaForm},
+            {symbols.intern("define"), &Compiler::defineForm},
+            {symbols.intern("cond"), &Compiler::condForm},
+            {symbols.intern("begin"), &Compiler::beginForm},
+            {symbols.intern("let"), &Compiler::letForm},
+            {keywords().delay, &Compiler::delayForm},
+            {keywords().consStream, &Compiler::consStreamForm},
+            {keywords().guard, &Compiler::guardForm},
+        };
+    }();
+    auto it = FORMS.find(name);
+    return it == FORMS.end() ? nullptr : it->second;
+}
@@ -0,0 +1,121 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "./bytecode.h"
+#include "./value.h"
+
+class Interpreter;
+
+// Compiles datums into bytecode for the VM, one Prototype per lambda, all
+// allocated in the interpreter's code arena.
+//
+// Local variables are resolved as they are compiled to a frame depth and a
+// slot. Each lambda body and let has a scope of slots for its parameters or
+// bindings followed by the names its body defines, found by scanning it
+// first; a scope with no slots makes no frame at run time. Names in no
+// scope are global.
+//
+// Only a lambda can keep a scope alive past its call, so a scope that no
+// lambda in its body refers to lives in stack slots of its activation
+// instead of a heap frame. Lets nested in a lambda body share its
+// activation's slots, and a lambda made there captures only the frames.
+class Compiler {
+private:
+    struct Scope {
+        std::vector<SymbolId> names;
+        bool onStack;
+        // The stack slot of the first name, for a scope on the stack.
+        std::uint32_t first;
+    };
+    // Where a local variable lives: a stack slot of the current activation,
+    // or a slot of the frame depth frames out.
+    struct Local {
+        bool onStack;
+        std::uint32_t depth;
+        std::uint32_t slot;
+    };
+
+    Interpreter& interpreter;
+    // The compiler of the lambda this one is nested in.
+    Compiler* enclosing;
+    std::vector<std::uint8_t> code;
+    std::vector<Value> constants;
+    std::vector<const Prototype*> children;
+    std::vector<GlobalRef> globals;
+    std::vector<CallSite> callSites;
+    std::vector<Scope> scopes;
+    // Stack slots in use by the scopes open so far, and the most ever used.
+    std::uint32_t nextStackSlot{0};
+    std::uint32_t stackSlots{0};
+
+    explicit Compiler(Interpreter& interpreter, Compiler* enclosing = nullptr)
+        : interpreter{interpreter}, enclosing{enclosing} {}
+
+    Prototype* finish();
+
+    // Whether expr refers to a name in scope, other than inside a quote.
+    bool refersTo(Value expr, const std::vector<SymbolId>& scope);
+    // Whether a lambda in expr refers to a name in scope that it does not
+    // bind itself, and so needs the scope kept in a frame. A delay or
+    // cons-stream counts, as it makes one.
+    bool captures(Value expr, const std::vector<SymbolId>& scope);
+    std::optional<Local> resolve(SymbolId name) const;
+    void compileVariable(SymbolId name);
+
+    void emit(Opcode op) {
+        code.push_back(static_cast<std::uint8_t>(op));
+    }
+    void emit(Opcode op, std::uint32_t operand);
+    void emitOperand(std::uint32_t operand);
+    void emitConstant(Value value);
+    // Emits a jump to be patched later, returning where its offset is.
+    std::size_t emitJump(Opcode op);
+    // Points the jump at the end of the code so far.
+    void patchJump(std::size_t at);
+
+    // tail is whether expr is in tail position, so that a call there can
+    // replace the current activation.
+    void compile(Value expr, bool tail);
+    void compileBody(Value body, bool tail);
+    void compileCall(Value expr, bool tail);
+    void compileTemplate(Value tmpl, int level);
+    void compileLambda(Value params, Value body);
+    // The arithmetic instruction for expr, if it is a call of two operands to
+    // an arithmetic builtin through its own global name.
+    std::optional<Opcode> findArithmetic(Value expr);
+    // Compiles the operands of such a call, then op for it.
+    void compileArithmetic(Value expr, Opcode op);
+    // Compiles the test of a conditional and a jump taken if it is false,
+    // returning where the jump's offset is.
+    std::size_t compileTest(Value test);
+    void compileDefinition(SymbolId name);
+
+    void quoteForm(Value args, bool tail);
+    void quasiquoteForm(Value args, bool tail);
+    void ifForm(Value args, bool tail);
+    void andForm(Value args, bool tail);
+    void orForm(Value args, bool tail);
+    void lambdaForm(Value args, bool tail);
+    void defineForm(Value args, bool tail);
+    void condForm(Value args, bool tail);
+    void beginForm(Value args, bool tail);
+    void letForm(Value args, bool tail);
+    void delayForm(Value args, bool tail);
+    void consStreamForm(Value args, bool tail);
+    void guardForm(Value args, bool tail);
+
+    using FormCompiler = void (Compiler::*)(Value args, bool tail);
+    static FormCompiler findForm(SymbolId name);
+
+public:
+    // Compiles a top-level datum, which must be in the code arena, as the
+    // body of a procedure of no parameters.
+    static const Prototype* compileTopLevel(Interpreter& interpreter, Value expr);
+};
+
+#endif
@@ -8,4 +8,9 @@ public:
     using runtime_error::runtime_error;
 };
 
+class LispError : public std::runtime_error {
+public:
+    using runtime_error::runtime_error;
+};
+
 #endif
\ No newline at end of file
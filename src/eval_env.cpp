@@ -0,0 +1,38 @@
+#include "./eval_env.h"
+
+#include <new>
+
+// The frame and its bindings are allocated together, so that only the parent
+// needs rooting.
+EvalEnv* EvalEnv::create(Heap& heap, EvalEnv* parent, std::uint32_t capacity) {
+    Root parentRoot(heap, toValue(parent));
+    auto size = sizeof(EvalEnv) + Bindings::sizeOf(capacity);
+    auto memory = static_cast<std::byte*>(heap.allocate(size));
+    auto bindings = new (memory + sizeof(EvalEnv)) Bindings(capacity);
+    return new (memory) EvalEnv(parentRoot, Value::fromObject(bindings));
+}
+
+void EvalEnv::define(Heap& heap, EvalEnv* env, SymbolId name, Value value) {
+    if (auto slot = env->find(name)) {
+        *slot = value;
+        heap.writeBarrier(env->getBindings(), slot);
+        return;
+    }
+    if (env->getBindings()->count == env->getBindings()->capacity) {
+        Root envRoot(heap, Value::fromObject(env));
+        Root valueRoot(heap, value);
+        auto grown = std::max<std::uint32_t>(env->getBindings()->capacity * 2, 4);
+        auto moved = new (heap.allocate(Bindings::sizeOf(grown))) Bindings(grown);
+        env = static_cast<EvalEnv*>(envRoot.get().asObject());
+        value = valueRoot;
+        auto old = env->getBindings();
+        std::copy_n(old->data(), old->count, moved->data());
+        moved->count = old->count;
+        env->bindings = Value::fromObject(moved);
+        heap.writeBarrier(env, &env->bindings);
+    }
+    auto frame = env->getBindings();
+    auto& binding = frame->data()[frame->count++];
+    binding = {Value::fromSymbol(name), value};
+    heap.writeBarrier(frame, &binding.value);
+}
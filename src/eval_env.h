@@ -0,0 +1,94 @@
+#ifndef EVAL_ENV_H
+#define EVAL_ENV_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "./heap.h"
+#include "./value.h"
+
+struct Binding {
+    Value name;
+    Value value;
+};
+
+// The variables of one frame, stored after the header. Slots past count are
+// kept at () so that the collector never sees garbage.
+struct Bindings : Object {
+    std::uint32_t count{0};
+    std::uint32_t capacity;
+
+    explicit Bindings(std::uint32_t capacity)
+        : Object(ObjectType::BINDINGS, sizeOf(capacity)), capacity{capacity} {
+        std::fill_n(data(), capacity, Binding{});
+    }
+
+    static std::uint32_t sizeOf(std::uint32_t capacity) {
+        return static_cast<std::uint32_t>(sizeof(Bindings) + sizeof(Binding) * capacity);
+    }
+    Binding* data() {
+        return reinterpret_cast<Binding*>(this + 1);
+    }
+};
+
+// One frame of local variables, searched linearly by symbol id. Frames are
+// small, so this beats hashing. A frame without parent is enclosed directly
+// by the interpreter's global table.
+//
+// Frames live in the collected heap and move, so an EvalEnv* is only good
+// until the next allocation; keep frames needed past one in a Root.
+class EvalEnv : public Object {
+private:
+    Value parent;
+    Value bindings;
+
+    Bindings* getBindings() const {
+        return static_cast<Bindings*>(bindings.asObject());
+    }
+
+public:
+    EvalEnv(Value parent, Value bindings)
+        : Object(ObjectType::ENVIRONMENT, sizeof(EvalEnv)), parent{parent}, bindings{bindings} {}
+
+    static EvalEnv* create(Heap& heap, EvalEnv* parent, std::uint32_t capacity);
+
+    static Value toValue(EvalEnv* env) {
+        return env ? Value::fromObject(env) : Value();
+    }
+    static EvalEnv* fromValue(Value value) {
+        return value.isNil() ? nullptr : static_cast<EvalEnv*>(value.asObject());
+    }
+
+    EvalEnv* getParent() const {
+        return fromValue(parent);
+    }
+
+    // The slot bound to name in this frame alone, or nullptr.
+    Value* find(SymbolId name) {
+        auto frame = getBindings();
+        auto data = frame->data();
+        for (std::uint32_t i = 0; i < frame->count; i++) {
+            if (data[i].name == Value::fromSymbol(name)) {
+                return &data[i].value;
+            }
+        }
+        return nullptr;
+    }
+    // Binds name in env, replacing an existing binding. May collect.
+    static void define(Heap& heap, EvalEnv* env, SymbolId name, Value value);
+};
+
+// A Root holding a frame, or null for the global one.
+class EnvRoot {
+private:
+    Root root;
+
+public:
+    EnvRoot(Heap& heap, EvalEnv* env) : root{heap, EvalEnv::toValue(env)} {}
+
+    EvalEnv* get() const {
+        return EvalEnv::fromValue(root);
+    }
+};
+
+#endif
@@ -0,0 +1,579 @@
+#include "./forms.h"
+
+#include <algorithm>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./error.h"
+#include "./interpreter.h"
+
+const Keywords& keywords() {
+    static const Keywords instance;
+    return instance;
+}
+
+void checkOperands(const char* form, Value args, std::size_t min, std::size_t max) {
+    std::size_t count = 0;
+    for (; args.isPair(); args = args.asPair()->cdr) {
+        count++;
+    }
+    if (!args.isNil() || count < min || count > max) {
+        throw LispError(std::string("Malformed ") + form);
+    }
+}
+
+void checkParams(Value params) {
+    for (; params.isPair(); params = params.asPair()->cdr) {
+        if (!params.asPair()->car.isSymbol()) {
+            throw LispError("Parameter must be a symbol: " + params.asPair()->car.toString());
+        }
+    }
+    if (!params.isNil() && !params.isSymbol()) {
+        throw LispError("Parameter must be a symbol: " + params.toString());
+    }
+}
+
+bool isForm(Value value, SymbolId keyword) {
+    return value.isPair() && value.asPair()->car == Value::fromSymbol(keyword) &&
+           value.asPair()->cdr.isPair() && value.asPair()->cdr.asPair()->cdr.isNil();
+}
+
+namespace {
+
+// A pair in the code arena.
+Value codeCons(Interpreter& interpreter, Value car, Value cdr) {
+    auto pair = interpreter.getCodeArena().make<Pair>(car, cdr);
+    interpreter.addCodeRoot(&pair->car);
+    interpreter.addCodeRoot(&pair->cdr);
+    return Value::fromPair(pair);
+}
+
+// (lambda () x)
+Value makeThunk(Interpreter& interpreter, Value x) {
+    auto body = codeCons(interpreter, x, Value());
+    return codeCons(interpreter, Value::fromSymbol(keywords().lambda),
+                    codeCons(interpreter, Value(), body));
+}
+
+}  // namespace
+
+Value expandDelay(Interpreter& interpreter, Value args) {
+    checkOperands("delay", args, 1, 1);
+    static const auto MAKE_PROMISE = SymbolTable::global().intern("#%make-promise");
+    auto thunk = makeThunk(interpreter, args.asPair()->car);
+    return codeCons(interpreter, Value::fromSymbol(MAKE_PROMISE),
+                    codeCons(interpreter, thunk, Value()));
+}
+
+Value expandConsStream(Interpreter& interpreter, Value args) {
+    checkOperands("cons-stream", args, 2, 2);
+    static const auto CONS_STREAM = SymbolTable::global().intern("#%cons-stream");
+    auto thunk = makeThunk(interpreter, args.asPair()->cdr.asPair()->car);
+    auto operands =
+        codeCons(interpreter, args.asPair()->car, codeCons(interpreter, thunk, Value()));
+    return codeCons(interpreter, Value::fromSymbol(CONS_STREAM), operands);
+}
+
+namespace {
+
+Value first(Value list) {
+    return list.asPair()->car;
+}
+
+Value rest(Value list) {
+    return list.asPair()->cdr;
+}
+
+Value second(Value list) {
+    return first(rest(list));
+}
+
+class If : public Node {
+private:
+    const Node* test;
+    const Node* consequent;
+    const Node* alternative;
+
+public:
+    If(const Node* test, const Node* consequent, const Node* alternative)
+        : test{test}, consequent{consequent}, alternative{alternative} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        bool result;
+        {
+            EnvRoot envRoot(interpreter.getHeap(), env);
+            result = test->run(interpreter, env).isTrue();
+            env = envRoot.get();
+        }
+        return (result ? consequent : alternative)->run(interpreter, env);
+    }
+};
+
+// and when IS_AND, or otherwise: the first operand whose truth is not
+// IS_AND, else the last.
+template <bool IS_AND>
+class Logical : public Node {
+private:
+    std::span<const Node*> operands;
+
+public:
+    explicit Logical(std::span<const Node*> operands) : operands{operands} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        if (operands.empty()) {
+            return Value::fromBoolean(IS_AND);
+        }
+        {
+            EnvRoot envRoot(interpreter.getHeap(), env);
+            for (std::size_t i = 0; i + 1 < operands.size(); i++) {
+                auto result = operands[i]->run(interpreter, envRoot.get());
+                if (result.isTrue() != IS_AND) {
+                    return result;
+                }
+            }
+            env = envRoot.get();
+        }
+        return operands.back()->run(interpreter, env);
+    }
+};
+
+class LambdaNode : public Node {
+private:
+    Value params;
+    const Node* body;
+    Value source;
+
+public:
+    LambdaNode(Value params, const Node* body, Value source)
+        : params{params}, body{body}, source{source} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        return interpreter.makeLambda(params, body, source, env);
+    }
+};
+
+// Binds the names a body defines, unbound, before running it. Until its
+// define runs, such a name is then an error, as on the VM, rather than a
+// variable of an enclosing scope.
+class Hoist : public Node {
+private:
+    std::span<SymbolId> names;
+    const Node* body;
+
+public:
+    Hoist(std::span<SymbolId> names, const Node* body) : names{names}, body{body} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        {
+            EnvRoot envRoot(interpreter.getHeap(), env);
+            for (auto name : names) {
+                EvalEnv::define(interpreter.getHeap(), envRoot.get(), name, Value::unbound());
+            }
+            env = envRoot.get();
+        }
+        return body->run(interpreter, env);
+    }
+};
+
+class Define : public Node {
+private:
+    SymbolId name;
+    const Node* value;
+
+public:
+    Define(SymbolId name, const Node* value) : name{name}, value{value} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        EnvRoot envRoot(interpreter.getHeap(), env);
+        auto result = value->run(interpreter, env);
+        interpreter.define(name, result, envRoot.get());
+        return Value();
+    }
+};
+
+// test is null for an else clause, and body for a clause of a test alone.
+struct Clause {
+    const Node* test;
+    const Node* body;
+};
+
+class Cond : public Node {
+private:
+    std::span<Clause> clauses;
+
+public:
+    explicit Cond(std::span<Clause> clauses) : clauses{clauses} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        const Node* body = nullptr;
+        {
+            EnvRoot envRoot(interpreter.getHeap(), env);
+            for (auto& clause : clauses) {
+                if (!clause.test) {
+                    body = clause.body;
+                    break;
+                }
+                auto result = clause.test->run(interpreter, envRoot.get());
+                if (result.isTrue()) {
+                    if (!clause.body) {
+                        return result;
+                    }
+                    body = clause.body;
+                    break;
+                }
+            }
+            env = envRoot.get();
+        }
+        return body ? body->run(interpreter, env) : Value();
+    }
+};
+
+class Let : public Node {
+private:
+    std::span<SymbolId> names;
+    std::span<const Node*> values;
+    const Node* body;
+
+public:
+    Let(std::span<SymbolId> names, std::span<const Node*> values, const Node* body)
+        : names{names}, values{values}, body{body} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        auto& heap = interpreter.getHeap();
+        EvalEnv* bodyEnv;
+        {
+            EnvRoot envRoot(heap, env);
+            auto frame = EvalEnv::create(heap, env, static_cast<std::uint32_t>(names.size()));
+            EnvRoot frameRoot(heap, frame);
+            for (std::size_t i = 0; i < names.size(); i++) {
+                auto value = values[i]->run(interpreter, envRoot.get());
+                EvalEnv::define(heap, frameRoot.get(), names[i], value);
+            }
+            bodyEnv = frameRoot.get();
+        }
+        return body->run(interpreter, bodyEnv);
+    }
+};
+
+class Guard : public Node {
+private:
+    std::span<GlobalRef> conditions;
+    const Node* fast;
+    const Node* slow;
+
+public:
+    Guard(std::span<GlobalRef> conditions, const Node* fast, const Node* slow)
+        : conditions{conditions}, fast{fast}, slow{slow} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        for (auto& condition : conditions) {
+            if (*condition.cell != condition.expected) {
+                return slow->run(interpreter, env);
+            }
+        }
+        return fast->run(interpreter, env);
+    }
+};
+
+// Builds a list of the values of items, ending in the value of tail.
+class ListNode : public Node {
+private:
+    std::span<const Node*> items;
+    const Node* tail;
+
+public:
+    ListNode(std::span<const Node*> items, const Node* tail) : items{items}, tail{tail} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        auto& heap = interpreter.getHeap();
+        EnvRoot envRoot(heap, env);
+        Root head(heap);
+        Root last(heap);
+        for (auto item : items) {
+            auto value = item->run(interpreter, envRoot.get());
+            auto pair = interpreter.cons(value, Value());
+            if (last.get().isPair()) {
+                interpreter.setCdr(last, pair);
+            } else {
+                head = pair;
+            }
+            last = pair;
+        }
+        auto end = tail->run(interpreter, envRoot.get());
+        interpreter.setCdr(last, end);
+        return head;
+    }
+};
+
+const Node* quoteForm(Interpreter& interpreter, Value args, bool) {
+    checkOperands("quote", args, 1, 1);
+    return interpreter.makeConstant(first(args));
+}
+
+// Analyzes a quasiquoted template into a node building a copy of it, with
+// each (unquote x) at the same nesting level replaced by the value of x.
+// Gives nullptr if there is no such unquote, so the template can be shared.
+const Node* analyzeTemplate(Interpreter& interpreter, Value tmpl, int level) {
+    auto& names = keywords();
+    auto& code = interpreter.getCodeArena();
+    if (isForm(tmpl, names.unquote) && level == 1) {
+        return interpreter.analyze(second(tmpl));
+    }
+    if (!tmpl.isPair()) {
+        return nullptr;
+    }
+    interpreter.checkNativeStack();
+    if (isForm(tmpl, names.unquote) || isForm(tmpl, names.quasiquote)) {
+        auto inner = isForm(tmpl, names.unquote) ? level - 1 : level + 1;
+        auto node = analyzeTemplate(interpreter, second(tmpl), inner);
+        if (!node) {
+            return nullptr;
+        }
+        auto items = code.makeArray<const Node*>(2);
+        items[0] = interpreter.makeConstant(first(tmpl));
+        items[1] = node;
+        return code.make<ListNode>(items, interpreter.makeConstant(Value()));
+    }
+    std::vector<const Node*> nodes;
+    bool constant = true;
+    auto tail = tmpl;
+    for (; tail.isPair() && !isForm(tail, names.unquote) && !isForm(tail, names.quasiquote);
+         tail = rest(tail)) {
+        nodes.push_back(analyzeTemplate(interpreter, first(tail), level));
+        constant = constant && !nodes.back();
+    }
+    auto tailNode = analyzeTemplate(interpreter, tail, level);
+    if (constant && !tailNode) {
+        return nullptr;
+    }
+    auto items = code.makeArray<const Node*>(nodes.size());
+    for (std::size_t i = 0; i < nodes.size(); i++, tmpl = rest(tmpl)) {
+        items[i] = nodes[i] ? nodes[i] : interpreter.makeConstant(first(tmpl));
+    }
+    return code.make<ListNode>(items, tailNode ? tailNode : interpreter.makeConstant(tail));
+}
+
+const Node* quasiquoteForm(Interpreter& interpreter, Value args, bool) {
+    checkOperands("quasiquote", args, 1, 1);
+    auto node = analyzeTemplate(interpreter, first(args), 1);
+    return node ? node : interpreter.makeConstant(first(args));
+}
+
+const Node* ifForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("if", args, 2, 3);
+    auto test = interpreter.analyze(first(args));
+    auto consequent = interpreter.analyze(second(args), tail);
+    auto alternative = rest(rest(args));
+    auto otherwise = alternative.isNil() ? interpreter.makeConstant(Value())
+                                         : interpreter.analyze(first(alternative), tail);
+    return interpreter.getCodeArena().make<If>(test, consequent, otherwise);
+}
+
+const Node* andForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("and", args, 0, SIZE_MAX);
+    return interpreter.getCodeArena().make<Logical<true>>(interpreter.analyzeList(args, tail));
+}
+
+const Node* orForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("or", args, 0, SIZE_MAX);
+    return interpreter.getCodeArena().make<Logical<false>>(interpreter.analyzeList(args, tail));
+}
+
+// The body of a lambda or let binding the names in bound, with the other
+// names it defines hoisted.
+const Node* analyzeScope(Interpreter& interpreter, Value body, std::vector<SymbolId> bound,
+                         bool tail) {
+    auto count = bound.size();
+    collectDefines(interpreter, body, bound);
+    auto node = interpreter.analyzeBody(body, tail);
+    if (bound.size() == count) {
+        return node;
+    }
+    auto names = interpreter.getCodeArena().makeArray<SymbolId>(bound.size() - count);
+    std::copy(bound.begin() + static_cast<std::ptrdiff_t>(count), bound.end(), names.begin());
+    return interpreter.getCodeArena().make<Hoist>(names, node);
+}
+
+const Node* analyzeLambda(Interpreter& interpreter, Value params, Value body) {
+    checkParams(params);
+    std::vector<SymbolId> bound;
+    auto param = params;
+    for (; param.isPair(); param = rest(param)) {
+        bound.push_back(first(param).asSymbol());
+    }
+    if (param.isSymbol()) {
+        bound.push_back(param.asSymbol());
+    }
+    auto node = analyzeScope(interpreter, body, std::move(bound), true);
+    return interpreter.getCodeArena().make<LambdaNode>(params, node, body);
+}
+
+const Node* lambdaForm(Interpreter& interpreter, Value args, bool) {
+    checkOperands("lambda", args, 2, SIZE_MAX);
+    return analyzeLambda(interpreter, first(args), rest(args));
+}
+
+const Node* defineForm(Interpreter& interpreter, Value args, bool) {
+    checkOperands("define", args, 2, SIZE_MAX);
+    auto& code = interpreter.getCodeArena();
+    auto target = first(args);
+    if (target.isPair()) {
+        if (!first(target).isSymbol()) {
+            throw LispError("Malformed define");
+        }
+        auto lambda = analyzeLambda(interpreter, rest(target), rest(args));
+        return code.make<Define>(first(target).asSymbol(), lambda);
+    }
+    if (target.isSymbol()) {
+        checkOperands("define", args, 2, 2);
+        return code.make<Define>(target.asSymbol(), interpreter.analyze(second(args)));
+    }
+    throw LispError("Malformed define");
+}
+
+const Node* condForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("cond", args, 0, SIZE_MAX);
+    std::size_t count = 0;
+    for (auto clause = args; clause.isPair(); clause = rest(clause)) {
+        count++;
+    }
+    auto clauses = interpreter.getCodeArena().makeArray<Clause>(count);
+    for (auto& clause : clauses) {
+        auto datum = first(args);
+        args = rest(args);
+        checkOperands("cond clause", datum, 1, SIZE_MAX);
+        auto test = first(datum);
+        if (test != Value::fromSymbol(keywords().elseKeyword)) {
+            clause.test = interpreter.analyze(test);
+        }
+        if (!clause.test || !rest(datum).isNil()) {
+            clause.body = interpreter.analyzeBody(rest(datum), tail);
+        }
+    }
+    return interpreter.getCodeArena().make<Cond>(clauses);
+}
+
+const Node* beginForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("begin", args, 0, SIZE_MAX);
+    return interpreter.analyzeBody(args, tail);
+}
+
+const Node* letForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("let", args, 2, SIZE_MAX);
+    auto bindings = first(args);
+    checkOperands("let", bindings, 0, SIZE_MAX);
+    std::size_t count = 0;
+    for (auto binding = bindings; binding.isPair(); binding = rest(binding)) {
+        count++;
+    }
+    auto& code = interpreter.getCodeArena();
+    auto names = code.makeArray<SymbolId>(count);
+    auto values = code.makeArray<const Node*>(count);
+    for (std::size_t i = 0; i < count; i++, bindings = rest(bindings)) {
+        auto binding = first(bindings);
+        checkOperands("let binding", binding, 2, 2);
+        if (!first(binding).isSymbol()) {
+            throw LispError("Malformed let binding");
+        }
+        names[i] = first(binding).asSymbol();
+        values[i] = interpreter.analyze(second(binding));
+    }
+    auto body = analyzeScope(interpreter, rest(args), {names.begin(), names.end()}, tail);
+    return code.make<Let>(names, values, body);
+}
+
+const Node* guardForm(Interpreter& interpreter, Value args, bool tail) {
+    checkOperands("guard", args, 3, 3);
+    auto list = first(args);
+    checkOperands("guard", list, 0, SIZE_MAX);
+    std::size_t count = 0;
+    for (auto condition = list; condition.isPair(); condition = rest(condition)) {
+        count++;
+    }
+    auto conditions = interpreter.getCodeArena().makeArray<GlobalRef>(count);
+    for (auto& condition : conditions) {
+        auto datum = first(list);
+        list = rest(list);
+        if (!datum.isPair() || !first(datum).isSymbol()) {
+            throw LispError("Malformed guard");
+        }
+        auto name = first(datum).asSymbol();
+        condition = {interpreter.globalCell(name), name, rest(datum)};
+        interpreter.addCodeRoot(&condition.expected);
+    }
+    auto fast = interpreter.analyze(second(args), tail);
+    auto slow = interpreter.analyze(second(rest(args)), tail);
+    return interpreter.getCodeArena().make<Guard>(conditions, fast, slow);
+}
+
+const Node* delayForm(Interpreter& interpreter, Value args, bool tail) {
+    return interpreter.analyze(expandDelay(interpreter, args), tail);
+}
+
+const Node* consStreamForm(Interpreter& interpreter, Value args, bool tail) {
+    return interpreter.analyze(expandConsStream(interpreter, args), tail);
+}
+
+}  // namespace
+
+void collectDefines(Interpreter& interpreter, Value expr, std::vector<SymbolId>& scope) {
+    if (!expr.isPair()) {
+        return;
+    }
+    interpreter.checkNativeStack();
+    auto& names = keywords();
+    auto head = first(expr);
+    auto args = rest(expr);
+    if (head == Value::fromSymbol(names.quote) || head == Value::fromSymbol(names.quasiquote) ||
+        head == Value::fromSymbol(names.lambda) || head == Value::fromSymbol(names.delay)) {
+        return;
+    }
+    if (head == Value::fromSymbol(names.consStream) && args.isPair()) {
+        collectDefines(interpreter, first(args), scope);
+        return;
+    }
+    if (head == Value::fromSymbol(names.define) && args.isPair()) {
+        auto target = first(args);
+        if (target.isPair() && first(target).isSymbol()) {
+            target = first(target);
+        } else {
+            // The value is evaluated in the scope too.
+            collectDefines(interpreter, rest(args), scope);
+        }
+        if (target.isSymbol() &&
+            std::find(scope.begin(), scope.end(), target.asSymbol()) == scope.end()) {
+            scope.push_back(target.asSymbol());
+        }
+        return;
+    }
+    if (head == Value::fromSymbol(names.let) && args.isPair()) {
+        for (auto binding = first(args); binding.isPair(); binding = rest(binding)) {
+            if (first(binding).isPair()) {
+                collectDefines(interpreter, rest(first(binding)), scope);
+            }
+        }
+        return;
+    }
+    for (; expr.isPair(); expr = rest(expr)) {
+        collectDefines(interpreter, first(expr), scope);
+    }
+}
+
+SpecialForm findSpecialForm(SymbolId name) {
+    static const std::unordered_map<SymbolId, SpecialForm> FORMS = [] {
+        auto& symbols = SymbolTable::global();
+        return std::unordered_map<SymbolId, SpecialForm>{
+            {symbols.intern("quote"), quoteForm},   {symbols.intern("quasiquote"), quasiquoteForm},
+            {symbols.intern("if"), ifForm},         {symbols.intern("and"), andForm},
+            {symbols.intern("or"), orForm},         {symbols.intern("lambda"), lambdaForm},
+            {symbols.intern("define"), defineForm}, {symbols.intern("cond"), condForm},
+            {symbols.intern("begin"), beginForm},   {symbols.intern("let"), letForm},
+            {keywords().delay, delayForm},          {keywords().consStream, consStreamForm},
+            {keywords().guard, guardForm},
+        };
+    }();
+    auto it = FORMS.find(name);
+    return it == FORMS.end() ? nullptr : it->second;
+}
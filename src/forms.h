@@ -0,0 +1,55 @@
+#ifndef FORMS_H
+#define FORMS_H
+
+#include <cstddef>
+#include <vector>
+
+#include "./node.h"
+#include "./value.h"
+
+class Interpreter;
+
+// Analyzes a special form given its operands, and whether it is in tail
+// position in a lambda body.
+using SpecialForm = const Node* (*)(Interpreter& interpreter, Value args, bool tail);
+
+// The special form named name, or nullptr if name is not a keyword.
+SpecialForm findSpecialForm(SymbolId name);
+
+// Symbols the forms recognise within their operands.
+struct Keywords {
+    SymbolId quote{SymbolTable::global().intern("quote")};
+    SymbolId quasiquote{SymbolTable::global().intern("quasiquote")};
+    SymbolId unquote{SymbolTable::global().intern("unquote")};
+    SymbolId elseKeyword{SymbolTable::global().intern("else")};
+    SymbolId lambda{SymbolTable::global().intern("lambda")};
+    SymbolId define{SymbolTable::global().intern("define")};
+    SymbolId let{SymbolTable::global().intern("let")};
+    SymbolId delay{SymbolTable::global().intern("delay")};
+    SymbolId consStream{SymbolTable::global().intern("cons-stream")};
+    // Only made by the optimizer, as the reader cannot give it: (#%guard
+    // ((name . value) ...) fast slow) evaluates fast while each global name
+    // holds its value, and slow otherwise.
+    SymbolId guard{SymbolTable::global().intern("#%guard")};
+};
+
+const Keywords& keywords();
+
+// Checks that args is a proper list of between min and max datums.
+void checkOperands(const char* form, Value args, std::size_t min, std::size_t max);
+// Checks that params is a valid lambda parameter list.
+void checkParams(Value params);
+// Whether value is the list (keyword x).
+bool isForm(Value value, SymbolId keyword);
+// Adds the names defined by expr, other than inside lambdas, let bodies
+// and delayed expressions, to scope. Both engines bind these names, unbound,
+// on entering the body or let that defines them.
+void collectDefines(Interpreter& interpreter, Value expr, std::vector<SymbolId>& scope);
+
+// The call a delay or cons-stream form stands for, given its operands:
+// (delay x) is (#%make-promise (lambda () x)), and (cons-stream a b) is
+// (#%cons-stream a (lambda () b)), calling builtins of those names.
+Value expandDelay(Interpreter& interpreter, Value args);
+Value expandConsStream(Interpreter& interpreter, Value args);
+
+#endif
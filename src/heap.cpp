@@ -0,0 +1,243 @@
+#include "./heap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+
+constexpr std::uint8_t FORWARDED = 1;
+
+std::size_t alignUp(std::size_t size, std::size_t align) {
+    return (size + align - 1) & ~(align - 1);
+}
+
+}  // namespace
+
+Heap::Heap(std::size_t nurserySize)
+    : nursery{new std::byte[nurserySize]}, nurseryEnd{nursery + nurserySize}, cursor{nursery} {}
+
+Heap::~Heap() {
+    freeChunks(pairs);
+    freeChunks(objects);
+    delete[] nursery;
+}
+
+Heap::Chunk* Heap::newChunk(Space& space, std::size_t size) {
+    auto header = alignUp(sizeof(Chunk), 16);
+    auto total = CHUNK_SIZE;
+    std::uint8_t* cards = nullptr;
+    if (alignUp(header + (CHUNK_SIZE >> CARD_SHIFT), 16) + size > CHUNK_SIZE) {
+        total = alignUp(header + size, CHUNK_SIZE);
+        cards = new std::uint8_t[total >> CARD_SHIFT];
+    } else {
+        header = alignUp(header + (CHUNK_SIZE >> CARD_SHIFT), 16);
+    }
+    auto base = static_cast<std::byte*>(::operator new(total, std::align_val_t{CHUNK_SIZE}));
+    auto chunk = new (base) Chunk{total, base + header, base + header, cards};
+    if (!cards) {
+        chunk->cards = reinterpret_cast<std::uint8_t*>(chunk + 1);
+    }
+    std::memset(chunk->cards, 0, total >> CARD_SHIFT);
+    space.chunks.push_back(chunk);
+    chunkBases.insert(reinterpret_cast<std::uintptr_t>(base));
+    return chunk;
+}
+
+void Heap::freeChunks(Space& space) {
+    for (auto chunk : space.chunks) {
+        if (chunk->cards != reinterpret_cast<std::uint8_t*>(chunk + 1)) {
+            delete[] chunk->cards;
+        }
+        ::operator delete(static_cast<void*>(chunk), std::align_val_t{CHUNK_SIZE});
+    }
+    space = Space();
+}
+
+std::byte* Heap::allocateOld(Space& space, std::size_t size) {
+    oldBytes += size;
+    if (static_cast<std::size_t>(space.limit - space.cursor) < size) {
+        auto chunk = newChunk(space, size);
+        if (size > CHUNK_SIZE / 4) {
+            // A large object gets a chunk of its own. The next allocation
+            // opens a fresh chunk after it, so chunks only ever grow at the
+            // back of the list, which the Cheney scan relies on.
+            chunk->end = chunk->data + size;
+            space.cursor = space.limit = nullptr;
+            return chunk->data;
+        }
+        space.cursor = chunk->data;
+        space.limit = reinterpret_cast<std::byte*>(chunk) + chunk->size;
+    }
+    auto result = space.cursor;
+    space.cursor += size;
+    space.chunks.back()->end = space.cursor;
+    return result;
+}
+
+void* Heap::allocateSlow(std::size_t size) {
+    if (size > static_cast<std::size_t>(nurseryEnd - nursery) / 4) {
+        // Too big for the nursery, so it starts old. The caller fills it in
+        // without barriers, so all its cards start dirty.
+        if (oldBytes + size > majorThreshold) {
+            collect();
+        }
+        auto result = allocateOld(objects, size);
+        auto chunk = reinterpret_cast<Chunk*>(chunkBase(result));
+        std::memset(chunk->cards, 1, chunk->size >> CARD_SHIFT);
+        return result;
+    }
+    collect();
+    return allocate(size);
+}
+
+Value Heap::cons(Value car, Value cdr) {
+    if (static_cast<std::size_t>(nurseryEnd - cursor) < sizeof(Pair)) {
+        Root carRoot(*this, car);
+        Root cdrRoot(*this, cdr);
+        collect();
+        car = carRoot;
+        cdr = cdrRoot;
+    }
+    auto pair = new (cursor) Pair{car, cdr};
+    cursor += sizeof(Pair);
+    return Value::fromPair(pair);
+}
+
+bool Heap::isCollected(const void* address) const {
+    return inNursery(address) || (major && fromChunkBases.contains(chunkBase(address)));
+}
+
+Value Heap::evacuate(Value value) {
+    if (!value.isPointer() || !isCollected(value.asPointer())) {
+        return value;
+    }
+    if (value.isPair()) {
+        auto pair = value.asPair();
+        if (pair->car.isForwarding()) {
+            return Value::fromPair(static_cast<Pair*>(pair->car.asPointer()));
+        }
+        auto copy = new (allocateOld(pairs, sizeof(Pair))) Pair{*pair};
+        pair->car = Value::forwardingTo(copy);
+        return Value::fromPair(copy);
+    }
+    auto object = value.asObject();
+    // The forwarding address overwrites the first word after the header.
+    auto forward = reinterpret_cast<Object**>(object + 1);
+    if (object->gcFlags & FORWARDED) {
+        return Value::fromObject(*forward);
+    }
+    auto copy = allocateOld(objects, object->size);
+    std::memcpy(copy, object, object->size);
+    object->gcFlags |= FORWARDED;
+    *forward = reinterpret_cast<Object*>(copy);
+    return Value::fromObject(*forward);
+}
+
+void Heap::scanWords(Value* begin, Value* end) {
+    for (auto slot = begin; slot < end; slot++) {
+        *slot = evacuate(*slot);
+    }
+}
+
+bool Heap::scanSpace(Space& space, ScanPosition& position, bool pairSpace) {
+    bool progress = false;
+    while (position.chunk < space.chunks.size()) {
+        auto chunk = space.chunks[position.chunk];
+        if (!position.next) {
+            position.next = chunk->data;
+        }
+        // Evacuation may append to this chunk, so end is reread each time.
+        while (position.next < chunk->end) {
+            progress = true;
+            auto size = pairSpace ? sizeof(Pair) : reinterpret_cast<Object*>(position.next)->size;
+            auto fields = pairSpace ? position.next : position.next + sizeof(Object);
+            scanWords(reinterpret_cast<Value*>(fields),
+                      reinterpret_cast<Value*>(position.next + size));
+            position.next += size;
+        }
+        if (position.chunk + 1 == space.chunks.size()) {
+            break;
+        }
+        position.chunk++;
+        position.next = nullptr;
+    }
+    return progress;
+}
+
+// Object boundaries are not known within a card, so every word in it is
+// treated as a value; see Object for why that is safe.
+void Heap::scanDirtyCards(Space& space) {
+    auto count = space.chunks.size();
+    for (std::size_t i = 0; i < count; i++) {
+        auto chunk = space.chunks[i];
+        auto base = reinterpret_cast<std::byte*>(chunk);
+        auto cards = chunk->cards;
+        auto end = chunk->end;
+        for (std::size_t card = 0; card < (chunk->size >> CARD_SHIFT); card++) {
+            if (!cards[card]) {
+                continue;
+            }
+            cards[card] = 0;
+            auto from = std::max(base + (card << CARD_SHIFT), chunk->data);
+            auto to = std::min(base + ((card + 1) << CARD_SHIFT), end);
+            if (from < to) {
+                scanWords(reinterpret_cast<Value*>(from), reinterpret_cast<Value*>(to));
+            }
+        }
+    }
+}
+
+void Heap::collect() {
+    auto startOf = [](Space& space) {
+        if (space.chunks.empty()) {
+            return ScanPosition{0, nullptr};
+        }
+        return ScanPosition{space.chunks.size() - 1, space.chunks.back()->end};
+    };
+    Space fromPairs;
+    Space fromObjects;
+    if (major) {
+        fromPairs = std::move(pairs);
+        fromObjects = std::move(objects);
+        fromChunkBases = std::move(chunkBases);
+        pairs = Space();
+        objects = Space();
+        chunkBases.clear();
+        oldBytes = 0;
+    }
+    auto oldBefore = oldBytes;
+    auto pairScan = startOf(pairs);
+    auto objectScan = startOf(objects);
+
+    for (auto slot : roots) {
+        *slot = evacuate(*slot);
+    }
+    if (rootScanner) {
+        rootScanner([this](Value& slot) { slot = evacuate(slot); });
+    }
+    if (!major) {
+        scanDirtyCards(pairs);
+        scanDirtyCards(objects);
+    }
+    while (scanSpace(pairs, pairScan, true) | scanSpace(objects, objectScan, false)) {
+    }
+    cursor = nursery;
+
+    if (major) {
+        freeChunks(fromPairs);
+        freeChunks(fromObjects);
+        fromChunkBases.clear();
+        majorThreshold = std::max(MIN_MAJOR_THRESHOLD, oldBytes * 2);
+        stats.majorCollections++;
+        major = false;
+    } else {
+        stats.bytesPromoted += oldBytes - oldBefore;
+        stats.minorCollections++;
+        if (oldBytes > majorThreshold) {
+            major = true;
+            collect();
+        }
+    }
+    stats.oldBytes = oldBytes;
+}
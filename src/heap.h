@@ -0,0 +1,179 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include "./value.h"
+
+// Generational, precise, copying collector for pairs and objects.
+//
+// New objects are bump-allocated in a fixed nursery. When it fills, a minor
+// collection copies the live ones into the old space, found from the roots
+// and from the dirty cards of the old space. When the old space has grown
+// past a threshold, a major collection copies everything live into a fresh
+// old space.
+//
+// The old space is made of aligned chunks, each with a card table; pairs and
+// other objects are kept in separate chunks so that both can be walked in
+// address order. A store of a pointer into an old object must be followed by
+// writeBarrier(), which marks the card holding the slot.
+//
+// Collection can happen on any allocation. Every value a caller still needs
+// afterwards must be in a root: a Root handle, or a slot reported by the
+// root scanner (the interpreter's value stack and globals). Objects outside
+// the heap, such as literals read into an Arena, are never moved and must
+// not point into the heap.
+class Heap {
+public:
+    using RootVisitor = std::function<void(Value&)>;
+
+    static constexpr std::size_t DEFAULT_NURSERY_SIZE = 2 << 20;
+
+    struct Stats {
+        std::size_t minorCollections{0};
+        std::size_t majorCollections{0};
+        std::size_t bytesPromoted{0};
+        std::size_t oldBytes{0};
+    };
+
+private:
+    static constexpr std::size_t CHUNK_SIZE = 256 * 1024;
+    static constexpr int CARD_SHIFT = 9;
+    static constexpr std::size_t MIN_MAJOR_THRESHOLD = 16 << 20;
+
+    // Placed at the start of each old-space chunk. The cards follow it in a
+    // chunk of CHUNK_SIZE; a larger chunk keeps them apart, so that its data
+    // starts within the first CHUNK_SIZE bytes, where chunkBase() finds the
+    // header from the address of the object.
+    struct Chunk {
+        std::size_t size;
+        std::byte* end;
+        std::byte* data;
+        std::uint8_t* cards;
+    };
+
+    struct Space {
+        std::vector<Chunk*> chunks;
+        std::byte* cursor{nullptr};
+        std::byte* limit{nullptr};
+    };
+
+    // Where a Cheney scan of a space has got to.
+    struct ScanPosition {
+        std::size_t chunk;
+        std::byte* next;
+    };
+
+    std::byte* nursery;
+    std::byte* nurseryEnd;
+    std::byte* cursor;
+    Space pairs;
+    Space objects;
+    std::unordered_set<std::uintptr_t> chunkBases;
+    // During a major collection, the chunks being evacuated.
+    std::unordered_set<std::uintptr_t> fromChunkBases;
+    std::size_t oldBytes{0};
+    std::size_t majorThreshold{MIN_MAJOR_THRESHOLD};
+    bool major{false};
+    std::function<void(const RootVisitor&)> rootScanner;
+    std::vector<Value*> roots;
+    Stats stats;
+
+    friend class Root;
+
+    static std::uintptr_t chunkBase(const void* address) {
+        return reinterpret_cast<std::uintptr_t>(address) & ~(CHUNK_SIZE - 1);
+    }
+    Chunk* newChunk(Space& space, std::size_t size);
+    void freeChunks(Space& space);
+    std::byte* allocateOld(Space& space, std::size_t size);
+    void* allocateSlow(std::size_t size);
+
+    bool inNursery(const void* address) const {
+        return address >= nursery && address < nurseryEnd;
+    }
+    bool isCollected(const void* address) const;
+    Value evacuate(Value value);
+    void scanWords(Value* begin, Value* end);
+    bool scanSpace(Space& space, ScanPosition& position, bool pairSpace);
+    void scanDirtyCards(Space& space);
+    void collect();
+
+public:
+    explicit Heap(std::size_t nurserySize = DEFAULT_NURSERY_SIZE);
+    ~Heap();
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    // Sets the function that visits every root slot outside Root handles.
+    void setRootScanner(std::function<void(const RootVisitor&)> scanner) {
+        rootScanner = std::move(scanner);
+    }
+
+    // Allocates size bytes, a multiple of 8, for an object. May collect.
+    void* allocate(std::size_t size) {
+        if (static_cast<std::size_t>(nurseryEnd - cursor) >= size) {
+            auto result = cursor;
+            cursor += size;
+            return result;
+        }
+        return allocateSlow(size);
+    }
+    Value cons(Value car, Value cdr);
+
+    // Whether address lies in the heap, rather than an arena or static data.
+    bool contains(const void* address) const {
+        return inNursery(address) || chunkBases.contains(chunkBase(address));
+    }
+
+    // Records a store into slot, a field of the heap object starting at
+    // object (for a pair, the pair itself).
+    void writeBarrier(const void* object, const void* slot) {
+        if (!inNursery(object)) {
+            auto chunk = reinterpret_cast<Chunk*>(chunkBase(object));
+            chunk->cards[(reinterpret_cast<std::uintptr_t>(slot) -
+                            reinterpret_cast<std::uintptr_t>(chunk)) >>
+                           CARD_SHIFT] = 1;
+        }
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+};
+
+// Keeps a value alive and up to date across collections for as long as the
+// handle exists. Handles must be destroyed in reverse order of creation,
+// which scoping guarantees.
+class Root {
+private:
+    Heap& heap;
+    Value value;
+
+public:
+    Root(Heap& heap, Value value = Value()) : heap{heap}, value{value} {
+        heap.roots.push_back(&this->value);
+    }
+    ~Root() {
+        heap.roots.pop_back();
+    }
+    Root(const Root&) = delete;
+    Root& operator=(const Root&) = delete;
+
+    Root& operator=(Value newValue) {
+        value = newValue;
+        return *this;
+    }
+    Value get() const {
+        return value;
+    }
+    operator Value() const {
+        return value;
+    }
+};
+
+#endif
@@ -0,0 +1,394 @@
+#include "./interpreter.h"
+
+#include "./builtins.h"
+#include "./compiler.h"
+#include "./error.h"
+#include "./forms.h"
+
+namespace {
+
+class Constant : public Node {
+private:
+    Value value;
+
+public:
+    explicit Constant(Value value) : value{value} {}
+
+    Value* slot() {
+        return &value;
+    }
+    Value run(Interpreter&, EvalEnv*) const override {
+        return value;
+    }
+};
+
+class Variable : public Node {
+private:
+    SymbolId name;
+
+public:
+    explicit Variable(SymbolId name) : name{name} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        return interpreter.lookup(name, env);
+    }
+};
+
+template <bool TAIL>
+class Call : public Node {
+private:
+    const Node* op;
+    std::span<const Node*> operands;
+
+public:
+    Call(const Node* op, std::span<const Node*> operands) : op{op}, operands{operands} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        return interpreter.evalCall(op, operands, env, TAIL);
+    }
+};
+
+// The last node runs after env's root is gone, which keeps the native stack
+// shallow in deep recursion.
+class Sequence : public Node {
+private:
+    std::span<const Node*> nodes;
+
+public:
+    explicit Sequence(std::span<const Node*> nodes) : nodes{nodes} {}
+
+    Value run(Interpreter& interpreter, EvalEnv* env) const override {
+        {
+            EnvRoot envRoot(interpreter.getHeap(), env);
+            for (std::size_t i = 0; i + 1 < nodes.size(); i++) {
+                nodes[i]->run(interpreter, envRoot.get());
+            }
+            env = envRoot.get();
+        }
+        return nodes.back()->run(interpreter, env);
+    }
+};
+
+}  // namespace
+
+Interpreter::Interpreter(std::size_t nurserySize)
+    : heap{nurserySize},
+      stack{std::make_unique<Value[]>(STACK_CAPACITY)} {
+    heap.setRootScanner([this](const Heap::RootVisitor& visit) {
+        for (std::size_t i = 0; i < stackSize; i++) {
+            visit(stack[i]);
+        }
+        for (auto& value : globals) {
+            visit(value);
+        }
+        for (auto slot : codeSlots) {
+            visit(*slot);
+        }
+    });
+    addBuiltins(*this);
+}
+
+Value Interpreter::makeString(std::string_view text) {
+    return Value::fromString(code.make<String>(code.copy(text)));
+}
+
+Value Interpreter::makeLambda(Value params, const Node* body, Value source, EvalEnv* env) {
+    EnvRoot envRoot(heap, env);
+    auto memory = heap.allocate(sizeof(Lambda));
+    auto lambda = new (memory) Lambda(params, body, source, EvalEnv::toValue(envRoot.get()));
+    return Value::fromObject(lambda);
+}
+
+Value Interpreter::makeClosure(const Prototype* prototype, Value env) {
+    Root envRoot(heap, env);
+    auto memory = heap.allocate(sizeof(Closure));
+    return Value::fromObject(new (memory) Closure(prototype, envRoot));
+}
+
+Value Interpreter::makePromise(Value proc, Value args) {
+    Root procRoot(heap, proc);
+    Root argsRoot(heap, args);
+    auto memory = heap.allocate(sizeof(Promise));
+    return Value::fromObject(new (memory) Promise(procRoot, argsRoot));
+}
+
+Value Interpreter::makeF64Vector(std::uint64_t length) {
+    if (length > F64Vector::MAX_LENGTH) {
+        throw LispError("f64vector too long: " + std::to_string(length));
+    }
+    auto memory = heap.allocate(F64Vector::sizeOf(length));
+    return Value::fromObject(new (memory) F64Vector(length));
+}
+
+void Interpreter::setCar(Value pair, Value value) {
+    if (!heap.contains(pair.asPair())) {
+        throw LispError("Cannot modify a constant: " + pair.toString());
+    }
+    pair.asPair()->car = value;
+    heap.writeBarrier(pair.asPair(), &pair.asPair()->car);
+}
+
+void Interpreter::setCdr(Value pair, Value value) {
+    if (!heap.contains(pair.asPair())) {
+        throw LispError("Cannot modify a constant: " + pair.toString());
+    }
+    pair.asPair()->cdr = value;
+    heap.writeBarrier(pair.asPair(), &pair.asPair()->cdr);
+}
+
+// Only the heap pairs are copied; code pairs are shared and other heap
+// objects, which are closures, are left in place with their slots recorded
+// as roots.
+Value Interpreter::copyToCode(Value datum) {
+    auto inHeap = [this](Value value) {
+        return value.isPointer() && heap.contains(value.asPointer());
+    };
+    if (!datum.isPair() || !inHeap(datum)) {
+        return datum;
+    }
+    auto head = code.make<Pair>(datum.asPair()->car, datum.asPair()->cdr);
+    for (auto pair = head;; pair = pair->cdr.asPair()) {
+        pair->car = copyToCode(pair->car);
+        if (inHeap(pair->car)) {
+            codeSlots.push_back(&pair->car);
+        }
+        auto next = pair->cdr;
+        if (!next.isPair() || !inHeap(next)) {
+            if (inHeap(next)) {
+                codeSlots.push_back(&pair->cdr);
+            }
+            break;
+        }
+        pair->cdr = Value::fromPair(code.make<Pair>(next.asPair()->car, next.asPair()->cdr));
+    }
+    return Value::fromPair(head);
+}
+
+void Interpreter::addCodeRoot(Value* slot) {
+    if (slot->isPointer() && heap.contains(slot->asPointer())) {
+        codeSlots.push_back(slot);
+    }
+}
+
+void Interpreter::push(Value value) {
+    if (stackSize == STACK_CAPACITY) {
+        throw LispError("Stack overflow");
+    }
+    stack[stackSize++] = value;
+}
+
+// A name hoisted from a body is bound in its frame before its define runs,
+// and is not defined until then.
+Value Interpreter::lookup(SymbolId name, EvalEnv* env) {
+    Value value = Value::unbound();
+    for (; env; env = env->getParent()) {
+        if (auto slot = env->find(name)) {
+            value = *slot;
+            break;
+        }
+    }
+    if (!env && name < globals.size()) {
+        value = globals[name];
+    }
+    if (!value.isUnbound()) {
+        return value;
+    }
+    throw LispError("Variable " + std::string(SymbolTable::global().name(name)) +
+                    " is not defined");
+}
+
+void Interpreter::define(SymbolId name, Value value, EvalEnv* env) {
+    if (env) {
+        EvalEnv::define(heap, env, name, value);
+        return;
+    }
+    *globalCell(name) = value;
+    globalEpoch++;
+}
+
+Value* Interpreter::globalCell(SymbolId name) {
+    if (name >= globals.size()) {
+        globals.resize(name + 1, Value::unbound());
+    }
+    return &globals[name];
+}
+
+void Interpreter::checkNativeStack() {
+    char marker;
+    auto here = reinterpret_cast<std::uintptr_t>(&marker);
+    if (here > nativeBase) {
+        nativeBase = here;
+    } else if (nativeBase - here > MAX_NATIVE_STACK) {
+        throw LispError("Maximum recursion depth exceeded");
+    }
+}
+
+Value Interpreter::eval(Value expr) {
+    expr = Optimizer(*this, optimizations).optimize(expr);
+    if (engine == Engine::TREE) {
+        return analyze(expr)->run(*this, nullptr);
+    }
+    return vm.execute(Compiler::compileTopLevel(*this, expr), Value());
+}
+
+const Node* Interpreter::makeConstant(Value value) {
+    auto node = code.make<Constant>(value);
+    addCodeRoot(node->slot());
+    return node;
+}
+
+const Node* Interpreter::analyze(Value expr, bool tail) {
+    switch (expr.getType()) {
+        case ValueType::SYMBOL: return code.make<Variable>(expr.asSymbol());
+        case ValueType::PAIR: break;
+        case ValueType::NIL: throw LispError("Evaluating nil is prohibited");
+        default: return makeConstant(expr);
+    }
+    checkNativeStack();
+    auto pair = expr.asPair();
+    if (pair->car.isSymbol()) {
+        if (auto form = findSpecialForm(pair->car.asSymbol())) {
+            return form(*this, pair->cdr, tail);
+        }
+    }
+    auto rest = pair->cdr;
+    while (rest.isPair()) {
+        rest = rest.asPair()->cdr;
+    }
+    if (!rest.isNil()) {
+        throw LispError("Malformed procedure call");
+    }
+    auto op = analyze(pair->car);
+    auto operands = analyzeList(pair->cdr);
+    if (tail) {
+        return code.make<Call<true>>(op, operands);
+    }
+    return code.make<Call<false>>(op, operands);
+}
+
+std::span<const Node*> Interpreter::analyzeList(Value list, bool tail) {
+    std::size_t count = 0;
+    auto rest = list;
+    for (; rest.isPair(); rest = rest.asPair()->cdr) {
+        count++;
+    }
+    if (!rest.isNil()) {
+        throw LispError("Malformed expression list");
+    }
+    auto nodes = code.makeArray<const Node*>(count);
+    for (auto& node : nodes) {
+        node = analyze(list.asPair()->car, tail && &node == &nodes.back());
+        list = list.asPair()->cdr;
+    }
+    return nodes;
+}
+
+const Node* Interpreter::analyzeBody(Value body, bool tail) {
+    auto nodes = analyzeList(body, tail);
+    if (nodes.empty()) {
+        return makeConstant(Value());
+    }
+    return nodes.size() == 1 ? nodes[0] : code.make<Sequence>(nodes);
+}
+
+// The frame and the operator are kept on the stack below the arguments,
+// where collections triggered by evaluating those can update them.
+Value Interpreter::evalCall(const Node* op, std::span<const Node* const> operands, EvalEnv* env,
+                            bool tail) {
+    checkNativeStack();
+    StackMark mark{*this, stackSize};
+    push(EvalEnv::toValue(env));
+    push(op->run(*this, env));
+    for (auto operand : operands) {
+        push(operand->run(*this, EvalEnv::fromValue(stack[mark.base])));
+    }
+    auto proc = stack[mark.base + 1];
+    auto args = &stack[mark.base + 2];
+    auto count = stackSize - mark.base - 2;
+    if (tail && proc.isObject(ObjectType::LAMBDA)) {
+        auto lambda = static_cast<Lambda*>(proc.asObject());
+        auto body = lambda->body;
+        tailEnv = bindArguments(lambda->params, EvalEnv::fromValue(lambda->env), args, count);
+        tailBody = body;
+        return Value();
+    }
+    return apply(proc, args, count);
+}
+
+Value Interpreter::apply(Value proc, const Value* args, std::size_t count) {
+    if (proc.isObject(ObjectType::BUILTIN)) {
+        return static_cast<Builtin*>(proc.asObject())->function(*this, args, count);
+    }
+    if (proc.isObject(ObjectType::CLOSURE)) {
+        return vm.call(static_cast<Closure*>(proc.asObject()), args, count);
+    }
+    if (!proc.isObject(ObjectType::LAMBDA)) {
+        throw LispError("Not a procedure: " + proc.toString());
+    }
+    auto lambda = static_cast<Lambda*>(proc.asObject());
+    auto body = lambda->body;
+    auto env = bindArguments(lambda->params, EvalEnv::fromValue(lambda->env), args, count);
+    // Tail calls come back here, so a loop of them runs in constant native
+    // stack.
+    while (true) {
+        auto result = body->run(*this, env);
+        if (!tailBody) {
+            return result;
+        }
+        body = tailBody;
+        env = tailEnv;
+        tailBody = nullptr;
+    }
+}
+
+EvalEnv* Interpreter::bindArguments(Value params, EvalEnv* parent, const Value* args,
+                                    std::size_t count) {
+    std::uint32_t required = 0;
+    auto param = params;
+    for (; param.isPair(); param = param.asPair()->cdr) {
+        required++;
+    }
+    bool variadic = param.isSymbol();
+    if (count < required) {
+        throw LispError("Too few arguments");
+    }
+    if (!variadic && count > required) {
+        throw LispError("Too many arguments");
+    }
+
+    // Parameters are code, so only the frame needs rooting.
+    EnvRoot frame(heap, EvalEnv::create(heap, parent, required + variadic));
+    std::size_t i = 0;
+    for (; params.isPair(); params = params.asPair()->cdr, i++) {
+        EvalEnv::define(heap, frame.get(), params.asPair()->car.asSymbol(), args[i]);
+    }
+    if (params.isSymbol()) {
+        Root rest(heap);
+        for (auto j = count; j > i; j--) {
+            rest = cons(args[j - 1], rest);
+        }
+        EvalEnv::define(heap, frame.get(), params.asSymbol(), rest);
+    }
+    return frame.get();
+}
+
+Value Interpreter::call(Value proc, std::initializer_list<Value> args) {
+    StackMark mark{*this, stackSize};
+    push(proc);
+    for (auto arg : args) {
+        push(arg);
+    }
+    return apply(stack[mark.base], &stack[mark.base + 1], args.size());
+}
+
+Value Interpreter::callWithList(Value proc, Value list) {
+    StackMark mark{*this, stackSize};
+    push(proc);
+    for (; list.isPair(); list = list.asPair()->cdr) {
+        push(list.asPair()->car);
+    }
+    if (!list.isNil()) {
+        throw LispError("apply: expected a list");
+    }
+    return apply(stack[mark.base], &stack[mark.base + 1], stackSize - mark.base - 1);
+}
@@ -0,0 +1,160 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "./arena.h"
+#include "./bytecode.h"
+#include "./eval_env.h"
+#include "./heap.h"
+#include "./node.h"
+#include "./optimizer.h"
+#include "./value.h"
+#include "./vm.h"
+
+// Evaluates datums, once the Optimizer has rewritten them, either by
+// analyzing each into a tree of Nodes and running it, or by compiling it to
+// bytecode for the VM.
+// Global variables live in a table indexed by symbol id; local ones in
+// EvalEnv frames searched by name for the tree, and in Frames of slots
+// resolved at compile time for the VM. Arguments being collected for a call are kept on the value
+// stack, which builtins receive a slice of.
+//
+// Pairs, closures and frames made while running are allocated from the
+// collected heap; the value stack and the globals are its roots. Code, being
+// the datums read and the builtins and strings, lives in an arena for the
+// interpreter's lifetime instead, so that eval never has to root it. Pairs
+// there are immutable.
+class Interpreter {
+public:
+    enum class Engine { TREE, VM };
+
+private:
+    friend class VM;
+
+
+    static constexpr std::size_t STACK_CAPACITY = 1 << 20;
+    // How much of the native stack analysis and evaluation may use, leaving
+    // room below the usual 8 MiB limit for builtins and error handling.
+    static constexpr std::size_t MAX_NATIVE_STACK = 6 << 20;
+
+    // Pops values pushed since construction however the scope ends.
+    struct StackMark {
+        Interpreter& self;
+        std::size_t base;
+        ~StackMark() {
+            self.stackSize = base;
+        }
+    };
+
+    Arena code;
+    Heap heap;
+    // Indexed by symbol id. A deque, so that cells stay put as it grows.
+    std::deque<Value> globals;
+    // Advanced by every global define, invalidating the VM's call caches.
+    std::uint64_t globalEpoch{1};
+    // Slots in code that hold heap objects, from datums copied by copyToCode.
+    std::vector<Value*> codeSlots;
+    std::unique_ptr<Value[]> stack;
+    std::size_t stackSize{0};
+    // The outermost native stack address seen by checkNativeStack(), which
+    // assumes the stack grows down.
+    std::uintptr_t nativeBase{0};
+    // The body and frame a call in tail position leaves for the apply() it
+    // returns to, which runs them in place of the body it was running.
+    // Nothing allocates in between, so the frame needs no root.
+    const Node* tailBody{nullptr};
+    EvalEnv* tailEnv{nullptr};
+    Engine engine{Engine::VM};
+    bool jitEnabled{true};
+    Optimizer::Options optimizations;
+    VM vm{*this};
+
+    // A new frame for a call to a procedure taking params, with them bound.
+    EvalEnv* bindArguments(Value params, EvalEnv* parent, const Value* args, std::size_t count);
+
+public:
+    explicit Interpreter(std::size_t nurserySize = Heap::DEFAULT_NURSERY_SIZE);
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    Heap& getHeap() {
+        return heap;
+    }
+    // Where datums to be evaluated must be read into.
+    Arena& getCodeArena() {
+        return code;
+    }
+
+    void setEngine(Engine engine) {
+        this->engine = engine;
+    }
+    // Whether the VM compiles hot procedures to native code, where it can.
+    void setJit(bool enabled) {
+        jitEnabled = enabled;
+    }
+    // Which passes of the optimizer run on each datum before it is evaluated.
+    void setOptimizations(const Optimizer::Options& options) {
+        optimizations = options;
+    }
+
+    // expr must be in the code arena.
+    Value eval(Value expr);
+    // expr must be in the code arena. tail is whether it is in tail position
+    // in a lambda body.
+    const Node* analyze(Value expr, bool tail = false);
+    // A node evaluating each datum of a proper list in turn, giving the last
+    // value, or () for an empty list.
+    const Node* analyzeBody(Value body, bool tail);
+    // tail applies to the last datum.
+    std::span<const Node*> analyzeList(Value list, bool tail = false);
+    const Node* makeConstant(Value value);
+
+    // Throws if deep recursion has nearly used up the native stack.
+    void checkNativeStack();
+    // Runs a call whose operator and operands have been analyzed. A call in
+    // tail position of a Lambda only binds its arguments, and gives () with
+    // tailBody set.
+    Value evalCall(const Node* op, std::span<const Node* const> operands, EvalEnv* env,
+                   bool tail);
+    // args must point into the value stack, as they do for builtins.
+    Value apply(Value proc, const Value* args, std::size_t count);
+    Value call(Value proc, std::initializer_list<Value> args);
+    // Calls proc with the items of a proper list as arguments.
+    Value callWithList(Value proc, Value list);
+
+    Value lookup(SymbolId name, EvalEnv* env);
+    // Binds name in env, or globally when env is null.
+    void define(SymbolId name, Value value, EvalEnv* env);
+    // The cell holding the global variable name, unbound if it is not
+    // defined yet.
+    Value* globalCell(SymbolId name);
+
+    Value cons(Value car, Value cdr) {
+        return heap.cons(car, cdr);
+    }
+    void setCar(Value pair, Value value);
+    void setCdr(Value pair, Value value);
+    Value makeString(std::string_view text);
+    Value makeLambda(Value params, const Node* body, Value source, EvalEnv* env);
+    // env is the VM frame the closure captures, or ().
+    Value makeClosure(const Prototype* prototype, Value env);
+    Value makePromise(Value proc, Value args);
+    // An f64vector of zeros.
+    Value makeF64Vector(std::uint64_t length);
+    // Copies a datum built at run time into the code arena, so it can be
+    // evaluated.
+    Value copyToCode(Value datum);
+    // Records a slot in code that may hold a heap object, as a root.
+    void addCodeRoot(Value* slot);
+
+    void push(Value value);
+};
+
+#endif
@@ -0,0 +1,770 @@
+#include "./jit.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <unordered_map>
+#include <utility>
+
+#ifdef MINI_LISP_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef MINI_LISP_JIT
+
+namespace {
+
+enum class Register : std::uint8_t {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    RSI = 6,
+    RDI = 7,
+    R8 = 8,
+    R9 = 9,
+    R10 = 10,
+    R11 = 11,
+};
+
+// The low nibble of the jcc and setcc opcodes.
+enum class Condition : std::uint8_t {
+    OVERFLOWED = 0x0,
+    ABOVE_EQUAL = 0x3,
+    EQUAL = 0x4,
+    NOT_EQUAL = 0x5,
+    ABOVE = 0x7,
+    PARITY = 0xA,
+    NO_PARITY = 0xB,
+    LESS = 0xC,
+    GREATER_EQUAL = 0xD,
+    LESS_EQUAL = 0xE,
+    GREATER = 0xF,
+};
+
+// Opcodes of the two-register ALU instructions, register to register/memory.
+enum class Alu : std::uint8_t {
+    ADD = 0x01,
+    OR = 0x09,
+    AND = 0x21,
+    SUB = 0x29,
+    CMP = 0x39,
+    TEST = 0x85,
+    MOV = 0x89,
+};
+
+// Opcode extensions of the immediate forms.
+constexpr int ADD_EXTENSION = 0;
+constexpr int SUB_EXTENSION = 5;
+constexpr int CMP_EXTENSION = 7;
+constexpr int SHL_EXTENSION = 4;
+constexpr int SHR_EXTENSION = 5;
+constexpr int SAR_EXTENSION = 7;
+
+// The few x86-64 instructions the templates need. Jumps are always rel32,
+// and memory operands always [base + disp32].
+class Assembler {
+private:
+    std::vector<std::uint8_t> code;
+
+    static int number(Register r) {
+        return static_cast<int>(r);
+    }
+    void byte(std::uint8_t value) {
+        code.push_back(value);
+    }
+    void bytes(std::initializer_list<std::uint8_t> values) {
+        code.insert(code.end(), values);
+    }
+    template <typename T>
+    void immediate(T value) {
+        auto at = code.size();
+        code.resize(at + sizeof(T));
+        std::memcpy(&code[at], &value, sizeof(T));
+    }
+    // Omitted when it would be 0x40, unless force, which byte registers
+    // other than al to bl need.
+    void rex(bool wide, int reg, int rm, bool force = false) {
+        std::uint8_t prefix = 0x40 | (wide << 3) | ((reg >> 3) << 2) | (rm >> 3);
+        if (prefix != 0x40 || force) {
+            byte(prefix);
+        }
+    }
+    void registerOperand(int reg, int rm) {
+        byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+    void memoryOperand(int reg, int base, std::int32_t displacement) {
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == 4) {
+            byte(0x24);
+        }
+        immediate(displacement);
+    }
+    void sse(std::uint8_t prefix, std::uint8_t opcode, int reg, int rm, bool wide) {
+        byte(prefix);
+        rex(wide, reg, rm);
+        bytes({0x0F, opcode});
+        registerOperand(reg, rm);
+    }
+
+public:
+    std::size_t size() const {
+        return code.size();
+    }
+    const std::vector<std::uint8_t>& output() const {
+        return code;
+    }
+
+    void moveImmediate(Register r, std::uint64_t value) {
+        rex(true, 0, number(r));
+        byte(0xB8 + (number(r) & 7));
+        immediate(value);
+    }
+    // Zero-extends value.
+    void moveImmediate32(Register r, std::uint32_t value) {
+        rex(false, 0, number(r));
+        byte(0xB8 + (number(r) & 7));
+        immediate(value);
+    }
+    void load(Register r, Register base, std::int32_t displacement) {
+        rex(true, number(r), number(base));
+        byte(0x8B);
+        memoryOperand(number(r), number(base), displacement);
+    }
+    void store(Register base, std::int32_t displacement, Register r) {
+        rex(true, number(r), number(base));
+        byte(0x89);
+        memoryOperand(number(r), number(base), displacement);
+    }
+    void store32(Register base, std::int32_t displacement, std::uint32_t value) {
+        rex(false, 0, number(base));
+        byte(0xC7);
+        memoryOperand(0, number(base), displacement);
+        immediate(value);
+    }
+    void alu(Alu op, Register destination, Register source) {
+        rex(true, number(source), number(destination));
+        byte(static_cast<std::uint8_t>(op));
+        registerOperand(number(source), number(destination));
+    }
+    void aluImmediate(int extension, Register r, std::int32_t value) {
+        rex(true, 0, number(r));
+        byte(0x81);
+        registerOperand(extension, number(r));
+        immediate(value);
+    }
+    void compare32(Register r, std::uint32_t value) {
+        rex(false, 0, number(r));
+        byte(0x81);
+        registerOperand(CMP_EXTENSION, number(r));
+        immediate(value);
+    }
+    void shift(int extension, Register r, std::uint8_t count) {
+        rex(true, 0, number(r));
+        byte(0xC1);
+        registerOperand(extension, number(r));
+        byte(count);
+    }
+    void multiply(Register destination, Register source) {
+        rex(true, number(destination), number(source));
+        bytes({0x0F, 0xAF});
+        registerOperand(number(destination), number(source));
+    }
+    // Sets r to 0 or 1 by the condition.
+    void set(Condition condition, Register r) {
+        rex(false, 0, number(r), true);
+        bytes({0x0F, static_cast<std::uint8_t>(0x90 | static_cast<std::uint8_t>(condition))});
+        registerOperand(0, number(r));
+        rex(false, number(r), number(r), true);
+        bytes({0x0F, 0xB6});
+        registerOperand(number(r), number(r));
+    }
+    // Each jump returns where its offset is, for patch().
+    std::size_t jump(Condition condition) {
+        bytes({0x0F, static_cast<std::uint8_t>(0x80 | static_cast<std::uint8_t>(condition))});
+        immediate(std::int32_t{0});
+        return code.size() - sizeof(std::int32_t);
+    }
+    std::size_t jump() {
+        byte(0xE9);
+        immediate(std::int32_t{0});
+        return code.size() - sizeof(std::int32_t);
+    }
+    void jump(Register r) {
+        rex(false, 0, number(r));
+        byte(0xFF);
+        registerOperand(4, number(r));
+    }
+    void call(Register base, std::int32_t displacement) {
+        rex(false, 0, number(base));
+        byte(0xFF);
+        memoryOperand(2, number(base), displacement);
+    }
+    void push(Register r) {
+        rex(false, 0, number(r));
+        byte(0x50 + (number(r) & 7));
+    }
+    void pop(Register r) {
+        rex(false, 0, number(r));
+        byte(0x58 + (number(r) & 7));
+    }
+    void patch(std::size_t at, std::size_t target) {
+        auto offset = static_cast<std::int32_t>(target - (at + sizeof(std::int32_t)));
+        std::memcpy(&code[at], &offset, sizeof(offset));
+    }
+    // Points the jump at the code emitted next.
+    void bind(std::size_t at) {
+        patch(at, code.size());
+    }
+    void ret() {
+        byte(0xC3);
+    }
+
+    void moveToXmm(int xmm, Register r) {
+        sse(0x66, 0x6E, xmm, number(r), true);
+    }
+    void moveFromXmm(Register r, int xmm) {
+        sse(0x66, 0x7E, xmm, number(r), true);
+    }
+    void convertToDouble(int xmm, Register r) {
+        sse(0xF2, 0x2A, xmm, number(r), true);
+    }
+    void addDouble(int destination, int source) {
+        sse(0xF2, 0x58, destination, source, false);
+    }
+    void subtractDouble(int destination, int source) {
+        sse(0xF2, 0x5C, destination, source, false);
+    }
+    void multiplyDouble(int destination, int source) {
+        sse(0xF2, 0x59, destination, source, false);
+    }
+    void divideDouble(int destination, int source) {
+        sse(0xF2, 0x5E, destination, source, false);
+    }
+    void compareDouble(int a, int b) {
+        sse(0x66, 0x2E, a, b, false);
+    }
+    void clearDouble(int xmm) {
+        sse(0x66, 0x57, xmm, xmm, false);
+    }
+};
+
+using enum Register;
+
+constexpr std::int32_t BASE = offsetof(NativeContext, base);
+constexpr std::int32_t TOP = offsetof(NativeContext, top);
+constexpr std::int32_t LIMIT = offsetof(NativeContext, limit);
+constexpr std::int32_t EXIT = offsetof(NativeContext, exit);
+constexpr std::int32_t CALL = offsetof(NativeContext, call);
+constexpr std::int32_t RET = offsetof(NativeContext, ret);
+
+// Frames hold their parent right after the object header, then the slots.
+static_assert(sizeof(Frame) == sizeof(Object) + sizeof(Value));
+constexpr std::int32_t FRAME_PARENT = sizeof(Object);
+constexpr std::int32_t FRAME_SLOTS = sizeof(Frame);
+
+const std::uint64_t NIL_BITS = Value().getBits();
+const std::uint64_t FALSE_BITS = Value::fromBoolean(false).getBits();
+const std::uint64_t UNBOUND_BITS = Value::unbound().getBits();
+const std::uint64_t FIXNUM_BITS = Value::fromInteger(0).getBits();
+const std::uint32_t FIXNUM_TAG = static_cast<std::uint32_t>(FIXNUM_BITS >> 48);
+constexpr std::uint64_t PAYLOAD_MASK = (std::uint64_t{1} << 48) - 1;
+
+std::uint32_t operandCount(Opcode op) {
+    switch (op) {
+        case Opcode::NIL:
+        case Opcode::POP:
+        case Opcode::RETURN:
+        case Opcode::LEAVE: return 0;
+        case Opcode::LOAD_STACK:
+        case Opcode::CALL:
+        case Opcode::TAIL_CALL:
+        case Opcode::ENTER:
+        case Opcode::JUMP_UNLESS_LESS:
+        case Opcode::JUMP_UNLESS_GREATER:
+        case Opcode::JUMP_UNLESS_NUMBER_EQUAL:
+        case Opcode::JUMP_UNLESS_LESS_EQUAL:
+        case Opcode::JUMP_UNLESS_GREATER_EQUAL:
+        case Opcode::JUMP_UNLESS_GLOBAL: return 2;
+        case Opcode::LOAD_LOCAL:
+        case Opcode::ENTER_STACK: return 3;
+        default: return 1;
+    }
+}
+
+// Translates one prototype. Registers hold, throughout:
+//
+//     rbx  the NativeContext, saved by the entry
+//     rsi  the activation's base
+//     rdx  the top of the stack
+//     rcx  the limit of the stack
+//
+// leaving rax, rdi, r8 to r11 and xmm0 to xmm2 free. rsi, rdx and rcx are
+// reloaded from the context after calling one of its hooks, which may have
+// moved to another activation.
+class Translator {
+private:
+    const Prototype& prototype;
+    Assembler assembler;
+    // The native offset of each instruction, by bytecode offset.
+    std::vector<std::size_t> offsets;
+    // Jumps to be pointed at an instruction, and at the exit before one.
+    std::vector<std::pair<std::size_t, std::uint32_t>> jumps;
+    std::vector<std::pair<std::size_t, std::uint32_t>> exits;
+    // The bytecode offset of the instruction being translated.
+    std::uint32_t at{0};
+
+    const std::uint8_t* operandAt(std::uint32_t index) const {
+        return &prototype.code[at + 1 + index * sizeof(std::uint32_t)];
+    }
+    std::uint32_t operand(std::uint32_t index) const {
+        return readOperand<std::uint32_t>(operandAt(index));
+    }
+    std::uint32_t jumpTarget(std::uint32_t index, std::uint32_t next) const {
+        auto offset = readOperand<std::int32_t>(operandAt(index));
+        return static_cast<std::uint32_t>(static_cast<std::int64_t>(next) + offset);
+    }
+    static std::int32_t slotAt(std::uint32_t slot) {
+        return static_cast<std::int32_t>(sizeof(Value) * (1 + slot));
+    }
+
+    // Leaves the current instruction to the interpreter.
+    void exitIf(Condition condition) {
+        exits.emplace_back(assembler.jump(condition), at);
+    }
+    void exit() {
+        exits.emplace_back(assembler.jump(), at);
+    }
+    void exitIfUnbound(Register r) {
+        assembler.moveImmediate(R8, UNBOUND_BITS);
+        assembler.alu(Alu::CMP, r, R8);
+        exitIf(Condition::EQUAL);
+    }
+    // Goes on where a hook returned, or leaves the current instruction to the
+    // interpreter.
+    void continueFromHook() {
+        assembler.load(RSI, RBX, BASE);
+        assembler.load(RDX, RBX, TOP);
+        assembler.load(RCX, RBX, LIMIT);
+        assembler.alu(Alu::TEST, RAX, RAX);
+        exitIf(Condition::EQUAL);
+        assembler.jump(RAX);
+    }
+    void push(Register r) {
+        assembler.alu(Alu::CMP, RDX, RCX);
+        exitIf(Condition::ABOVE_EQUAL);
+        assembler.store(RDX, 0, r);
+        assembler.aluImmediate(ADD_EXTENSION, RDX, sizeof(Value));
+    }
+    void untag(Register r) {
+        assembler.shift(SHL_EXTENSION, r, 16);
+        assembler.shift(SAR_EXTENSION, r, 16);
+    }
+    // Tags the integer in rax, leaving it to the interpreter if it is out of
+    // the fixnum range.
+    void tagFixnum() {
+        assembler.alu(Alu::MOV, R8, RAX);
+        untag(R8);
+        assembler.alu(Alu::CMP, R8, RAX);
+        exitIf(Condition::NOT_EQUAL);
+        assembler.shift(SHL_EXTENSION, RAX, 16);
+        assembler.shift(SHR_EXTENSION, RAX, 16);
+        assembler.moveImmediate(R8, FIXNUM_BITS);
+        assembler.alu(Alu::OR, RAX, R8);
+    }
+    // Converts the number in r, whose tag is in tag, to a double in xmm.
+    void toDouble(int xmm, Register r, Register tag) {
+        assembler.compare32(tag, FIXNUM_TAG);
+        auto isDouble = assembler.jump(Condition::NOT_EQUAL);
+        untag(r);
+        assembler.convertToDouble(xmm, r);
+        auto done = assembler.jump();
+        assembler.bind(isDouble);
+        assembler.moveToXmm(xmm, r);
+        assembler.bind(done);
+    }
+
+    void translateArithmetic(Opcode op, const GlobalRef& global);
+    void translateInstruction(Opcode op, std::uint32_t next);
+
+public:
+    explicit Translator(const Prototype& prototype)
+        : prototype{prototype}, offsets(prototype.code.size()) {}
+
+    // Returns the code, and the offset of each instruction in it.
+    std::pair<const std::vector<std::uint8_t>&, const std::vector<std::size_t>&> translate();
+};
+
+// Leaves the result in rax, or for a comparison 0 or 1 in r8. Both operands
+// stay on the stack until the guards have passed.
+void Translator::translateArithmetic(Opcode op, const GlobalRef& global) {
+    auto& a = assembler;
+    a.moveImmediate(RAX, reinterpret_cast<std::uint64_t>(global.cell));
+    a.load(RAX, RAX, 0);
+    a.moveImmediate(R8, global.expected.getBits());
+    a.alu(Alu::CMP, RAX, R8);
+    exitIf(Condition::NOT_EQUAL);
+    a.load(RAX, RDX, -16);
+    a.load(R9, RDX, -8);
+    a.alu(Alu::MOV, R10, RAX);
+    a.shift(SHR_EXTENSION, R10, 48);
+    a.alu(Alu::MOV, R11, R9);
+    a.shift(SHR_EXTENSION, R11, 48);
+
+    // Two fixnums.
+    a.compare32(R10, FIXNUM_TAG);
+    auto firstNotFixnum = a.jump(Condition::NOT_EQUAL);
+    a.compare32(R11, FIXNUM_TAG);
+    auto secondNotFixnum = a.jump(Condition::NOT_EQUAL);
+    untag(RAX);
+    untag(R9);
+    switch (op) {
+        case Opcode::ADD:
+            a.alu(Alu::ADD, RAX, R9);
+            tagFixnum();
+            break;
+        case Opcode::SUBTRACT:
+            a.alu(Alu::SUB, RAX, R9);
+            tagFixnum();
+            break;
+        case Opcode::MULTIPLY:
+            a.multiply(RAX, R9);
+            exitIf(Condition::OVERFLOWED);
+            tagFixnum();
+            break;
+        // Whether the quotient is exact is left to the interpreter.
+        case Opcode::DIVIDE: exit(); break;
+        default: {
+            static const std::unordered_map<Opcode, Condition> CONDITIONS{
+                {Opcode::LESS, Condition::LESS},
+                {Opcode::GREATER, Condition::GREATER},
+                {Opcode::NUMBER_EQUAL, Condition::EQUAL},
+                {Opcode::LESS_EQUAL, Condition::LESS_EQUAL},
+                {Opcode::GREATER_EQUAL, Condition::GREATER_EQUAL},
+            };
+            a.alu(Alu::CMP, RAX, R9);
+            a.set(CONDITIONS.at(op), R8);
+        }
+    }
+    auto done = a.jump();
+
+    // Two numbers, at least one a double.
+    a.bind(firstNotFixnum);
+    a.bind(secondNotFixnum);
+    a.compare32(R10, FIXNUM_TAG);
+    exitIf(Condition::ABOVE);
+    a.compare32(R11, FIXNUM_TAG);
+    exitIf(Condition::ABOVE);
+    if (op == Opcode::DIVIDE) {
+        // Division by an exact zero is an error the builtin reports.
+        a.compare32(R11, FIXNUM_TAG);
+        auto nonzero = a.jump(Condition::NOT_EQUAL);
+        a.alu(Alu::MOV, R8, R9);
+        a.shift(SHL_EXTENSION, R8, 16);
+        a.alu(Alu::TEST, R8, R8);
+        exitIf(Condition::EQUAL);
+        a.bind(nonzero);
+    }
+    toDouble(0, RAX, R10);
+    toDouble(1, R9, R11);
+    switch (op) {
+        case Opcode::ADD:
+            // The builtin starts its sum from an exact 0.
+            a.clearDouble(2);
+            a.addDouble(2, 0);
+            a.addDouble(2, 1);
+            a.compareDouble(2, 2);
+            exitIf(Condition::PARITY);
+            a.moveFromXmm(RAX, 2);
+            break;
+        case Opcode::SUBTRACT:
+        case Opcode::MULTIPLY:
+        case Opcode::DIVIDE:
+            if (op == Opcode::SUBTRACT) {
+                a.subtractDouble(0, 1);
+            } else if (op == Opcode::MULTIPLY) {
+                a.multiplyDouble(0, 1);
+            } else {
+                a.divideDouble(0, 1);
+            }
+            // NaNs are canonicalized by the interpreter.
+            a.compareDouble(0, 0);
+            exitIf(Condition::PARITY);
+            a.moveFromXmm(RAX, 0);
+            break;
+        // An unordered comparison sets the carry and zero flags, so that
+        // only equality has to check for it.
+        case Opcode::LESS:
+            a.compareDouble(1, 0);
+            a.set(Condition::ABOVE, R8);
+            break;
+        case Opcode::LESS_EQUAL:
+            a.compareDouble(1, 0);
+            a.set(Condition::ABOVE_EQUAL, R8);
+            break;
+        case Opcode::GREATER:
+            a.compareDouble(0, 1);
+            a.set(Condition::ABOVE, R8);
+            break;
+        case Opcode::GREATER_EQUAL:
+            a.compareDouble(0, 1);
+            a.set(Condition::ABOVE_EQUAL, R8);
+            break;
+        default:
+            a.compareDouble(0, 1);
+            a.set(Condition::EQUAL, R8);
+            a.set(Condition::NO_PARITY, R9);
+            a.alu(Alu::AND, R8, R9);
+    }
+    a.bind(done);
+}
+
+void Translator::translateInstruction(Opcode op, std::uint32_t next) {
+    auto& a = assembler;
+    switch (op) {
+        case Opcode::CONSTANT:
+            a.moveImmediate(RAX, reinterpret_cast<std::uint64_t>(&prototype.constants[operand(0)]));
+            a.load(RAX, RAX, 0);
+            push(RAX);
+            return;
+        case Opcode::NIL:
+            a.moveImmediate(RAX, NIL_BITS);
+            push(RAX);
+            return;
+        case Opcode::LOAD_LOCAL:
+            a.load(RAX, RSI, 0);
+            a.moveImmediate(R8, PAYLOAD_MASK);
+            a.alu(Alu::AND, RAX, R8);
+            for (std::uint32_t depth = operand(0); depth > 0; depth--) {
+                a.load(RAX, RAX, FRAME_PARENT);
+                a.alu(Alu::AND, RAX, R8);
+            }
+            a.load(RAX, RAX, static_cast<std::int32_t>(FRAME_SLOTS + sizeof(Value) * operand(1)));
+            exitIfUnbound(RAX);
+            push(RAX);
+            return;
+        case Opcode::LOAD_STACK:
+            a.load(RAX, RSI, slotAt(operand(0)));
+            exitIfUnbound(RAX);
+            push(RAX);
+            return;
+        case Opcode::LOAD_GLOBAL: {
+            auto cell = prototype.globals[operand(0)].cell;
+            a.moveImmediate(RAX, reinterpret_cast<std::uint64_t>(cell));
+            a.load(RAX, RAX, 0);
+            exitIfUnbound(RAX);
+            push(RAX);
+            return;
+        }
+        case Opcode::DEFINE_STACK:
+            a.load(RAX, RDX, -8);
+            a.store(RSI, slotAt(operand(0)), RAX);
+            a.moveImmediate(RAX, NIL_BITS);
+            a.store(RDX, -8, RAX);
+            return;
+        case Opcode::POP: a.aluImmediate(SUB_EXTENSION, RDX, sizeof(Value)); return;
+        case Opcode::JUMP: jumps.emplace_back(a.jump(), jumpTarget(0, next)); return;
+        case Opcode::JUMP_IF_FALSE:
+            a.aluImmediate(SUB_EXTENSION, RDX, sizeof(Value));
+            a.load(RAX, RDX, 0);
+            a.moveImmediate(R8, FALSE_BITS);
+            a.alu(Alu::CMP, RAX, R8);
+            jumps.emplace_back(a.jump(Condition::EQUAL), jumpTarget(0, next));
+            return;
+        case Opcode::JUMP_IF_FALSE_OR_POP:
+        case Opcode::JUMP_IF_TRUE_OR_POP:
+            a.load(RAX, RDX, -8);
+            a.moveImmediate(R8, FALSE_BITS);
+            a.alu(Alu::CMP, RAX, R8);
+            jumps.emplace_back(a.jump(op == Opcode::JUMP_IF_FALSE_OR_POP ? Condition::EQUAL
+                                                                         : Condition::NOT_EQUAL),
+                               jumpTarget(0, next));
+            a.aluImmediate(SUB_EXTENSION, RDX, sizeof(Value));
+            return;
+        case Opcode::ENTER_STACK: {
+            auto first = operand(0);
+            auto count = operand(1);
+            auto size = operand(2);
+            for (std::uint32_t i = 0; i < count; i++) {
+                a.load(RAX, RDX, -static_cast<std::int32_t>(sizeof(Value) * (count - i)));
+                a.store(RSI, slotAt(first + i), RAX);
+            }
+            a.moveImmediate(RAX, UNBOUND_BITS);
+            for (auto i = count; i < size; i++) {
+                a.store(RSI, slotAt(first + i), RAX);
+            }
+            a.aluImmediate(SUB_EXTENSION, RDX, static_cast<std::int32_t>(sizeof(Value) * count));
+            return;
+        }
+        case Opcode::ADD:
+        case Opcode::SUBTRACT:
+        case Opcode::MULTIPLY:
+        case Opcode::DIVIDE:
+            translateArithmetic(op, prototype.globals[operand(0)]);
+            a.store(RDX, -16, RAX);
+            a.aluImmediate(SUB_EXTENSION, RDX, sizeof(Value));
+            return;
+        case Opcode::LESS:
+        case Opcode::GREATER:
+        case Opcode::NUMBER_EQUAL:
+        case Opcode::LESS_EQUAL:
+        case Opcode::GREATER_EQUAL:
+            translateArithmetic(op, prototype.globals[operand(0)]);
+            a.moveImmediate(RAX, FALSE_BITS);
+            a.alu(Alu::ADD, RAX, R8);
+            a.store(RDX, -16, RAX);
+            a.aluImmediate(SUB_EXTENSION, RDX, sizeof(Value));
+            return;
+        case Opcode::JUMP_UNLESS_LESS:
+        case Opcode::JUMP_UNLESS_GREATER:
+        case Opcode::JUMP_UNLESS_NUMBER_EQUAL:
+        case Opcode::JUMP_UNLESS_LESS_EQUAL:
+        case Opcode::JUMP_UNLESS_GREATER_EQUAL: {
+            static const std::unordered_map<Opcode, Opcode> COMPARISONS{
+                {Opcode::JUMP_UNLESS_LESS, Opcode::LESS},
+                {Opcode::JUMP_UNLESS_GREATER, Opcode::GREATER},
+                {Opcode::JUMP_UNLESS_NUMBER_EQUAL, Opcode::NUMBER_EQUAL},
+                {Opcode::JUMP_UNLESS_LESS_EQUAL, Opcode::LESS_EQUAL},
+                {Opcode::JUMP_UNLESS_GREATER_EQUAL, Opcode::GREATER_EQUAL},
+            };
+            translateArithmetic(COMPARISONS.at(op), prototype.globals[operand(0)]);
+            a.aluImmediate(SUB_EXTENSION, RDX, 2 * sizeof(Value));
+            a.alu(Alu::TEST, R8, R8);
+            jumps.emplace_back(a.jump(Condition::EQUAL), jumpTarget(1, next));
+            return;
+        }
+        case Opcode::JUMP_UNLESS_GLOBAL: {
+            // The value may be a closure, which the collector can move.
+            auto& global = prototype.globals[operand(0)];
+            a.moveImmediate(RAX, reinterpret_cast<std::uint64_t>(global.cell));
+            a.load(RAX, RAX, 0);
+            a.moveImmediate(R8, reinterpret_cast<std::uint64_t>(&global.expected));
+            a.load(R8, R8, 0);
+            a.alu(Alu::CMP, RAX, R8);
+            jumps.emplace_back(a.jump(Condition::NOT_EQUAL), jumpTarget(1, next));
+            return;
+        }
+        case Opcode::CALL:
+        case Opcode::TAIL_CALL:
+            a.store(RBX, TOP, RDX);
+            a.alu(Alu::MOV, RDI, RBX);
+            a.moveImmediate32(RSI, operand(0));
+            a.moveImmediate32(RDX, operand(1));
+            a.moveImmediate32(RCX, next);
+            a.moveImmediate32(R8, op == Opcode::TAIL_CALL);
+            a.call(RBX, CALL);
+            continueFromHook();
+            return;
+        case Opcode::RETURN:
+            a.store(RBX, TOP, RDX);
+            a.alu(Alu::MOV, RDI, RBX);
+            a.call(RBX, RET);
+            continueFromHook();
+            return;
+        // Instructions that allocate or define.
+        default: exit(); return;
+    }
+}
+
+std::pair<const std::vector<std::uint8_t>&, const std::vector<std::size_t>&>
+Translator::translate() {
+    auto& a = assembler;
+    // The entry: loads the registers, then jumps to the instruction asked for.
+    // Pushing rbx also aligns the stack for calls.
+    a.push(RBX);
+    a.alu(Alu::MOV, RBX, RDI);
+    a.alu(Alu::MOV, RAX, RSI);
+    a.load(RSI, RBX, BASE);
+    a.load(RDX, RBX, TOP);
+    a.load(RCX, RBX, LIMIT);
+    a.jump(RAX);
+
+    auto code = prototype.code;
+    while (at < code.size()) {
+        auto op = static_cast<Opcode>(code[at]);
+        auto next = at + 1 + operandCount(op) * static_cast<std::uint32_t>(sizeof(std::uint32_t));
+        offsets[at] = a.size();
+        translateInstruction(op, next);
+        at = next;
+    }
+    for (auto [jump, target] : jumps) {
+        a.patch(jump, offsets[target]);
+    }
+    // One exit per instruction, saving the top and where to go on.
+    std::unordered_map<std::uint32_t, std::size_t> stubs;
+    for (auto [jump, exit] : exits) {
+        auto stub = stubs.find(exit);
+        if (stub == stubs.end()) {
+            stub = stubs.emplace(exit, a.size()).first;
+            a.store(RBX, TOP, RDX);
+            a.store32(RBX, EXIT, exit);
+            a.pop(RBX);
+            a.ret();
+        }
+        a.patch(jump, stub->second);
+    }
+    return {a.output(), offsets};
+}
+
+}  // namespace
+
+Jit::~Jit() {
+    for (auto region : regions) {
+        munmap(region.start, region.size);
+    }
+}
+
+// Regions are only writable while code is copied in.
+std::uint8_t* Jit::install(const std::vector<std::uint8_t>& code) {
+    constexpr std::size_t REGION_SIZE = 64 * 1024;
+    constexpr std::size_t ALIGNMENT = 16;
+    if (regions.empty() || used + code.size() > regions.back().size) {
+        auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        auto size = (std::max(code.size(), REGION_SIZE) + page - 1) / page * page;
+        auto start =
+            mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (start == MAP_FAILED) {
+            return nullptr;
+        }
+        regions.push_back({static_cast<std::uint8_t*>(start), size});
+        used = 0;
+    } else if (mprotect(regions.back().start, regions.back().size, PROT_READ | PROT_WRITE) != 0) {
+        return nullptr;
+    }
+    auto& region = regions.back();
+    auto start = region.start + used;
+    std::copy(code.begin(), code.end(), start);
+    used = (used + code.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (mprotect(region.start, region.size, PROT_READ | PROT_EXEC) != 0) {
+        return nullptr;
+    }
+    return start;
+}
+
+const NativeCode* Jit::compile(const Prototype& prototype) {
+    Translator translator(prototype);
+    auto [code, offsets] = translator.translate();
+    auto start = install(code);
+    if (!start) {
+        return nullptr;
+    }
+    auto native = arena.make<NativeCode>();
+    native->entry = reinterpret_cast<decltype(native->entry)>(start);
+    native->addresses = arena.makeArray<const void*>(offsets.size());
+    for (std::size_t i = 0; i < offsets.size(); i++) {
+        native->addresses[i] = start + offsets[i];
+    }
+    return native;
+}
+
+#else
+
+Jit::~Jit() = default;
+
+const NativeCode* Jit::compile(const Prototype&) {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "./arena.h"
+#include "./bytecode.h"
+#include "./value.h"
+
+// Only x86-64 under the System V calling convention, with mmap, is supported.
+#if defined(__x86_64__) && !defined(_WIN32)
+#define MINI_LISP_JIT
+#endif
+
+// What native code works on, and where it stopped.
+struct NativeContext {
+    Value* base;
+    Value* top;
+    Value* limit;
+    std::uint32_t exit;
+    // Carry out a call or return from native code, updating base and top, and
+    // give the native address to go on at; null leaves the instruction to the
+    // interpreter. They must not throw.
+    const void* (*call)(NativeContext* context, std::uint32_t count, std::uint32_t site,
+                        std::uint32_t next, bool tail);
+    const void* (*ret)(NativeContext* context);
+};
+
+struct NativeCode {
+    void (*entry)(NativeContext* context, const void* at);
+    // The native address of each instruction, by its bytecode offset.
+    std::span<const void*> addresses;
+};
+
+// Compiles the bytecode of hot prototypes into x86-64 machine code, one
+// template per instruction, in executable pages of its own.
+//
+// Native code runs from any instruction up to the first one that needs the
+// interpreter: allocation, and any whose guards fail, such as arithmetic on
+// anything but fixnums and doubles. It leaves that instruction unrun, so the
+// interpreter can carry on from it. Calls and returns go through the
+// context, and may carry on in the native code of another prototype.
+class Jit {
+private:
+    struct Region {
+        std::uint8_t* start;
+        std::size_t size;
+    };
+
+    Arena& arena;
+    std::vector<Region> regions;
+    // Bytes of the last region used so far.
+    std::size_t used{0};
+
+    // Copies code into executable memory.
+    std::uint8_t* install(const std::vector<std::uint8_t>& code);
+
+public:
+    explicit Jit(Arena& arena) : arena{arena} {}
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    ~Jit();
+
+    // Null if native code is not supported here.
+    const NativeCode* compile(const Prototype& prototype);
+};
+
+#endif
@@ -1,23 +1,216 @@
+#include <deque>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 
+#include "./error.h"
+#include "./interpreter.h"
+#include "./mapped_file.h"
+#include "./parallel_tokenizer.h"
+#include "./reader.h"
+#include "./stream_tokenizer.h"
 #include "./tokenizer.h"
 
-int main() {
+struct Options {
+    Interpreter::Engine engine{Interpreter::Engine::VM};
+    bool jit{true};
+    Optimizer::Options optimizations;
+};
+
+void configure(Interpreter& interpreter, const Options& options) {
+    interpreter.setEngine(options.engine);
+    interpreter.setJit(options.jit);
+    interpreter.setOptimizations(options.optimizations);
+}
+
+// Turns off the optimizer passes named in a comma-separated list.
+bool disablePasses(std::string_view names, Optimizer::Options& optimizations) {
+    while (true) {
+        auto end = names.find(',');
+        auto name = names.substr(0, end);
+        if (name == "fold") {
+            optimizations.fold = false;
+        } else if (name == "branches") {
+            optimizations.branches = false;
+        } else if (name == "inline") {
+            optimizations.inlining = false;
+        } else if (name == "let") {
+            optimizations.lambdaCalls = false;
+        } else {
+            std::cerr << "Unknown optimization: " << name << std::endl;
+            return false;
+        }
+        if (end == std::string_view::npos) {
+            return true;
+        }
+        names = names.substr(end + 1);
+    }
+}
+
+// Whether a token can only be followed by the rest of its datum.
+bool isPrefix(const Token& token) {
+    auto type = token.getType();
+    return type == TokenType::QUOTE || type == TokenType::QUASIQUOTE ||
+           type == TokenType::UNQUOTE;
+}
+
+// A script that cannot be mapped, such as a pipe, is read in chunks instead.
+// Each form runs once its last token has arrived.
+void runStream(std::istream& in, Interpreter& interpreter) {
+    StreamTokenizer tokenizer(in);
+    Reader reader(interpreter.getCodeArena());
+    std::deque<TokenPtr> tokens;
+    int depth = 0;
+    while (auto token = tokenizer.next()) {
+        depth += token->getType() == TokenType::LEFT_PAREN;
+        depth -= token->getType() == TokenType::RIGHT_PAREN;
+        bool prefix = isPrefix(*token);
+        tokens.push_back(std::move(token));
+        if (depth <= 0 && !prefix) {
+            depth = 0;
+            while (!tokens.empty()) {
+                interpreter.eval(reader.read(tokens));
+            }
+        }
+    }
+    while (!tokens.empty()) {
+        interpreter.eval(reader.read(tokens));
+    }
+}
+
+// Scripts at least this large, such as batches of many thousands of
+// defines, are tokenized whole on several threads before any form runs,
+// when there are several hardware threads to run them on.
+constexpr std::size_t PARALLEL_TOKENIZE_SIZE = 4 * ParallelTokenizer::MIN_CHUNK_SIZE;
+
+// The tokens of a whole script, or nothing if it has a syntax error, so that
+// the forms before the error can still be run, form by form.
+std::optional<std::deque<TokenPtr>> tokenizeInParallel(std::string_view source) {
+    try {
+        return ParallelTokenizer::tokenizeBorrowed(source);
+    } catch (SyntaxError&) {
+        return std::nullopt;
+    }
+}
+
+int runFile(const std::string& path, const Options& options) {
+    try {
+        Interpreter interpreter;
+        configure(interpreter, options);
+        std::error_code error;
+        if (!std::filesystem::is_regular_file(path, error)) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in || std::filesystem::is_directory(path, error)) {
+                throw std::runtime_error("Cannot open " + path);
+            }
+            runStream(in, interpreter);
+            return 0;
+        }
+        MappedFile file(path);
+        Reader reader(interpreter.getCodeArena());
+        if (file.view().size() >= PARALLEL_TOKENIZE_SIZE &&
+            std::thread::hardware_concurrency() > 1) {
+            if (auto tokens = tokenizeInParallel(file.view())) {
+                while (!tokens->empty()) {
+                    interpreter.eval(reader.read(*tokens));
+                }
+                return 0;
+            }
+        }
+        TokenRange tokens(file.view());
+        while (tokens.begin() != tokens.end()) {
+            interpreter.eval(reader.read(tokens));
+        }
+        return 0;
+    } catch (std::runtime_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
+void runRepl(const Options& options) {
+    StreamTokenizer tokenizer;
+    Interpreter interpreter;
+    configure(interpreter, options);
+    Reader reader(interpreter.getCodeArena());
+    // Tokens of a datum still being typed, and its open parenthesis depth.
+    std::deque<TokenPtr> tokens;
+    int depth = 0;
     while (true) {
         try {
-            std::cout << ">>> " ;
+            std::cout << (tokenizer.isIdle() && tokens.empty() ? ">>> " : "... ");
             std::string line;
             std::getline(std::cin, line);
-            if (std::cin.eof()) {
-                std::exit(0);
+            bool eof = std::cin.eof();
+            if (!eof) {
+                line += '\n';
+            }
+            auto first = tokens.size();
+            tokenizer.feed(line, tokens);
+            if (eof) {
+                tokenizer.finish(tokens);
+            }
+            for (auto i = first; i < tokens.size(); i++) {
+                auto type = tokens[i]->getType();
+                depth += type == TokenType::LEFT_PAREN;
+                depth -= type == TokenType::RIGHT_PAREN;
+            }
+            auto prefix = !tokens.empty() && isPrefix(*tokens.back());
+            if (eof || (depth <= 0 && !prefix)) {
+                depth = 0;
+                while (!tokens.empty()) {
+                    std::cout << interpreter.eval(reader.read(tokens)).toString() << std::endl;
+                }
             }
-            auto tokens = Tokenizer::tokenize(line);
-            for (auto& token : tokens) {
-                std::cout << *token << std::endl;
+            if (eof) {
+                std::exit(0);
             }
         } catch (std::runtime_error& e) {
+            tokenizer.reset();
+            tokens.clear();
+            depth = 0;
             std::cerr << "Error: " << e.what() << std::endl;
         }
     }
 }
+
+int main(int argc, char** argv) {
+    Options options;
+    int arg = 1;
+    for (; arg < argc && std::string_view(argv[arg]).starts_with("--"); arg++) {
+        std::string_view option = argv[arg];
+        if (option == "--no-jit") {
+            options.jit = false;
+            continue;
+        }
+        if (option == "--no-optimize") {
+            options.optimizations = {false, false, false, false};
+            continue;
+        }
+        if (option.starts_with("--no-optimize=")) {
+            if (!disablePasses(option.substr(14), options.optimizations)) {
+                return 1;
+            }
+            continue;
+        }
+        if (!option.starts_with("--engine=")) {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+        auto name = option.substr(9);
+        if (name == "tree") {
+            options.engine = Interpreter::Engine::TREE;
+        } else if (name != "vm") {
+            std::cerr << "Unknown engine: " << name << std::endl;
+            return 1;
+        }
+    }
+    if (arg < argc) {
+        return runFile(argv[arg], options);
+    }
+    runRepl(options);
+}
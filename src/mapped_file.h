@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A read-only memory mapping of a whole file, advised for sequential access.
+class MappedFile {
+private:
+    const char* data{nullptr};
+    std::size_t size{0};
+#ifdef _WIN32
+    void* mapping{nullptr};
+#endif
+
+public:
+    // Throws std::runtime_error if the file cannot be opened or mapped, which
+    // includes anything but a regular file: pipes and devices report no
+    // size to map.
+    explicit MappedFile(const std::string& path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::string_view view() const {
+        return {data, size};
+    }
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef NODE_H
+#define NODE_H
+
+#include "./eval_env.h"
+#include "./value.h"
+
+class Interpreter;
+
+// A form after analysis. Its syntax has been checked and its special form
+// dispatched once, so running it only evaluates. Nodes live in the code
+// arena next to the datums they were analyzed from, and are never freed.
+class Node {
+public:
+    virtual Value run(Interpreter& interpreter, EvalEnv* env) const = 0;
+
+protected:
+    ~Node() = default;
+};
+
+#endif
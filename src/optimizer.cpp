@@ -0,0 +1,546 @@
+#include "./optimizer.h"
+
+#include <algorithm>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "./bytecode.h"
+#include "./error.h"
+#include "./forms.h"
+#include "./interpreter.h"
+
+namespace {
+
+Value first(Value list) {
+    return list.asPair()->car;
+}
+
+Value rest(Value list) {
+    return list.asPair()->cdr;
+}
+
+Value second(Value list) {
+    return first(rest(list));
+}
+
+// The length of a proper list, or nothing for any other datum.
+std::optional<std::size_t> lengthOf(Value list) {
+    std::size_t length = 0;
+    for (; list.isPair(); list = rest(list)) {
+        length++;
+    }
+    return list.isNil() ? std::optional(length) : std::nullopt;
+}
+
+// The names of a proper list of distinct symbols.
+std::optional<std::vector<SymbolId>> namesOf(Value params) {
+    std::vector<SymbolId> names;
+    for (; params.isPair(); params = rest(params)) {
+        auto param = first(params);
+        if (!param.isSymbol() ||
+            std::find(names.begin(), names.end(), param.asSymbol()) != names.end()) {
+            return std::nullopt;
+        }
+        names.push_back(param.asSymbol());
+    }
+    return params.isNil() ? std::optional(std::move(names)) : std::nullopt;
+}
+
+bool isValidParams(Value params) {
+    for (; params.isPair(); params = rest(params)) {
+        if (!first(params).isSymbol()) {
+            return false;
+        }
+    }
+    return params.isNil() || params.isSymbol();
+}
+
+// Whether expr has a define, other than inside a quote. Dropping one would
+// change which names its scope binds.
+bool containsDefine(Value expr) {
+    auto& names = keywords();
+    if (!expr.isPair() || first(expr) == Value::fromSymbol(names.quote)) {
+        return false;
+    }
+    if (first(expr) == Value::fromSymbol(names.define)) {
+        return true;
+    }
+    for (; expr.isPair(); expr = rest(expr)) {
+        if (containsDefine(first(expr))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether the atoms and pairs of expr fit in what is left of budget, which
+// they use up.
+bool fits(Value expr, std::size_t& budget) {
+    for (;; expr = rest(expr)) {
+        if (budget == 0) {
+            return false;
+        }
+        budget--;
+        if (!expr.isPair()) {
+            return true;
+        }
+        if (!fits(first(expr), budget)) {
+            return false;
+        }
+    }
+}
+
+// Conditions on the same global, made at the same time, are the same.
+void addCondition(std::vector<Value>& conditions, Value condition) {
+    for (auto other : conditions) {
+        if (first(other) == first(condition)) {
+            return;
+        }
+    }
+    conditions.push_back(condition);
+}
+
+bool isFoldable(SymbolId name) {
+    static const std::unordered_set<std::string_view> FOLDABLE{
+        "+", "-", "*",  "/",  "abs",   "expt", "modulo", "remainder", "=",
+        "<", ">", "<=", ">=", "even?", "odd?", "zero?",  "not",
+    };
+    return FOLDABLE.contains(SymbolTable::global().name(name));
+}
+
+}  // namespace
+
+Value Optimizer::cons(Value car, Value cdr) {
+    auto pair = interpreter.getCodeArena().make<Pair>(car, cdr);
+    interpreter.addCodeRoot(&pair->car);
+    interpreter.addCodeRoot(&pair->cdr);
+    return Value::fromPair(pair);
+}
+
+Value Optimizer::list(std::initializer_list<Value> items) {
+    return list(std::vector<Value>(items));
+}
+
+Value Optimizer::list(const std::vector<Value>& items) {
+    Value result;
+    for (auto item = items.rbegin(); item != items.rend(); ++item) {
+        result = cons(*item, result);
+    }
+    return result;
+}
+
+bool Optimizer::isLocal(SymbolId name) const {
+    return std::find(locals.begin(), locals.end(), name) != locals.end();
+}
+
+void Optimizer::addDefines(Value body) {
+    auto& names = keywords();
+    if (!body.isPair() || first(body) == Value::fromSymbol(names.quote) ||
+        first(body) == Value::fromSymbol(names.quasiquote)) {
+        return;
+    }
+    if (first(body) == Value::fromSymbol(names.define) && rest(body).isPair()) {
+        auto target = second(body);
+        if (target.isPair()) {
+            target = first(target);
+        }
+        if (target.isSymbol()) {
+            locals.push_back(target.asSymbol());
+        }
+    }
+    for (; body.isPair(); body = rest(body)) {
+        addDefines(first(body));
+    }
+}
+
+// Constants, quotes, and guarded constants that folding left.
+std::optional<Optimizer::Known> Optimizer::evaluate(Value expr) const {
+    auto& names = keywords();
+    if (!expr.isPair()) {
+        if (expr.isSymbol() || expr.isNil()) {
+            return std::nullopt;
+        }
+        return Known{expr, {}};
+    }
+    if (isForm(expr, names.quote)) {
+        return Known{second(expr), {}};
+    }
+    if (first(expr) != Value::fromSymbol(names.guard) || lengthOf(expr) != 4) {
+        return std::nullopt;
+    }
+    auto fast = second(rest(expr));
+    if (fast.isPair() || fast.isSymbol() || fast.isNil()) {
+        return std::nullopt;
+    }
+    Known known{fast, {}};
+    for (auto condition = second(expr); condition.isPair(); condition = rest(condition)) {
+        known.conditions.push_back(first(condition));
+    }
+    return known;
+}
+
+Value Optimizer::guard(const std::vector<Value>& conditions, Value fast, Value slow) {
+    return list({Value::fromSymbol(keywords().guard), list(conditions), fast, slow});
+}
+
+bool Optimizer::isInlinable(Value expr, SymbolId name, const std::vector<SymbolId>& params,
+                            std::size_t& budget) const {
+    auto& names = keywords();
+    if (budget == 0) {
+        return false;
+    }
+    budget--;
+    if (expr.isSymbol()) {
+        auto symbol = expr.asSymbol();
+        if (std::find(params.begin(), params.end(), symbol) != params.end()) {
+            return true;
+        }
+        return symbol != name && !isLocal(symbol);
+    }
+    if (!expr.isPair()) {
+        return true;
+    }
+    auto head = first(expr);
+    if (head == Value::fromSymbol(names.quote)) {
+        return true;
+    }
+    if (head == Value::fromSymbol(names.lambda) || head == Value::fromSymbol(names.define) ||
+        head == Value::fromSymbol(names.quasiquote)) {
+        return false;
+    }
+    for (; expr.isPair(); expr = rest(expr)) {
+        if (!isInlinable(first(expr), name, params, budget)) {
+            return false;
+        }
+    }
+    return expr.isNil() || isInlinable(expr, name, params, budget);
+}
+
+Value Optimizer::optimize(Value expr) {
+    if (!expr.isPair() || !lengthOf(expr)) {
+        return expr;
+    }
+    interpreter.checkNativeStack();
+    auto head = first(expr);
+    if (head.isSymbol() && findSpecialForm(head.asSymbol())) {
+        auto form = findForm(head.asSymbol());
+        return form ? (this->*form)(expr) : expr;
+    }
+    return optimizeCall(expr);
+}
+
+Value Optimizer::optimizeList(Value datums) {
+    std::vector<Value> items;
+    bool changed = false;
+    for (auto datum = datums; datum.isPair(); datum = rest(datum)) {
+        items.push_back(optimize(first(datum)));
+        changed = changed || items.back() != first(datum);
+    }
+    return changed ? list(items) : datums;
+}
+
+Value Optimizer::optimizeBody(Value body) {
+    addDefines(body);
+    return optimizeList(body);
+}
+
+Value Optimizer::optimizeCall(Value expr) {
+    auto call = optimizeList(expr);
+    auto op = first(call);
+    if (options.lambdaCalls) {
+        if (auto let = lambdaToLet(call)) {
+            return *let;
+        }
+    }
+    if (!op.isSymbol() || isLocal(op.asSymbol())) {
+        return call;
+    }
+    if (options.fold) {
+        if (auto folded = fold(call, expr)) {
+            return *folded;
+        }
+    }
+    if (options.inlining && inlineDepth < MAX_INLINE_DEPTH) {
+        if (auto inlined = inlineCall(call, expr)) {
+            return *inlined;
+        }
+    }
+    return call;
+}
+
+// The builtin runs now, and anything it throws leaves the call to run later
+// and report it.
+std::optional<Value> Optimizer::fold(Value call, Value original) {
+    auto name = first(call).asSymbol();
+    auto builtin = *interpreter.globalCell(name);
+    if (!isFoldable(name) || !builtin.isObject(ObjectType::BUILTIN) ||
+        static_cast<Builtin*>(builtin.asObject())->name != SymbolTable::global().name(name)) {
+        return std::nullopt;
+    }
+    std::vector<Value> args;
+    std::vector<Value> conditions;
+    for (auto operand = rest(call); operand.isPair(); operand = rest(operand)) {
+        auto known = evaluate(first(operand));
+        if (!known || !(known->value.isNumber() || known->value.isBoolean())) {
+            return std::nullopt;
+        }
+        args.push_back(known->value);
+        for (auto condition : known->conditions) {
+            addCondition(conditions, condition);
+        }
+    }
+    Value result;
+    try {
+        result = interpreter.callWithList(builtin, list(args));
+    } catch (const LispError&) {
+        return std::nullopt;
+    }
+    if (!result.isNumber() && !result.isBoolean()) {
+        return std::nullopt;
+    }
+    addCondition(conditions, cons(first(call), builtin));
+    return guard(conditions, result, original);
+}
+
+// Only procedures closed over the global environment are inlined, as their
+// bodies refer to nothing but their parameters and globals. The original call
+// is the slow form, so that guards do not nest in both forms of one another.
+std::optional<Value> Optimizer::inlineCall(Value call, Value original) {
+    auto name = first(call).asSymbol();
+    auto proc = *interpreter.globalCell(name);
+    Value params;
+    Value body;
+    if (proc.isObject(ObjectType::CLOSURE)) {
+        auto closure = static_cast<Closure*>(proc.asObject());
+        if (!closure->env.isNil()) {
+            return std::nullopt;
+        }
+        params = closure->prototype->params;
+        body = closure->prototype->body;
+    } else if (proc.isObject(ObjectType::LAMBDA)) {
+        auto lambda = static_cast<Lambda*>(proc.asObject());
+        if (!lambda->env.isNil()) {
+            return std::nullopt;
+        }
+        params = lambda->params;
+        body = lambda->source;
+    } else {
+        return std::nullopt;
+    }
+    auto names = namesOf(params);
+    if (!names || !body.isPair() || !rest(body).isNil() || lengthOf(rest(call)) != names->size()) {
+        return std::nullopt;
+    }
+    auto budget = MAX_INLINE_SIZE;
+    if (!isInlinable(first(body), name, *names, budget)) {
+        return std::nullopt;
+    }
+    budget = MAX_INLINE_SIZE;
+    if (!fits(rest(original), budget)) {
+        return std::nullopt;
+    }
+
+    std::vector<Value> bindings;
+    auto args = rest(call);
+    for (auto param : *names) {
+        bindings.push_back(list({Value::fromSymbol(param), first(args)}));
+        args = rest(args);
+    }
+    auto outer = locals.size();
+    locals.insert(locals.end(), names->begin(), names->end());
+    inlineDepth++;
+    auto inlined = optimize(first(body));
+    inlineDepth--;
+    locals.resize(outer);
+    auto let = list({Value::fromSymbol(keywords().let), list(bindings), inlined});
+    return guard({cons(first(call), proc)}, let, original);
+}
+
+std::optional<Value> Optimizer::lambdaToLet(Value call) {
+    auto lambda = first(call);
+    if (!lambda.isPair() || first(lambda) != Value::fromSymbol(keywords().lambda) ||
+        lengthOf(lambda) < 3) {
+        return std::nullopt;
+    }
+    auto names = namesOf(second(lambda));
+    if (!names || lengthOf(rest(call)) != names->size()) {
+        return std::nullopt;
+    }
+    std::vector<Value> bindings;
+    auto args = rest(call);
+    for (auto param : *names) {
+        bindings.push_back(list({Value::fromSymbol(param), first(args)}));
+        args = rest(args);
+    }
+    return cons(Value::fromSymbol(keywords().let), cons(list(bindings), rest(rest(lambda))));
+}
+
+Value Optimizer::optimizeIf(Value expr) {
+    auto args = rest(expr);
+    auto length = *lengthOf(args);
+    if (length < 2 || length > 3) {
+        return expr;
+    }
+    auto test = optimize(first(args));
+    auto consequent = optimize(second(args));
+    auto alternative = length == 3 ? optimize(second(rest(args))) : Value();
+    auto rebuilt = length == 3 ? list({first(expr), test, consequent, alternative})
+                               : list({first(expr), test, consequent});
+    auto known = options.branches ? evaluate(test) : std::nullopt;
+    if (!known) {
+        return rebuilt;
+    }
+    auto dropped = known->value.isTrue() ? alternative : consequent;
+    if (containsDefine(dropped)) {
+        return rebuilt;
+    }
+    Value chosen;
+    if (known->value.isTrue()) {
+        chosen = consequent;
+    } else {
+        chosen = length == 3 ? alternative : list({Value::fromSymbol(keywords().quote), Value()});
+    }
+    return known->conditions.empty() ? chosen : guard(known->conditions, chosen, rebuilt);
+}
+
+// Clauses after one whose test is a true constant are dropped, and that
+// clause becomes an else clause; those whose test is false are dropped too.
+Value Optimizer::optimizeCond(Value expr) {
+    auto& names = keywords();
+    auto elseKeyword = Value::fromSymbol(names.elseKeyword);
+    std::vector<Value> clauses;
+    for (auto clause = rest(expr); clause.isPair(); clause = rest(clause)) {
+        auto datum = first(clause);
+        if (!datum.isPair() || !lengthOf(datum)) {
+            return expr;
+        }
+        auto test = first(datum) == elseKeyword ? elseKeyword : optimize(first(datum));
+        clauses.push_back(cons(test, optimizeList(rest(datum))));
+    }
+    auto rebuilt = cons(first(expr), list(clauses));
+    if (!options.branches) {
+        return rebuilt;
+    }
+    std::vector<Value> kept;
+    for (std::size_t i = 0; i < clauses.size(); i++) {
+        auto test = first(clauses[i]);
+        if (test == elseKeyword) {
+            kept.insert(kept.end(), clauses.begin() + i, clauses.end());
+            break;
+        }
+        auto known = evaluate(test);
+        if (!known || !known->conditions.empty()) {
+            kept.push_back(clauses[i]);
+            continue;
+        }
+        if (!known->value.isTrue()) {
+            if (containsDefine(clauses[i])) {
+                return rebuilt;
+            }
+            continue;
+        }
+        for (auto j = i + 1; j < clauses.size(); j++) {
+            if (containsDefine(clauses[j])) {
+                return rebuilt;
+            }
+        }
+        auto body = rest(clauses[i]);
+        kept.push_back(cons(elseKeyword, body.isNil() ? list({test}) : body));
+        break;
+    }
+    if (kept.empty()) {
+        return list({Value::fromSymbol(names.quote), Value()});
+    }
+    if (first(kept[0]) == elseKeyword) {
+        return cons(Value::fromSymbol(SymbolTable::global().intern("begin")), rest(kept[0]));
+    }
+    return cons(first(expr), list(kept));
+}
+
+Value Optimizer::optimizeLambda(Value expr) {
+    auto args = rest(expr);
+    if (*lengthOf(args) < 2 || !isValidParams(first(args))) {
+        return expr;
+    }
+    auto outer = locals.size();
+    for (auto params = first(args);; params = rest(params)) {
+        if (params.isSymbol()) {
+            locals.push_back(params.asSymbol());
+        }
+        if (!params.isPair()) {
+            break;
+        }
+        locals.push_back(first(params).asSymbol());
+    }
+    auto body = optimizeBody(rest(args));
+    locals.resize(outer);
+    return body == rest(args) ? expr : cons(first(expr), cons(first(args), body));
+}
+
+Value Optimizer::optimizeDefine(Value expr) {
+    auto args = rest(expr);
+    auto length = *lengthOf(args);
+    if (length < 2) {
+        return expr;
+    }
+    auto target = first(args);
+    if (target.isPair()) {
+        if (!first(target).isSymbol()) {
+            return expr;
+        }
+        // As (lambda params body ...).
+        auto lambda = optimizeLambda(cons(first(expr), cons(rest(target), rest(args))));
+        return cons(first(expr), cons(target, rest(rest(lambda))));
+    }
+    if (!target.isSymbol() || length != 2) {
+        return expr;
+    }
+    return list({first(expr), target, optimize(second(args))});
+}
+
+Value Optimizer::optimizeLet(Value expr) {
+    auto args = rest(expr);
+    if (*lengthOf(args) < 2 || !lengthOf(first(args))) {
+        return expr;
+    }
+    std::vector<Value> bindings;
+    std::vector<SymbolId> names;
+    for (auto binding = first(args); binding.isPair(); binding = rest(binding)) {
+        auto datum = first(binding);
+        if (lengthOf(datum) != 2 || !first(datum).isSymbol()) {
+            return expr;
+        }
+        bindings.push_back(list({first(datum), optimize(second(datum))}));
+        names.push_back(first(datum).asSymbol());
+    }
+    auto outer = locals.size();
+    locals.insert(locals.end(), names.begin(), names.end());
+    auto body = optimizeBody(rest(args));
+    locals.resize(outer);
+    return cons(first(expr), cons(list(bindings), body));
+}
+
+Value Optimizer::optimizeSequence(Value expr) {
+    return cons(first(expr), optimizeList(rest(expr)));
+}
+
+Optimizer::FormOptimizer Optimizer::findForm(SymbolId name) {
+    static const std::unordered_map<SymbolId, FormOptimizer> FORMS = [] {
+        auto& symbols = SymbolTable::global();
+        return std::unordered_map<SymbolId, FormOptimizer>{
+            {symbols.intern("if"), &Optimizer::optimizeIf},
+            {symbols.intern("and"), &Optimizer::optimizeSequence},
+            {symbols.intern("or"), &Optimizer::optimizeSequence},
+            {symbols.intern("lambda"), &Optimizer::optimizeLambda},
+            {symbols.intern("define"), &Optimizer::optimizeDefine},
+            {symbols.intern("cond"), &Optimizer::optimizeCond},
+            {symbols.intern("begin"), &Optimizer::optimizeSequence},
+            {symbols.intern("let"), &Optimizer::optimizeLet},
+            {keywords().delay, &Optimizer::optimizeSequence},
+            {keywords().consStream, &Optimizer::optimizeSequence},
+        };
+    }();
+    auto it = FORMS.find(name);
+    return it == FORMS.end() ? nullptr : it->second;
+}
@@ -0,0 +1,103 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+
+#include "./value.h"
+
+class Interpreter;
+
+// Rewrites each datum before either engine evaluates it, by these passes:
+//
+//     fold      a call of an arithmetic builtin on constants becomes its value
+//     branches  an if or cond drops the branches a constant test rules out
+//     inline    a call of a small procedure defined at top level becomes a let
+//               of its body
+//     let       ((lambda (x ...) body ...) a ...) becomes a let
+//
+// Folding and inlining depend on what globals hold at the time, so each
+// result of them is guarded: (#%guard ((name . value) ...) fast slow) runs
+// the rewritten form only while every global name still holds the value it
+// was rewritten for, and the original form otherwise. A later redefinition
+// then takes effect just as it would have without the optimizer.
+//
+// Malformed forms are left as they are, for the engine to report.
+class Optimizer {
+public:
+    struct Options {
+        bool fold{true};
+        bool branches{true};
+        bool inlining{true};
+        bool lambdaCalls{true};
+    };
+
+private:
+    // How deep inlined bodies may nest in one another, and how many atoms and
+    // pairs the body of a procedure inlined may have, and so may the
+    // arguments, which are in both forms of the guard.
+    static constexpr std::uint32_t MAX_INLINE_DEPTH = 3;
+    static constexpr std::size_t MAX_INLINE_SIZE = 32;
+
+    // The value of a datum worked out in advance, which holds while each
+    // global in conditions, as (name . value), still holds its value.
+    struct Known {
+        Value value;
+        std::vector<Value> conditions;
+    };
+
+    Interpreter& interpreter;
+    Options options;
+    // The names bound around the datum being optimized, innermost last.
+    std::vector<SymbolId> locals;
+    std::uint32_t inlineDepth{0};
+
+    // Pairs in the code arena.
+    Value cons(Value car, Value cdr);
+    Value list(std::initializer_list<Value> items);
+    Value list(const std::vector<Value>& items);
+
+    bool isLocal(SymbolId name) const;
+    // Adds the names defined anywhere in body to locals, which may be more
+    // than the engines bind there, but never fewer.
+    void addDefines(Value body);
+    std::optional<Known> evaluate(Value expr) const;
+    Value guard(const std::vector<Value>& conditions, Value fast, Value slow);
+    // Whether expr can be inlined for a call of name with params in place of
+    // name's body: it is small, makes no procedure, and refers to nothing else
+    // bound at the call.
+    bool isInlinable(Value expr, SymbolId name, const std::vector<SymbolId>& params,
+                     std::size_t& budget) const;
+
+    // Each datum of a proper list.
+    Value optimizeList(Value datums);
+    // A body in the scope of its defines, with locals already holding the
+    // names bound around it.
+    Value optimizeBody(Value body);
+    Value optimizeCall(Value expr);
+    std::optional<Value> fold(Value call, Value original);
+    std::optional<Value> inlineCall(Value call, Value original);
+    std::optional<Value> lambdaToLet(Value call);
+
+    Value optimizeIf(Value expr);
+    Value optimizeCond(Value expr);
+    Value optimizeLambda(Value expr);
+    Value optimizeDefine(Value expr);
+    Value optimizeLet(Value expr);
+    Value optimizeSequence(Value expr);
+
+    using FormOptimizer = Value (Optimizer::*)(Value expr);
+    static FormOptimizer findForm(SymbolId name);
+
+public:
+    Optimizer(Interpreter& interpreter, const Options& options)
+        : interpreter{interpreter}, options{options} {}
+
+    // expr must be in the code arena, and so is the result.
+    Value optimize(Value expr);
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "./parallel_tokenizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <thread>
+
+#include "./char_class.h"
+#include "./tokenizer.h"
+
+namespace {
+
+unsigned resolveThreads(unsigned threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    return std::max(threads, 1u);
+}
+
+// Runs task(i) for every i in [0, count) on up to `threads` threads. The
+// first exception in index order is rethrown once all tasks are done.
+template <typename Task>
+void runChunks(std::size_t count, unsigned threads, Task task) {
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<std::size_t> next{0};
+    auto worker = [&] {
+        for (std::size_t i; (i = next.fetch_add(1)) < count;) {
+            try {
+                task(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for (std::size_t i = 1; i < std::min<std::size_t>(threads, count); i++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+std::vector<std::size_t> chunkStarts(std::string_view input, unsigned threads) {
+    // A few chunks per thread even out uneven form sizes.
+    auto chunkSize = std::max(ParallelTokenizer::MIN_CHUNK_SIZE, input.size() / (threads * 4));
+    return ParallelTokenizer::splitTopLevel(input, chunkSize);
+}
+
+std::size_t chunkEnd(const std::vector<std::size_t>& starts, std::size_t i, std::string_view input) {
+    return i + 1 < starts.size() ? starts[i + 1] : input.size();
+}
+
+}  // namespace
+
+std::vector<std::size_t> ParallelTokenizer::splitTopLevel(std::string_view input,
+                                                          std::size_t chunkSize) {
+    std::vector<std::size_t> starts{0};
+    const auto& kernels = scanKernels();
+    const char* begin = input.data();
+    const char* end = begin + input.size();
+    const char* p = begin;
+    int depth = 0;
+    // Mirrors Tokenizer::scan closely enough to know where tokens start.
+    while (p < end) {
+        auto c = *p;
+        if (isSpace(c)) {
+            if (depth == 0 && static_cast<std::size_t>(p - begin) - starts.back() >= chunkSize) {
+                starts.push_back(p - begin);
+            }
+            p = skipSpace(kernels, p + 1, end);
+        } else if (c == ';') {
+            p = kernels.findLineEnd(p, end);
+        } else if (c == '"') {
+            p = kernels.findStringSpecial(p + 1, end);
+            while (p < end && *p == '\\') {
+                p = kernels.findStringSpecial(std::min(p + 2, end), end);
+            }
+            p = std::min(p + 1, end);
+        } else if (c == '#') {
+            p = std::min(p + 2, end);
+        } else if (c == '(') {
+            depth++;
+            p++;
+        } else if (c == ')') {
+            depth = std::max(depth - 1, 0);
+            p++;
+        } else if (Token::typeFromChar(c)) {
+            p++;
+        } else {
+            p = findTokenEnd(kernels, p + 1, end);
+        }
+    }
+    return starts;
+}
+
+std::deque<TokenPtr> ParallelTokenizer::tokenize(std::string_view input, bool borrowed,
+                                                 unsigned threads) {
+    threads = resolveThreads(threads);
+    auto starts = threads > 1 ? chunkStarts(input, threads) : std::vector<std::size_t>{0};
+    std::vector<std::deque<TokenPtr>> chunks(starts.size());
+    runChunks(starts.size(), threads, [&](std::size_t i) {
+        // Each chunk scans a prefix of the input from its own start offset.
+        Tokenizer tokenizer(input.substr(0, chunkEnd(starts, i, input)), borrowed);
+        chunks[i] = tokenizer.tokenize(starts[i]);
+    });
+    auto tokens = std::move(chunks[0]);
+    for (std::size_t i = 1; i < chunks.size(); i++) {
+        std::move(chunks[i].begin(), chunks[i].end(), std::back_inserter(tokens));
+    }
+    return tokens;
+}
+
+std::deque<TokenPtr> ParallelTokenizer::tokenize(const std::string& input, unsigned threads) {
+    return tokenize(input, false, threads);
+}
+
+std::deque<TokenPtr> ParallelTokenizer::tokenizeBorrowed(std::string_view input,
+                                                         unsigned threads) {
+    return tokenize(input, true, threads);
+}
+
+TokenStream ParallelTokenizer::tokenizeFlat(std::string_view input, unsigned threads) {
+    threads = resolveThreads(threads);
+    auto starts = threads > 1 ? chunkStarts(input, threads) : std::vector<std::size_t>{0};
+    std::vector<TokenStream> chunks(starts.size(), TokenStream(input));
+    runChunks(starts.size(), threads, [&](std::size_t i) {
+        Tokenizer tokenizer(input.substr(0, chunkEnd(starts, i, input)), true);
+        chunks[i] = tokenizer.tokenizeFlat(starts[i]);
+    });
+    if (chunks.size() == 1) {
+        return std::move(chunks[0]);
+    }
+    TokenStream tokens(input);
+    std::size_t count = 0;
+    for (auto& chunk : chunks) {
+        count += chunk.size();
+    }
+    tokens.reserve(count);
+    for (auto& chunk : chunks) {
+        tokens.append(chunk);
+    }
+    return tokens;
+}
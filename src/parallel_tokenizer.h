@@ -0,0 +1,39 @@
+#ifndef PARALLEL_TOKENIZER_H
+#define PARALLEL_TOKENIZER_H
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./token.h"
+#include "./token_stream.h"
+
+// Tokenizes large inputs on several threads. A sequential pre-scan, which
+// tracks parenthesis depth and string/comment state, splits the input at
+// whitespace between top-level forms; the chunks are then tokenized with
+// the serial Tokenizer and joined in order, so the result (including the
+// first syntax error thrown) is the same as the serial one. Only the
+// order in which new identifiers are interned may differ.
+class ParallelTokenizer {
+private:
+    static std::deque<TokenPtr> tokenize(std::string_view input, bool borrowed,
+                                         unsigned threads);
+
+public:
+    // Inputs smaller than this are not worth splitting.
+    static constexpr std::size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    // Start offsets of chunks of roughly `chunkSize` bytes each; the first
+    // is always 0.
+    static std::vector<std::size_t> splitTopLevel(std::string_view input,
+                                                  std::size_t chunkSize);
+
+    // `threads` of 0 means one per hardware thread.
+    static std::deque<TokenPtr> tokenize(const std::string& input, unsigned threads = 0);
+    static std::deque<TokenPtr> tokenizeBorrowed(std::string_view input, unsigned threads = 0);
+    static TokenStream tokenizeFlat(std::string_view input, unsigned threads = 0);
+};
+
+#endif
@@ -0,0 +1,175 @@
+#include "./reader.h"
+
+#include "./error.h"
+
+namespace {
+
+Value atomFromToken(const Token& token, Arena& arena) {
+    switch (token.getType()) {
+        case TokenType::BOOLEAN_LITERAL:
+            return Value::fromBoolean(static_cast<const BooleanLiteralToken&>(token).getValue());
+        case TokenType::NUMERIC_LITERAL:
+            return Value::fromNumber(static_cast<const NumericLiteralToken&>(token).getValue());
+        case TokenType::INTEGER_LITERAL:
+            return Value::fromInteger(static_cast<const IntegerLiteralToken&>(token).getValue());
+        case TokenType::STRING_LITERAL: {
+            auto text = arena.copy(static_cast<const StringLiteralToken&>(token).getValue());
+            return Value::fromString(arena.make<String>(text));
+        }
+        case TokenType::IDENTIFIER:
+            return Value::fromSymbol(static_cast<const IdentifierToken&>(token).getSymbol());
+        default: throw SyntaxError("Unexpected token");
+    }
+}
+
+struct DequeSource {
+    std::deque<TokenPtr>& tokens;
+
+    bool atEnd() const {
+        return tokens.empty();
+    }
+    TokenType peek() const {
+        return tokens.front()->getType();
+    }
+    void advance() {
+        tokens.pop_front();
+    }
+    Value atom(Arena& arena) const {
+        return atomFromToken(*tokens.front(), arena);
+    }
+};
+
+struct RangeSource {
+    TokenRange::Iterator it;
+
+    bool atEnd() const {
+        return it == std::default_sentinel;
+    }
+    TokenType peek() const {
+        return (*it)->getType();
+    }
+    void advance() {
+        ++it;
+    }
+    Value atom(Arena& arena) const {
+        return atomFromToken(**it, arena);
+    }
+};
+
+struct StreamSource {
+    const TokenStream& tokens;
+    std::size_t& pos;
+
+    bool atEnd() const {
+        return pos >= tokens.size();
+    }
+    TokenType peek() const {
+        return tokens.type(pos);
+    }
+    void advance() {
+        pos++;
+    }
+    Value atom(Arena& arena) const {
+        switch (tokens.type(pos)) {
+            case TokenType::BOOLEAN_LITERAL: return Value::fromBoolean(tokens.boolean(pos));
+            case TokenType::NUMERIC_LITERAL: return Value::fromNumber(tokens.number(pos));
+            case TokenType::INTEGER_LITERAL: return Value::fromInteger(tokens.integer(pos));
+            case TokenType::STRING_LITERAL:
+                return Value::fromString(arena.make<String>(arena.copy(tokens.text(pos))));
+            case TokenType::IDENTIFIER: return Value::fromSymbol(tokens.symbol(pos));
+            default: throw SyntaxError("Unexpected token");
+        }
+    }
+};
+
+}  // namespace
+
+Reader::Reader(Arena& arena)
+    : arena{arena},
+      quoteSymbol{SymbolTable::global().intern("quote")},
+      quasiquoteSymbol{SymbolTable::global().intern("quasiquote")},
+      unquoteSymbol{SymbolTable::global().intern("unquote")} {}
+
+template <typename Source>
+Value Reader::readDatum(Source& source) {
+    frames.clear();
+    while (true) {
+        if (source.atEnd()) {
+            throw SyntaxError("Unexpected end of input");
+        }
+        auto type = source.peek();
+        auto top = frames.empty() ? nullptr : &frames.back();
+        Value value;
+        if (top && top->kind == FrameKind::NEEDS_CLOSE) {
+            if (type != TokenType::RIGHT_PAREN) {
+                throw SyntaxError("Expected ')'");
+            }
+            source.advance();
+            value = top->head;
+            frames.pop_back();
+        } else if (type == TokenType::LEFT_PAREN) {
+            source.advance();
+            frames.push_back({FrameKind::LIST, 0, Value(), nullptr});
+            continue;
+        } else if (type == TokenType::QUOTE || type == TokenType::QUASIQUOTE ||
+                   type == TokenType::UNQUOTE) {
+            auto prefix = type == TokenType::QUOTE        ? quoteSymbol
+                          : type == TokenType::QUASIQUOTE ? quasiquoteSymbol
+                                                          : unquoteSymbol;
+            source.advance();
+            frames.push_back({FrameKind::PREFIX, prefix, Value(), nullptr});
+            continue;
+        } else if (type == TokenType::RIGHT_PAREN && top && top->kind == FrameKind::LIST) {
+            source.advance();
+            value = top->head;
+            frames.pop_back();
+        } else if (type == TokenType::DOT && top && top->kind == FrameKind::LIST && top->tail) {
+            source.advance();
+            top->kind = FrameKind::AFTER_DOT;
+            continue;
+        } else {
+            value = source.atom(arena);
+            source.advance();
+        }
+
+        // Hand the finished datum to the innermost open list, wrapping it in
+        // any prefixes on the way.
+        while (!frames.empty() && frames.back().kind == FrameKind::PREFIX) {
+            auto quoted = arena.make<Pair>(value, Value());
+            value = Value::fromPair(
+                arena.make<Pair>(Value::fromSymbol(frames.back().prefix), Value::fromPair(quoted)));
+            frames.pop_back();
+        }
+        if (frames.empty()) {
+            return value;
+        }
+        auto& frame = frames.back();
+        if (frame.kind == FrameKind::AFTER_DOT) {
+            frame.tail->cdr = value;
+            frame.kind = FrameKind::NEEDS_CLOSE;
+            continue;
+        }
+        auto pair = arena.make<Pair>(value, Value());
+        if (frame.tail) {
+            frame.tail->cdr = Value::fromPair(pair);
+        } else {
+            frame.head = Value::fromPair(pair);
+        }
+        frame.tail = pair;
+    }
+}
+
+Value Reader::read(std::deque<TokenPtr>& tokens) {
+    DequeSource source{tokens};
+    return readDatum(source);
+}
+
+Value Reader::read(const TokenStream& tokens, std::size_t& pos) {
+    StreamSource source{tokens, pos};
+    return readDatum(source);
+}
+
+Value Reader::read(TokenRange& tokens) {
+    RangeSource source{tokens.begin()};
+    return readDatum(source);
+}
@@ -0,0 +1,57 @@
+#ifndef READER_H
+#define READER_H
+
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "./arena.h"
+#include "./token.h"
+#include "./token_stream.h"
+#include "./tokenizer.h"
+#include "./value.h"
+
+// Builds datums from tokens. Every pair and string is allocated from the
+// given arena, so a datum is released all at once together with it.
+//
+// Open lists and pending quote prefixes are kept on an explicit stack rather
+// than the C++ call stack, so nesting depth is limited only by memory.
+class Reader {
+private:
+    enum class FrameKind : std::uint8_t {
+        LIST,
+        // Read the dot of a dotted pair; the next datum is the final cdr.
+        AFTER_DOT,
+        // Have the final cdr; only ')' may follow.
+        NEEDS_CLOSE,
+        PREFIX,
+    };
+
+    struct Frame {
+        FrameKind kind;
+        SymbolId prefix;
+        Value head;
+        Pair* tail;
+    };
+
+    Arena& arena;
+    SymbolId quoteSymbol;
+    SymbolId quasiquoteSymbol;
+    SymbolId unquoteSymbol;
+    std::vector<Frame> frames;
+
+    template <typename Source>
+    Value readDatum(Source& source);
+
+public:
+    explicit Reader(Arena& arena);
+
+    // Reads one datum, consuming its tokens from the front of the deque.
+    Value read(std::deque<TokenPtr>& tokens);
+    // Reads one datum starting at tokens[pos], advancing pos past it.
+    Value read(const TokenStream& tokens, std::size_t& pos);
+    // Reads one datum, scanning only as far as its last token.
+    Value read(TokenRange& tokens);
+};
+
+#endif
@@ -0,0 +1,185 @@
+#include "./stream_tokenizer.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "./error.h"
+#include "./tokenizer.h"
+
+StreamTokenizer::StreamTokenizer() : kernels{scanKernels()} {}
+
+StreamTokenizer::StreamTokenizer(Source source, std::size_t bufferSize)
+    : kernels{scanKernels()}, source{std::move(source)}, buffer(bufferSize) {}
+
+StreamTokenizer::StreamTokenizer(std::istream& in, std::size_t bufferSize)
+    : StreamTokenizer(
+          [&in](char* buffer, std::size_t size) -> std::size_t {
+              in.read(buffer, size);
+              return in.gcount();
+          },
+          bufferSize) {}
+
+StreamTokenizer StreamTokenizer::fromFileDescriptor(int fd, std::size_t bufferSize) {
+    return StreamTokenizer(
+        [fd](char* buffer, std::size_t size) -> std::size_t {
+#ifdef _WIN32
+            auto count = _read(fd, buffer, static_cast<unsigned>(size));
+#else
+            auto count = read(fd, buffer, size);
+#endif
+            if (count < 0) {
+                throw std::runtime_error("Failed to read input");
+            }
+            return count;
+        },
+        bufferSize);
+}
+
+TokenPtr StreamTokenizer::makeWord(std::string_view text) {
+    Lexeme lexeme;
+    classifyWord(text, lexeme);
+    switch (lexeme.type) {
+        case TokenType::DOT: return Token::dot();
+        case TokenType::NUMERIC_LITERAL:
+            return std::make_unique<NumericLiteralToken>(lexeme.number);
+        case TokenType::INTEGER_LITERAL:
+            return std::make_unique<IntegerLiteralToken>(lexeme.integer);
+        default: return std::make_unique<IdentifierToken>(lexeme.symbol);
+    }
+}
+
+void StreamTokenizer::feed(std::string_view chunk, std::deque<TokenPtr>& tokens) {
+    const char* p = chunk.data();
+    const char* end = p + chunk.size();
+    while (p < end) {
+        switch (state) {
+            case State::NORMAL: {
+                auto c = *p;
+                if (c == ';') {
+                    state = State::COMMENT;
+                } else if (isSpace(c)) {
+                    p = skipSpace(kernels, p + 1, end);
+                    continue;
+                } else if (auto token = Token::fromChar(c)) {
+                    tokens.push_back(std::move(token));
+                } else if (c == '#') {
+                    state = State::HASH;
+                } else if (c == '"') {
+                    pending.clear();
+                    state = State::STRING;
+                } else {
+                    auto wordEnd = findTokenEnd(kernels, p + 1, end);
+                    if (wordEnd == end) {
+                        // The word may continue in the next chunk.
+                        pending.assign(p, wordEnd);
+                        state = State::WORD;
+                    } else {
+                        tokens.push_back(makeWord({p, static_cast<std::size_t>(wordEnd - p)}));
+                    }
+                    p = wordEnd;
+                    continue;
+                }
+                p++;
+                break;
+            }
+            case State::COMMENT:
+                p = kernels.findLineEnd(p, end);
+                if (p < end) {
+                    state = State::NORMAL;
+                }
+                break;
+            case State::WORD: {
+                auto wordEnd = findTokenEnd(kernels, p, end);
+                pending.append(p, wordEnd);
+                if (wordEnd < end) {
+                    tokens.push_back(makeWord(pending));
+                    state = State::NORMAL;
+                }
+                p = wordEnd;
+                break;
+            }
+            case State::STRING: {
+                auto special = kernels.findStringSpecial(p, end);
+                pending.append(p, special);
+                p = special;
+                if (p == end) {
+                    break;
+                }
+                if (*p == '"') {
+                    tokens.push_back(std::make_unique<StringLiteralToken>(std::move(pending)));
+                    pending.clear();
+                    state = State::NORMAL;
+                } else {
+                    state = State::STRING_ESCAPE;
+                }
+                p++;
+                break;
+            }
+            case State::STRING_ESCAPE:
+                if (*p == 'n') {
+                    pending += '\n';
+                } else {
+                    pending += *p;
+                }
+                state = State::STRING;
+                p++;
+                break;
+            case State::HASH:
+                if (auto token = BooleanLiteralToken::fromChar(*p)) {
+                    tokens.push_back(std::move(token));
+                    state = State::NORMAL;
+                    p++;
+                } else {
+                    state = State::NORMAL;
+                    throw SyntaxError("Unexpected character after #");
+                }
+                break;
+        }
+    }
+}
+
+void StreamTokenizer::finish(std::deque<TokenPtr>& tokens) {
+    auto last = state;
+    reset();
+    switch (last) {
+        case State::WORD: tokens.push_back(makeWord(pending)); break;
+        case State::STRING:
+        case State::STRING_ESCAPE: throw SyntaxError("Unexpected end of string literal");
+        case State::HASH: throw SyntaxError("Unexpected character after #");
+        default: break;
+    }
+}
+
+void StreamTokenizer::reset() {
+    state = State::NORMAL;
+}
+
+bool StreamTokenizer::refill() {
+    if (finished) {
+        return false;
+    }
+    auto count = source(buffer.data(), buffer.size());
+    if (count == 0) {
+        finished = true;
+        finish(ready);
+    } else {
+        feed({buffer.data(), count}, ready);
+    }
+    return true;
+}
+
+TokenPtr StreamTokenizer::next() {
+    while (ready.empty()) {
+        if (!refill()) {
+            return nullptr;
+        }
+    }
+    auto token = std::move(ready.front());
+    ready.pop_front();
+    return token;
+}
@@ -0,0 +1,74 @@
+#ifndef STREAM_TOKENIZER_H
+#define STREAM_TOKENIZER_H
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./char_class.h"
+#include "./token.h"
+
+// Tokenizes input that arrives in chunks. Scanning state, including a
+// partially read identifier, string literal, escape or comment, is kept
+// across chunk boundaries, so tokens may span chunks and lines. Memory use
+// is bounded by the chunk size plus the longest token.
+class StreamTokenizer {
+public:
+    // Fills the buffer with up to `size` bytes; returns 0 at end of input.
+    using Source = std::function<std::size_t(char* buffer, std::size_t size)>;
+
+    static constexpr std::size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+private:
+    enum class State {
+        NORMAL,
+        COMMENT,
+        WORD,
+        STRING,
+        STRING_ESCAPE,
+        HASH,
+    };
+
+    State state{State::NORMAL};
+    std::string pending;
+    const ScanKernels& kernels;
+
+    Source source;
+    std::vector<char> buffer;
+    std::deque<TokenPtr> ready;
+    bool finished{false};
+
+    static TokenPtr makeWord(std::string_view text);
+    bool refill();
+
+public:
+    // Push mode: the caller feeds chunks.
+    StreamTokenizer();
+    // Pull mode: next() reads fixed-size chunks from the source as needed.
+    explicit StreamTokenizer(Source source, std::size_t bufferSize = DEFAULT_BUFFER_SIZE);
+    // Reads with std::istream::read, which waits for a full buffer; use push
+    // mode for interactive input.
+    explicit StreamTokenizer(std::istream& in, std::size_t bufferSize = DEFAULT_BUFFER_SIZE);
+    static StreamTokenizer fromFileDescriptor(int fd,
+                                              std::size_t bufferSize = DEFAULT_BUFFER_SIZE);
+
+    // Appends the tokens completed by `chunk` to `tokens`.
+    void feed(std::string_view chunk, std::deque<TokenPtr>& tokens);
+    // Flushes a trailing word; throws if a string literal is left open.
+    void finish(std::deque<TokenPtr>& tokens);
+    // Drops any partial token, e.g. after a syntax error.
+    void reset();
+    // True when no token is partially read, so a new chunk starts afresh.
+    bool isIdle() const {
+        return state == State::NORMAL || state == State::COMMENT;
+    }
+
+    // Returns nullptr once the source is exhausted.
+    TokenPtr next();
+};
+
+#endif
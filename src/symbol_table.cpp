@@ -0,0 +1,133 @@
+#include "./symbol_table.h"
+
+#include <cstring>
+#include <stdexcept>
+
+SymbolTable::Index::Index(std::size_t capacity)
+    : mask{capacity - 1}, slots{new std::atomic<std::uint64_t>[capacity]} {
+    for (std::size_t i = 0; i < capacity; i++) {
+        slots[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+SymbolTable::SymbolTable(bool threadSafe)
+    : threadSafe{threadSafe}, pages{new std::atomic<std::string_view*>[MAX_PAGES]} {
+    for (std::size_t i = 0; i < MAX_PAGES; i++) {
+        pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+    indexes.push_back(std::make_unique<Index>(1024));
+    index.store(indexes.back().get(), std::memory_order_release);
+}
+
+std::uint32_t SymbolTable::hash(std::string_view name) {
+    // FNV-1a
+    std::uint32_t h = 2166136261u;
+    for (unsigned char c : name) {
+        h = (h ^ c) * 16777619u;
+    }
+    return h;
+}
+
+std::optional<SymbolId> SymbolTable::find(std::string_view name, std::uint32_t hash) const {
+    auto current = index.load(std::memory_order_acquire);
+    for (auto i = hash & current->mask;; i = (i + 1) & current->mask) {
+        auto slot = current->slots[i].load(std::memory_order_acquire);
+        if (slot == 0) {
+            return std::nullopt;
+        }
+        if (static_cast<std::uint32_t>(slot >> 32) == hash) {
+            SymbolId id = static_cast<std::uint32_t>(slot) - 1;
+            if (this->name(id) == name) {
+                return id;
+            }
+        }
+    }
+}
+
+std::optional<SymbolId> SymbolTable::find(std::string_view name) const {
+    return find(name, hash(name));
+}
+
+std::string_view SymbolTable::store(std::string_view name) {
+    if (name.empty()) {
+        return {};
+    }
+    char* data;
+    if (name.size() > BLOCK_SIZE / 4) {
+        blocks.push_back(std::make_unique<char[]>(name.size()));
+        data = blocks.back().get();
+    } else {
+        if (BLOCK_SIZE - blockUsed < name.size()) {
+            blocks.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+            block = blocks.back().get();
+            blockUsed = 0;
+        }
+        data = block + blockUsed;
+        blockUsed += name.size();
+    }
+    std::memcpy(data, name.data(), name.size());
+    return {data, name.size()};
+}
+
+SymbolId SymbolTable::insert(std::string_view name, std::uint32_t hash) {
+    SymbolId id = count.load(std::memory_order_relaxed);
+    if (id >= MAX_PAGES * PAGE_SIZE) {
+        throw std::length_error("Too many symbols");
+    }
+    auto& page = pages[id >> PAGE_BITS];
+    if (!page.load(std::memory_order_relaxed)) {
+        ownedPages.push_back(std::make_unique<std::string_view[]>(PAGE_SIZE));
+        page.store(ownedPages.back().get(), std::memory_order_release);
+    }
+    page.load(std::memory_order_relaxed)[id & (PAGE_SIZE - 1)] = store(name);
+    count.store(id + 1, std::memory_order_release);
+
+    auto current = index.load(std::memory_order_relaxed);
+    auto i = hash & current->mask;
+    while (current->slots[i].load(std::memory_order_relaxed) != 0) {
+        i = (i + 1) & current->mask;
+    }
+    current->slots[i].store(std::uint64_t{hash} << 32 | (id + 1), std::memory_order_release);
+    if ((id + 1) * 2 > current->mask) {
+        grow();
+    }
+    return id;
+}
+
+void SymbolTable::grow() {
+    auto current = index.load(std::memory_order_relaxed);
+    auto next = std::make_unique<Index>((current->mask + 1) * 2);
+    for (std::size_t i = 0; i <= current->mask; i++) {
+        auto slot = current->slots[i].load(std::memory_order_relaxed);
+        if (slot != 0) {
+            auto j = (slot >> 32) & next->mask;
+            while (next->slots[j].load(std::memory_order_relaxed) != 0) {
+                j = (j + 1) & next->mask;
+            }
+            next->slots[j].store(slot, std::memory_order_relaxed);
+        }
+    }
+    index.store(next.get(), std::memory_order_release);
+    indexes.push_back(std::move(next));
+}
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    auto h = hash(name);
+    if (auto id = find(name, h)) {
+        return *id;
+    }
+    if (!threadSafe) {
+        return insert(name, h);
+    }
+    std::lock_guard lock(mutex);
+    // Another thread may have inserted it meanwhile.
+    if (auto id = find(name, h)) {
+        return *id;
+    }
+    return insert(name, h);
+}
+
+SymbolTable& SymbolTable::global() {
+    static SymbolTable table(true);
+    return table;
+}
@@ -0,0 +1,74 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+using SymbolId = std::uint32_t;
+
+// Append-only table mapping each distinct name to a dense 32-bit id. Names
+// are copied once and stay valid, at the same address, for the lifetime of
+// the table.
+//
+// When thread-safe, lookups of existing names and name() never lock; only
+// inserting a new name takes a mutex.
+class SymbolTable {
+private:
+    static constexpr int PAGE_BITS = 12;
+    static constexpr std::size_t PAGE_SIZE = std::size_t{1} << PAGE_BITS;
+    static constexpr std::size_t MAX_PAGES = 4096;
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+    // Open-addressed hash index. Each slot holds (hash << 32 | id + 1), or 0
+    // when empty, and is written exactly once.
+    struct Index {
+        std::size_t mask;
+        std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+        explicit Index(std::size_t capacity);
+    };
+
+    bool threadSafe;
+    std::mutex mutex;
+    std::atomic<Index*> index;
+    // Replaced indexes are kept alive for concurrent readers still probing them.
+    std::vector<std::unique_ptr<Index>> indexes;
+    std::unique_ptr<std::atomic<std::string_view*>[]> pages;
+    std::vector<std::unique_ptr<std::string_view[]>> ownedPages;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* block{nullptr};
+    std::size_t blockUsed{BLOCK_SIZE};
+    std::atomic<std::uint32_t> count{0};
+
+    static std::uint32_t hash(std::string_view name);
+    std::optional<SymbolId> find(std::string_view name, std::uint32_t hash) const;
+    SymbolId insert(std::string_view name, std::uint32_t hash);
+    std::string_view store(std::string_view name);
+    void grow();
+
+public:
+    explicit SymbolTable(bool threadSafe = false);
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    SymbolId intern(std::string_view name);
+    std::optional<SymbolId> find(std::string_view name) const;
+
+    std::string_view name(SymbolId id) const {
+        auto page = pages[id >> PAGE_BITS].load(std::memory_order_acquire);
+        return page[id & (PAGE_SIZE - 1)];
+    }
+    std::size_t size() const {
+        return count.load(std::memory_order_acquire);
+    }
+
+    // The thread-safe table shared by the tokenizers and the interpreter.
+    static SymbolTable& global();
+};
+
+#endif
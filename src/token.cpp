@@ -5,18 +5,23 @@
 
 using namespace std::literals;
 
-TokenPtr Token::fromChar(char c) {
-    TokenType type;
+std::optional<TokenType> Token::typeFromChar(char c) {
     switch (c) {
-        case '(': type = TokenType::LEFT_PAREN; break;
-        case ')': type = TokenType::RIGHT_PAREN; break;
-        case '\'': type = TokenType::QUOTE; break;
-        case '`': type = TokenType::QUASIQUOTE; break;
-        case ',': type = TokenType::UNQUOTE; break;
+        case '(': return TokenType::LEFT_PAREN;
+        case ')': return TokenType::RIGHT_PAREN;
+        case '\'': return TokenType::QUOTE;
+        case '`': return TokenType::QUASIQUOTE;
+        case ',': return TokenType::UNQUOTE;
         // DOT not listed here, because it can be part of identifier/literal.
-        default: return nullptr;
+        default: return std::nullopt;
+    }
+}
+
+TokenPtr Token::fromChar(char c) {
+    if (auto type = typeFromChar(c)) {
+        return TokenPtr(new Token(*type));
     }
-    return TokenPtr(new Token(type));
+    return nullptr;
 }
 
 TokenPtr Token::dot() {
@@ -53,14 +58,31 @@ std::string NumericLiteralToken::toString() const {
     return "(NUMERIC_LITERAL " + std::to_string(value) + ")";
 }
 
+std::string IntegerLiteralToken::toString() const {
+    return "(INTEGER_LITERAL " + std::to_string(value) + ")";
+}
+
+std::unique_ptr<StringLiteralToken> StringLiteralToken::borrow(std::string_view value) {
+    auto token = std::make_unique<StringLiteralToken>(std::string{});
+    token->value = value;
+    return token;
+}
+
 std::string StringLiteralToken::toString() const {
     std::ostringstream ss;
     ss << "(STRING_LITERAL " << std::quoted(value) << ")";
     return ss.str();
 }
 
+IdentifierToken::IdentifierToken(std::string_view name)
+    : IdentifierToken(SymbolTable::global().intern(name)) {}
+
+std::string_view IdentifierToken::getName() const {
+    return SymbolTable::global().name(symbol);
+}
+
 std::string IdentifierToken::toString() const {
-    return "(IDENTIFIER " + name + ")";
+    return "(IDENTIFIER "s.append(getName()) + ")";
 }
 
 std::ostream& operator<<(std::ostream& os, const Token& token) {
@@ -1,12 +1,16 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 
-enum class TokenType {
+#include "./symbol_table.h"
+
+enum class TokenType : std::uint8_t {
     LEFT_PAREN,
     RIGHT_PAREN,
     QUOTE,
@@ -15,10 +19,26 @@ enum class TokenType {
     DOT,
     BOOLEAN_LITERAL,
     NUMERIC_LITERAL,
+    INTEGER_LITERAL,
     STRING_LITERAL,
     IDENTIFIER,
 };
 
+// A scanned token: its span in the source plus its decoded payload. For
+// string literals the span covers the contents between the quotes.
+struct Lexeme {
+    TokenType type;
+    std::size_t offset;
+    std::size_t length;
+    double number;
+    std::int64_t integer;
+    SymbolId symbol;
+    bool boolean;
+    // Set when the string literal had escapes; its decoded text then lives in
+    // the tokenizer's scratch buffer rather than the source.
+    bool escaped;
+};
+
 class Token;
 using TokenPtr = std::unique_ptr<Token>;
 
@@ -32,6 +52,7 @@ protected:
 public:
     virtual ~Token() = default;
 
+    static std::optional<TokenType> typeFromChar(char c);
     static TokenPtr fromChar(char c);
     static TokenPtr dot();
 
@@ -69,29 +90,58 @@ public:
     std::string toString() const override;
 };
 
+// A numeric literal written without fraction or exponent that fits in 64
+// bits, kept exact instead of converted to double.
+class IntegerLiteralToken : public Token {
+private:
+    std::int64_t value;
+
+public:
+    IntegerLiteralToken(std::int64_t value) : Token(TokenType::INTEGER_LITERAL), value{value} {}
+
+    std::int64_t getValue() const {
+        return value;
+    }
+    std::string toString() const override;
+};
+
+// Text-carrying tokens either own their text, or borrow a slice of the
+// tokenizer's source buffer, which must then outlive them.
 class StringLiteralToken : public Token {
 private:
-    std::string value;
+    std::string storage;
+    std::string_view value;
 
 public:
-    StringLiteralToken(const std::string& value) : Token(TokenType::STRING_LITERAL), value{value} {}
+    StringLiteralToken(std::string value)
+        : Token(TokenType::STRING_LITERAL), storage{std::move(value)}, value{storage} {}
+    StringLiteralToken(const StringLiteralToken&) = delete;
+    StringLiteralToken& operator=(const StringLiteralToken&) = delete;
+
+    static std::unique_ptr<StringLiteralToken> borrow(std::string_view value);
 
-    const std::string& getValue() const {
+    std::string_view getValue() const {
         return value;
     }
+    bool isBorrowed() const {
+        return value.data() != storage.data();
+    }
     std::string toString() const override;
 };
 
+// Identifiers are interned in the global symbol table, which owns the name.
 class IdentifierToken : public Token {
 private:
-    std::string name;
+    SymbolId symbol;
 
 public:
-    IdentifierToken(const std::string& name) : Token(TokenType::IDENTIFIER), name{name} {}
+    IdentifierToken(SymbolId symbol) : Token(TokenType::IDENTIFIER), symbol{symbol} {}
+    IdentifierToken(std::string_view name);
 
-    const std::string& getName() const {
-        return name;
+    SymbolId getSymbol() const {
+        return symbol;
     }
+    std::string_view getName() const;
     std::string toString() const override;
 };
 
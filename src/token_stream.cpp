@@ -0,0 +1,90 @@
+#include "./token_stream.h"
+
+#include <stdexcept>
+
+TokenStream::TokenStream(std::string_view source) : source{source} {
+    if (source.size() > UINT32_MAX) {
+        throw std::length_error("Input too large for a flat token stream");
+    }
+}
+
+void TokenStream::push(const Lexeme& lexeme, std::string_view unescapedText) {
+    Payload payload{};
+    switch (lexeme.type) {
+        case TokenType::NUMERIC_LITERAL: payload.number = lexeme.number; break;
+        case TokenType::INTEGER_LITERAL: payload.integer = lexeme.integer; break;
+        case TokenType::IDENTIFIER: payload.symbol = lexeme.symbol; break;
+        case TokenType::BOOLEAN_LITERAL: payload.boolean = lexeme.boolean; break;
+        case TokenType::STRING_LITERAL:
+            if (lexeme.escaped) {
+                payload.unescaped = {static_cast<std::uint32_t>(unescaped.size()),
+                                     static_cast<std::uint32_t>(unescapedText.size())};
+                unescaped += unescapedText;
+            } else {
+                payload.unescaped = {NOT_ESCAPED, 0};
+            }
+            break;
+        default: break;
+    }
+    types.push_back(lexeme.type);
+    offsets.push_back(static_cast<std::uint32_t>(lexeme.offset));
+    lengths.push_back(static_cast<std::uint32_t>(lexeme.length));
+    payloads.push_back(payload);
+}
+
+void TokenStream::append(const TokenStream& other) {
+    auto first = payloads.size();
+    auto shift = static_cast<std::uint32_t>(unescaped.size());
+    types.insert(types.end(), other.types.begin(), other.types.end());
+    offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+    lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+    payloads.insert(payloads.end(), other.payloads.begin(), other.payloads.end());
+    unescaped += other.unescaped;
+    for (auto i = first; i < payloads.size(); i++) {
+        if (types[i] == TokenType::STRING_LITERAL && payloads[i].unescaped.offset != NOT_ESCAPED) {
+            payloads[i].unescaped.offset += shift;
+        }
+    }
+}
+
+void TokenStream::reserve(std::size_t count) {
+    types.reserve(count);
+    offsets.reserve(count);
+    lengths.reserve(count);
+    payloads.reserve(count);
+}
+
+std::string_view TokenStream::text(std::size_t i) const {
+    if (types[i] == TokenType::STRING_LITERAL && payloads[i].unescaped.offset != NOT_ESCAPED) {
+        auto span = payloads[i].unescaped;
+        return std::string_view(unescaped).substr(span.offset, span.length);
+    }
+    return source.substr(offsets[i], lengths[i]);
+}
+
+TokenPtr TokenStream::toToken(std::size_t i) const {
+    switch (types[i]) {
+        case TokenType::BOOLEAN_LITERAL:
+            return std::make_unique<BooleanLiteralToken>(boolean(i));
+        case TokenType::NUMERIC_LITERAL:
+            return std::make_unique<NumericLiteralToken>(number(i));
+        case TokenType::INTEGER_LITERAL:
+            return std::make_unique<IntegerLiteralToken>(integer(i));
+        case TokenType::STRING_LITERAL:
+            return std::make_unique<StringLiteralToken>(std::string(text(i)));
+        case TokenType::IDENTIFIER:
+            return std::make_unique<IdentifierToken>(symbol(i));
+        case TokenType::DOT: return Token::dot();
+        default: return Token::fromChar(source[offsets[i]]);
+    }
+}
+
+std::string TokenStream::toString(std::size_t i) const {
+    return toToken(i)->toString();
+}
+
+std::size_t TokenStream::memoryUsage() const {
+    return types.capacity() * sizeof(TokenType) + offsets.capacity() * sizeof(std::uint32_t) +
+           lengths.capacity() * sizeof(std::uint32_t) + payloads.capacity() * sizeof(Payload) +
+           unescaped.capacity();
+}
@@ -0,0 +1,88 @@
+#ifndef TOKEN_STREAM_H
+#define TOKEN_STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./token.h"
+
+// Tokens packed as parallel arrays over a borrowed source buffer. Nothing is
+// allocated per token; only string literals with escapes copy their decoded
+// text, into one shared buffer.
+class TokenStream {
+private:
+    struct TextSpan {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+    union Payload {
+        double number;
+        std::int64_t integer;
+        SymbolId symbol;
+        bool boolean;
+        TextSpan unescaped;
+    };
+
+    std::string_view source;
+    std::vector<TokenType> types;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> lengths;
+    std::vector<Payload> payloads;
+    std::string unescaped;
+
+    static constexpr std::uint32_t NOT_ESCAPED = UINT32_MAX;
+
+public:
+    // Offsets are kept in 32 bits, so source must be under 4 GiB.
+    TokenStream(std::string_view source);
+
+    void push(const Lexeme& lexeme, std::string_view unescapedText);
+    // Appends tokens scanned from this stream's source buffer, or a prefix of
+    // it; offsets are kept as they are.
+    void append(const TokenStream& other);
+    void reserve(std::size_t count);
+
+    std::size_t size() const {
+        return types.size();
+    }
+    bool empty() const {
+        return types.empty();
+    }
+    std::string_view getSource() const {
+        return source;
+    }
+
+    TokenType type(std::size_t i) const {
+        return types[i];
+    }
+    std::uint32_t offset(std::size_t i) const {
+        return offsets[i];
+    }
+    std::uint32_t length(std::size_t i) const {
+        return lengths[i];
+    }
+    double number(std::size_t i) const {
+        return payloads[i].number;
+    }
+    std::int64_t integer(std::size_t i) const {
+        return payloads[i].integer;
+    }
+    SymbolId symbol(std::size_t i) const {
+        return payloads[i].symbol;
+    }
+    bool boolean(std::size_t i) const {
+        return payloads[i].boolean;
+    }
+    // Name of an identifier, or decoded contents of a string literal.
+    std::string_view text(std::size_t i) const;
+
+    TokenPtr toToken(std::size_t i) const;
+    std::string toString(std::size_t i) const;
+
+    std::size_t memoryUsage() const;
+};
+
+#endif
@@ -1,81 +1,188 @@
 #include "./tokenizer.h"
 
-#include <cctype>
-#include <set>
+#include <charconv>
+#include <cstdlib>
+#include <ranges>
 #include <stdexcept>
 
+#include "./char_class.h"
 #include "./error.h"
 
-const std::set<char> TOKEN_END{'(', ')', '\'', '`', ',', '"'};
+namespace {
 
-TokenPtr Tokenizer::nextToken(int& pos) {
+std::size_t skipDigits(std::string_view text, std::size_t i) {
+    while (i < text.size() && isDigit(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+// Accepts exactly [+-]? (D+ | D+ '.' D* | '.' D+) ([eE] [+-]? D+)?, where D is
+// an ASCII digit; anything else (including inf, nan and hex) is not a number.
+// Never throws.
+bool parseNumber(std::string_view text, Lexeme& lexeme) {
+    std::size_t i = text[0] == '+' || text[0] == '-' ? 1 : 0;
+    auto intEnd = skipDigits(text, i);
+    bool hasDigits = intEnd > i;
+    bool exact = true;
+    i = intEnd;
+    if (i < text.size() && text[i] == '.') {
+        auto fracEnd = skipDigits(text, i + 1);
+        hasDigits |= fracEnd > i + 1;
+        exact = false;
+        i = fracEnd;
+    }
+    if (!hasDigits) {
+        return false;
+    }
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        auto expStart = i + 1 < text.size() && (text[i + 1] == '+' || text[i + 1] == '-') ? i + 2
+                                                                                         : i + 1;
+        i = skipDigits(text, expStart);
+        if (i == expStart) {
+            return false;
+        }
+        exact = false;
+    }
+    if (i != text.size()) {
+        return false;
+    }
+    // from_chars rejects a leading '+'.
+    auto first = text.data() + (text[0] == '+' ? 1 : 0);
+    auto last = text.data() + text.size();
+    if (exact) {
+        auto [end, error] = std::from_chars(first, last, lexeme.integer);
+        if (error == std::errc{}) {
+            lexeme.type = TokenType::INTEGER_LITERAL;
+            return true;
+        }
+    }
+    auto [end, error] = std::from_chars(first, last, lexeme.number);
+    if (error == std::errc::result_out_of_range) {
+        // Rare: let strtod saturate to +-inf or round to zero.
+        lexeme.number = std::strtod(std::string(text).c_str(), nullptr);
+    }
+    lexeme.type = TokenType::NUMERIC_LITERAL;
+    return true;
+}
+
+}  // namespace
+
+void classifyWord(std::string_view text, Lexeme& lexeme) {
+    if (text == ".") {
+        lexeme.type = TokenType::DOT;
+    } else if (parseNumber(text, lexeme)) {
+        return;
+    } else {
+        lexeme.type = TokenType::IDENTIFIER;
+        lexeme.symbol = SymbolTable::global().intern(text);
+    }
+}
+
+bool Tokenizer::scan(std::size_t& pos, Lexeme& lexeme) {
+    const char* begin = input.data();
+    const char* end = begin + input.size();
     while (pos < input.size()) {
         auto c = input[pos];
+        lexeme.offset = pos;
+        lexeme.length = 1;
+        lexeme.escaped = false;
         if (c == ';') {
-            while (pos < input.size() && input[pos] != '\n') {
-                pos++;
-            }
-        } else if (std::isspace(c)) {
+            pos = kernels.findLineEnd(begin + pos, end) - begin;
+        } else if (isSpace(c)) {
+            pos = skipSpace(kernels, begin + pos + 1, end) - begin;
+        } else if (auto type = Token::typeFromChar(c)) {
             pos++;
-        } else if (auto token = Token::fromChar(c)) {
-            pos++;
-            return token;
+            lexeme.type = *type;
+            return true;
         } else if (c == '#') {
-            if (auto result = BooleanLiteralToken::fromChar(input[pos + 1])) {
+            auto next = pos + 1 < input.size() ? input[pos + 1] : '\0';
+            if (next == 't' || next == 'f') {
                 pos += 2;
-                return result;
+                lexeme.type = TokenType::BOOLEAN_LITERAL;
+                lexeme.length = 2;
+                lexeme.boolean = next == 't';
+                return true;
             } else {
                 throw SyntaxError("Unexpected character after #");
             }
         } else if (c == '"') {
-            std::string string;
-            pos++;
+            auto start = ++pos;
+            pos = kernels.findStringSpecial(begin + pos, end) - begin;
+            lexeme.type = TokenType::STRING_LITERAL;
+            lexeme.offset = start;
+            if (pos < input.size() && input[pos] == '"') {
+                lexeme.length = pos++ - start;
+                return true;
+            }
+            // Escapes must be rewritten, so only these literals allocate.
+            lexeme.escaped = true;
+            unescaped.clear();
+            auto chunk = start;
             while (pos < input.size()) {
+                unescaped.append(input.substr(chunk, pos - chunk));
                 if (input[pos] == '"') {
-                    pos++;
-                    return std::make_unique<StringLiteralToken>(string);
-                } else if (input[pos] == '\\') {
-                    if (pos + 1 >= input.size()) {
-                        throw SyntaxError("Unexpected end of string literal");
-                    }
-                    auto next = input[pos + 1];
-                    if (next == 'n') {
-                        string += '\n';
-                    } else {
-                        string += next;
-                    }
-                    pos += 2;
+                    lexeme.length = pos++ - start;
+                    return true;
+                }
+                if (pos + 1 >= input.size()) {
+                    throw SyntaxError("Unexpected end of string literal");
+                }
+                auto next = input[pos + 1];
+                if (next == 'n') {
+                    unescaped += '\n';
                 } else {
-                    string += input[pos];
-                    pos++;
+                    unescaped += next;
                 }
+                pos += 2;
+                chunk = pos;
+                pos = kernels.findStringSpecial(begin + pos, end) - begin;
             }
             throw SyntaxError("Unexpected end of string literal");
         } else {
-            int start = pos;
-            do {
-                pos++;
-            } while (pos < input.size() && !std::isspace(input[pos]) &&
-                     TOKEN_END.find(input[pos]) == TOKEN_END.end());
-            auto text = input.substr(start, pos - start);
-            if (text == ".") {
-                return Token::dot();
-            }
-            if (std::isdigit(text[0]) || text[0] == '+' || text[0] == '-' || text[0] == '.') {
-                try {
-                    return std::make_unique<NumericLiteralToken>(std::stod(text));
-                } catch (std::invalid_argument& e) {
-                }
-            }
-            return std::make_unique<IdentifierToken>(text);
+            auto start = pos;
+            pos = findTokenEnd(kernels, begin + pos + 1, end) - begin;
+            lexeme.length = pos - start;
+            classifyWord(input.substr(start, pos - start), lexeme);
+            return true;
         }
     }
-    return nullptr;
+    return false;
+}
+
+TokenPtr Tokenizer::makeToken(const Lexeme& lexeme) const {
+    auto text = input.substr(lexeme.offset, lexeme.length);
+    switch (lexeme.type) {
+        case TokenType::BOOLEAN_LITERAL:
+            return std::make_unique<BooleanLiteralToken>(lexeme.boolean);
+        case TokenType::NUMERIC_LITERAL:
+            return std::make_unique<NumericLiteralToken>(lexeme.number);
+        case TokenType::INTEGER_LITERAL:
+            return std::make_unique<IntegerLiteralToken>(lexeme.integer);
+        case TokenType::STRING_LITERAL:
+            if (lexeme.escaped) {
+                return std::make_unique<StringLiteralToken>(unescaped);
+            } else if (borrowed) {
+                return StringLiteralToken::borrow(text);
+            }
+            return std::make_unique<StringLiteralToken>(std::string(text));
+        case TokenType::IDENTIFIER:
+            return std::make_unique<IdentifierToken>(lexeme.symbol);
+        case TokenType::DOT: return Token::dot();
+        default: return Token::fromChar(input[lexeme.offset]);
+    }
+}
+
+TokenPtr Tokenizer::nextToken(std::size_t& pos) {
+    Lexeme lexeme;
+    if (!scan(pos, lexeme)) {
+        return nullptr;
+    }
+    return makeToken(lexeme);
 }
 
-std::deque<TokenPtr> Tokenizer::tokenize() {
+std::deque<TokenPtr> Tokenizer::tokenize(std::size_t pos) {
     std::deque<TokenPtr> tokens;
-    int pos = 0;
     while (true) {
         auto token = nextToken(pos);
         if (!token) {
@@ -86,6 +193,34 @@ std::deque<TokenPtr> Tokenizer::tokenize() {
     return tokens;
 }
 
+TokenStream Tokenizer::tokenizeFlat(std::size_t pos) {
+    TokenStream tokens(input);
+    Lexeme lexeme;
+    while (scan(pos, lexeme)) {
+        tokens.push(lexeme, unescaped);
+    }
+    return tokens;
+}
+
 std::deque<TokenPtr> Tokenizer::tokenize(const std::string& input) {
-    return Tokenizer(input).tokenize();
+    return Tokenizer(input, false).tokenize(0);
+}
+
+std::deque<TokenPtr> Tokenizer::tokenizeBorrowed(std::string_view input) {
+    return Tokenizer(input, true).tokenize(0);
+}
+
+TokenStream Tokenizer::tokenizeFlat(std::string_view input) {
+    return Tokenizer(input, true).tokenizeFlat(0);
+}
+
+static_assert(std::ranges::input_range<TokenRange>);
+
+TokenPtr& TokenRange::fill() {
+    if (pending) {
+        pending = false;
+        current = tokenizer.nextToken(pos);
+        done = !current;
+    }
+    return current;
 }
@@ -1,21 +1,104 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 
+#include <cstddef>
 #include <deque>
+#include <iterator>
 #include <string>
+#include <string_view>
 
+#include "./char_class.h"
 #include "./token.h"
+#include "./token_stream.h"
+
+// Sets the type of a non-empty run of non-delimiter characters: DOT, a
+// numeric literal (with its value) or an identifier, which is interned.
+void classifyWord(std::string_view text, Lexeme& lexeme);
 
 class Tokenizer {
 private:
-    TokenPtr nextToken(int& pos);
-    std::deque<TokenPtr> tokenize();
+    bool scan(std::size_t& pos, Lexeme& lexeme);
+    TokenPtr makeToken(const Lexeme& lexeme) const;
+    TokenPtr nextToken(std::size_t& pos);
+    std::deque<TokenPtr> tokenize(std::size_t pos);
+    TokenStream tokenizeFlat(std::size_t pos);
+
+    std::string_view input;
+    bool borrowed;
+    std::string unescaped;
+    const ScanKernels& kernels;
+    Tokenizer(std::string_view input, bool borrowed)
+        : input{input}, borrowed{borrowed}, kernels{scanKernels()} {}
 
-    std::string input;
-    Tokenizer(const std::string& input) : input{input} {}
+    friend class ParallelTokenizer;
+    friend class TokenRange;
 
 public:
     static std::deque<TokenPtr> tokenize(const std::string& input);
+    // Escape-free string literals are returned as slices of `input` instead
+    // of copies, so `input` must outlive the tokens.
+    static std::deque<TokenPtr> tokenizeBorrowed(std::string_view input);
+    // Packs all tokens into one flat stream; `input` must outlive it.
+    static TokenStream tokenizeFlat(std::string_view input);
+};
+
+// Tokens scanned on demand, one at a time, as the range is iterated. Only the
+// current token is held; string literals borrow from `input`, which must
+// outlive the range and its tokens.
+//
+// Iterators share the range's position, so it can be consumed piecemeal:
+// begin() resumes where the previous iteration stopped. Scanning is deferred
+// until a token is looked at, so stepping past the last token of a form does
+// not touch the input after it, and a scan error is thrown from the
+// dereference or end comparison that reaches it.
+class TokenRange {
+private:
+    Tokenizer tokenizer;
+    std::size_t pos{0};
+    TokenPtr current;
+    bool pending{true};
+    bool done{false};
+
+    TokenPtr& fill();
+
+public:
+    class Iterator {
+    private:
+        TokenRange* range{nullptr};
+
+    public:
+        using value_type = TokenPtr;
+        using difference_type = std::ptrdiff_t;
+
+        Iterator() = default;
+        explicit Iterator(TokenRange* range) : range{range} {}
+
+        // The token may be moved out; the range does not look at it again.
+        TokenPtr& operator*() const {
+            return range->fill();
+        }
+        Iterator& operator++() {
+            range->fill();
+            range->pending = true;
+            return *this;
+        }
+        void operator++(int) {
+            ++*this;
+        }
+        bool operator==(std::default_sentinel_t) const {
+            range->fill();
+            return range->done;
+        }
+    };
+
+    explicit TokenRange(std::string_view input) : tokenizer(input, true) {}
+
+    Iterator begin() {
+        return Iterator(this);
+    }
+    std::default_sentinel_t end() const {
+        return {};
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,87 @@
+#include "./value.h"
+
+#include <charconv>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+void printAtom(std::ostringstream& os, Value value) {
+    switch (value.getType()) {
+        case ValueType::NIL: os << "()"; break;
+        case ValueType::BOOLEAN: os << (value.asBoolean() ? "#t" : "#f"); break;
+        case ValueType::NUMERIC: {
+            char buffer[32];
+            auto result = std::to_chars(buffer, buffer + sizeof(buffer), value.asNumber());
+            os << std::string_view(buffer, result.ptr - buffer);
+            break;
+        }
+        case ValueType::INTEGER: os << value.asInteger(); break;
+        case ValueType::STRING: os << std::quoted(value.asString()->text); break;
+        case ValueType::SYMBOL: os << SymbolTable::global().name(value.asSymbol()); break;
+        case ValueType::PROCEDURE: os << "#<procedure>"; break;
+        case ValueType::PROMISE: os << "#<promise>"; break;
+        case ValueType::F64VECTOR: {
+            auto vector = static_cast<F64Vector*>(value.asObject());
+            os << "#f64(";
+            for (std::uint64_t i = 0; i < vector->length; i++) {
+                os << (i ? " " : "");
+                printAtom(os, Value::fromNumber(vector->data()[i]));
+            }
+            os << ')';
+            break;
+        }
+        case ValueType::PAIR: break;
+    }
+}
+
+}  // namespace
+
+ValueType Value::getType() const {
+    switch (tag()) {
+        case FIXNUM_TAG: return ValueType::INTEGER;
+        case SPECIAL_TAG: return bits == NIL_BITS ? ValueType::NIL : ValueType::BOOLEAN;
+        case SYMBOL_TAG: return ValueType::SYMBOL;
+        case PAIR_TAG: return ValueType::PAIR;
+        case OBJECT_TAG:
+            switch (asObject()->objectType) {
+                case ObjectType::STRING: return ValueType::STRING;
+                case ObjectType::PROMISE: return ValueType::PROMISE;
+                case ObjectType::F64VECTOR: return ValueType::F64VECTOR;
+                default: return ValueType::PROCEDURE;
+            }
+        default: return ValueType::NUMERIC;
+    }
+}
+
+// Iterative so that deeply nested data cannot overflow the stack: rests
+// holds what remains of each list still open.
+std::string Value::toString() const {
+    std::ostringstream os;
+    std::vector<Value> rests;
+    auto value = *this;
+    while (true) {
+        if (value.isPair()) {
+            os << '(';
+            rests.push_back(value.asPair()->cdr);
+            value = value.asPair()->car;
+            continue;
+        }
+        printAtom(os, value);
+        while (!rests.empty() && !rests.back().isPair()) {
+            if (!rests.back().isNil()) {
+                os << " . ";
+                printAtom(os, rests.back());
+            }
+            os << ')';
+            rests.pop_back();
+        }
+        if (rests.empty()) {
+            return os.str();
+        }
+        os << ' ';
+        value = rests.back().asPair()->car;
+        rests.back() = rests.back().asPair()->cdr;
+    }
+}
@@ -0,0 +1,310 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "./symbol_table.h"
+
+enum class ValueType : std::uint8_t {
+    NIL,
+    BOOLEAN,
+    NUMERIC,
+    INTEGER,
+    STRING,
+    SYMBOL,
+    PAIR,
+    PROCEDURE,
+    PROMISE,
+    F64VECTOR,
+};
+
+enum class ObjectType : std::uint8_t {
+    STRING,
+    BUILTIN,
+    LAMBDA,
+    CLOSURE,
+    FRAME,
+    ENVIRONMENT,
+    BINDINGS,
+    PROMISE,
+    F64VECTOR,
+};
+
+// Header shared by every heap object other than pairs, which are kept to
+// two words and have a tag of their own. size is the object's total size in
+// bytes, so the collector can copy and walk objects it knows nothing else
+// about: every word after the header is either a Value or a plain integer
+// that cannot be mistaken for a tagged pointer.
+struct Object {
+    ObjectType objectType;
+    std::uint8_t gcFlags{0};
+    std::uint32_t size;
+
+    Object(ObjectType objectType, std::uint32_t size) : objectType{objectType}, size{size} {}
+};
+
+struct Pair;
+struct String;
+
+static_assert(sizeof(void*) == 8, "Value stores pointers in 48 bits");
+
+// A datum packed into one 64-bit word (NaN-boxing). Any double other than
+// NaN is stored as itself; NaNs are canonicalized, which leaves the negative
+// quiet NaN space free to tag the other kinds:
+//
+//     0xFFF9 | 48-bit signed fixnum
+//     0xFFFA | special constant: (), #f, #t, unbound
+//     0xFFFB | symbol id
+//     0xFFFC | Pair*
+//     0xFFFD | Object*
+//     0xFFFE | forwarding address, only seen by the collector
+//
+// Pairs, strings and procedures live outside the value, which must not
+// outlive the heap they were allocated from.
+class Value {
+private:
+    static constexpr int TAG_SHIFT = 48;
+    static constexpr std::uint64_t PAYLOAD_MASK = (std::uint64_t{1} << TAG_SHIFT) - 1;
+    static constexpr std::uint64_t CANONICAL_NAN = 0x7FF8'0000'0000'0000;
+    static constexpr std::uint64_t FIXNUM_TAG = 0xFFF9;
+    static constexpr std::uint64_t SPECIAL_TAG = 0xFFFA;
+    static constexpr std::uint64_t SYMBOL_TAG = 0xFFFB;
+    static constexpr std::uint64_t PAIR_TAG = 0xFFFC;
+    static constexpr std::uint64_t OBJECT_TAG = 0xFFFD;
+    static constexpr std::uint64_t FORWARD_TAG = 0xFFFE;
+    static constexpr std::uint64_t NIL_BITS = SPECIAL_TAG << TAG_SHIFT;
+    static constexpr std::uint64_t FALSE_BITS = NIL_BITS | 1;
+    static constexpr std::uint64_t TRUE_BITS = NIL_BITS | 2;
+    static constexpr std::uint64_t UNBOUND_BITS = NIL_BITS | 3;
+
+    std::uint64_t bits;
+
+    constexpr explicit Value(std::uint64_t bits) : bits{bits} {}
+    static constexpr Value tagged(std::uint64_t tag, std::uint64_t payload) {
+        return Value((tag << TAG_SHIFT) | (payload & PAYLOAD_MASK));
+    }
+    constexpr std::uint64_t tag() const {
+        return bits >> TAG_SHIFT;
+    }
+
+public:
+    static constexpr std::int64_t FIXNUM_MIN = -(std::int64_t{1} << 47);
+    static constexpr std::int64_t FIXNUM_MAX = (std::int64_t{1} << 47) - 1;
+
+    constexpr Value() : bits{NIL_BITS} {}
+
+    static constexpr Value fromBoolean(bool value) {
+        return Value(value ? TRUE_BITS : FALSE_BITS);
+    }
+    static Value fromNumber(double value) {
+        return Value(value != value ? CANONICAL_NAN : std::bit_cast<std::uint64_t>(value));
+    }
+    // Integers outside the fixnum range become doubles.
+    static Value fromInteger(std::int64_t value) {
+        if (value < FIXNUM_MIN || value > FIXNUM_MAX) {
+            return fromNumber(static_cast<double>(value));
+        }
+        return tagged(FIXNUM_TAG, static_cast<std::uint64_t>(value));
+    }
+    static constexpr Value fromSymbol(SymbolId value) {
+        return tagged(SYMBOL_TAG, value);
+    }
+    static Value fromPair(Pair* value) {
+        return tagged(PAIR_TAG, reinterpret_cast<std::uintptr_t>(value));
+    }
+    static Value fromObject(Object* value) {
+        return tagged(OBJECT_TAG, reinterpret_cast<std::uintptr_t>(value));
+    }
+    static Value fromString(String* value);
+    static Value forwardingTo(void* address) {
+        return tagged(FORWARD_TAG, reinterpret_cast<std::uintptr_t>(address));
+    }
+    // Marks a variable slot that has no value; never seen by programs.
+    static constexpr Value unbound() {
+        return Value(UNBOUND_BITS);
+    }
+
+    ValueType getType() const;
+    std::uint64_t getBits() const {
+        return bits;
+    }
+
+    bool isNil() const {
+        return bits == NIL_BITS;
+    }
+    bool isFalse() const {
+        return bits == FALSE_BITS;
+    }
+    bool isTrue() const {
+        return bits != FALSE_BITS;
+    }
+    bool isBoolean() const {
+        return bits == FALSE_BITS || bits == TRUE_BITS;
+    }
+    bool isUnbound() const {
+        return bits == UNBOUND_BITS;
+    }
+    bool isNumeric() const {
+        return tag() < FIXNUM_TAG;
+    }
+    bool isInteger() const {
+        return tag() == FIXNUM_TAG;
+    }
+    bool isNumber() const {
+        return tag() <= FIXNUM_TAG;
+    }
+    bool isSymbol() const {
+        return tag() == SYMBOL_TAG;
+    }
+    bool isPair() const {
+        return tag() == PAIR_TAG;
+    }
+    bool isObject() const {
+        return tag() == OBJECT_TAG;
+    }
+    bool isObject(ObjectType type) const {
+        return isObject() && asObject()->objectType == type;
+    }
+    bool isString() const {
+        return isObject(ObjectType::STRING);
+    }
+    bool isProcedure() const {
+        return isObject(ObjectType::BUILTIN) || isObject(ObjectType::LAMBDA) ||
+               isObject(ObjectType::CLOSURE);
+    }
+    bool isPointer() const {
+        return tag() == PAIR_TAG || tag() == OBJECT_TAG;
+    }
+    bool isForwarding() const {
+        return tag() == FORWARD_TAG;
+    }
+
+    bool asBoolean() const {
+        return bits == TRUE_BITS;
+    }
+    double asNumber() const {
+        return std::bit_cast<double>(bits);
+    }
+    std::int64_t asInteger() const {
+        return static_cast<std::int64_t>(bits << 16) >> 16;
+    }
+    // The value of a number of either kind as a double.
+    double asDouble() const {
+        return isInteger() ? static_cast<double>(asInteger()) : asNumber();
+    }
+    SymbolId asSymbol() const {
+        return static_cast<SymbolId>(bits);
+    }
+    Pair* asPair() const {
+        return reinterpret_cast<Pair*>(bits & PAYLOAD_MASK);
+    }
+    Object* asObject() const {
+        return reinterpret_cast<Object*>(bits & PAYLOAD_MASK);
+    }
+    String* asString() const {
+        return reinterpret_cast<String*>(bits & PAYLOAD_MASK);
+    }
+    void* asPointer() const {
+        return reinterpret_cast<void*>(bits & PAYLOAD_MASK);
+    }
+
+    // Identity, as eq? sees it.
+    friend bool operator==(Value a, Value b) {
+        return a.bits == b.bits;
+    }
+
+    std::string toString() const;
+};
+
+static_assert(sizeof(Value) == 8);
+
+struct Pair {
+    Value car;
+    Value cdr;
+};
+
+struct String : Object {
+    std::string_view text;
+
+    explicit String(std::string_view text)
+        : Object(ObjectType::STRING, sizeof(String)), text{text} {}
+};
+
+inline Value Value::fromString(String* value) {
+    return fromObject(value);
+}
+
+class Interpreter;
+class Node;
+
+using BuiltinFunction = Value (*)(Interpreter& interpreter, const Value* args, std::size_t count);
+
+struct Builtin : Object {
+    const char* name;
+    BuiltinFunction function;
+
+    Builtin(const char* name, BuiltinFunction function)
+        : Object(ObjectType::BUILTIN, sizeof(Builtin)), name{name}, function{function} {}
+};
+
+// A closure. params is the parameter list as written: a proper or dotted
+// list of symbols, or a single symbol taking all arguments as a list. body
+// is analyzed code, and source the datums it was analyzed from. env is the
+// defining EvalEnv, or () at top level.
+struct Lambda : Object {
+    Value params;
+    const Node* body;
+    Value source;
+    Value env;
+
+    Lambda(Value params, const Node* body, Value source, Value env)
+        : Object(ObjectType::LAMBDA, sizeof(Lambda)),
+          params{params},
+          body{body},
+          source{source},
+          env{env} {}
+};
+
+// What delay makes: until forced, a call of proc with the list args to make
+// the value. Forcing keeps the value and drops proc and args, so whatever
+// they hold can be collected.
+struct Promise : Object {
+    Value proc;
+    Value args;
+    // Unbound until forced.
+    Value value;
+
+    Promise(Value proc, Value args)
+        : Object(ObjectType::PROMISE, sizeof(Promise)),
+          proc{proc},
+          args{args},
+          value{Value::unbound()} {}
+};
+
+// A vector of doubles stored after the header, unboxed. No element looks
+// like a tagged pointer: NaNs are canonical when they come from a Value, and
+// arithmetic on them gives only a canonical NaN or its negation.
+struct F64Vector : Object {
+    std::uint64_t length;
+
+    explicit F64Vector(std::uint64_t length)
+        : Object(ObjectType::F64VECTOR, sizeOf(length)), length{length} {
+        std::fill_n(data(), length, 0.0);
+    }
+
+    // So that the size, two words of header included, fits in the header.
+    static constexpr std::uint64_t MAX_LENGTH = UINT32_MAX / sizeof(double) - 2;
+    static std::uint32_t sizeOf(std::uint64_t length) {
+        return static_cast<std::uint32_t>(sizeof(F64Vector) + sizeof(double) * length);
+    }
+    double* data() {
+        return reinterpret_cast<double*>(this + 1);
+    }
+};
+
+#endif
@@ -0,0 +1,373 @@
+#include "./vector_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MINI_LISP_VECTOR_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace {
+
+/**********
+ * SCALAR *
+ **********/
+
+double addScalar(double a, double b) {
+    return a + b;
+}
+
+double subtractScalar(double a, double b) {
+    return a - b;
+}
+
+double multiplyScalar(double a, double b) {
+    return a * b;
+}
+
+double divideScalar(double a, double b) {
+    return a / b;
+}
+
+double sumScalar(const double* a, std::size_t n) {
+    double sum = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+double dotScalar(const double* a, const double* b, std::size_t n) {
+    double sum = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+template <double (*OP)(double, double)>
+void binaryScalar(const double* a, const double* b, double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = OP(a[i], b[i]);
+    }
+}
+
+void absScalar(const double* a, double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = std::fabs(a[i]);
+    }
+}
+
+void scaleScalar(const double* a, double k, double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = a[i] * k;
+    }
+}
+
+#ifdef MINI_LISP_VECTOR_X86
+
+/********
+ * SSE2 *
+ ********/
+
+// Reductions keep four accumulators, so that each addition need not wait
+// for the one before it.
+
+double sumSse2(const double* a, std::size_t n) {
+    auto s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+        s2 = _mm_add_pd(s2, _mm_loadu_pd(a + i + 4));
+        s3 = _mm_add_pd(s3, _mm_loadu_pd(a + i + 6));
+    }
+    auto s = _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3));
+    auto sum = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    return sum + sumScalar(a + i, n - i);
+}
+
+double dotSse2(const double* a, const double* b, std::size_t n) {
+    auto s0 = _mm_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+        s2 = _mm_add_pd(s2, _mm_mul_pd(_mm_loadu_pd(a + i + 4), _mm_loadu_pd(b + i + 4)));
+        s3 = _mm_add_pd(s3, _mm_mul_pd(_mm_loadu_pd(a + i + 6), _mm_loadu_pd(b + i + 6)));
+    }
+    auto s = _mm_add_pd(_mm_add_pd(s0, s1), _mm_add_pd(s2, s3));
+    auto sum = _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+    return sum + dotScalar(a + i, b + i, n - i);
+}
+
+__m128d addSse2(__m128d a, __m128d b) {
+    return _mm_add_pd(a, b);
+}
+
+__m128d subtractSse2(__m128d a, __m128d b) {
+    return _mm_sub_pd(a, b);
+}
+
+__m128d multiplySse2(__m128d a, __m128d b) {
+    return _mm_mul_pd(a, b);
+}
+
+__m128d divideSse2(__m128d a, __m128d b) {
+    return _mm_div_pd(a, b);
+}
+
+template <__m128d (*OP)(__m128d, __m128d), double (*SCALAR)(double, double)>
+void binarySse2(const double* a, const double* b, double* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, OP(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    binaryScalar<SCALAR>(a + i, b + i, out + i, n - i);
+}
+
+void absSse2(const double* a, double* out, std::size_t n) {
+    auto sign = _mm_set1_pd(-0.0);
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_andnot_pd(sign, _mm_loadu_pd(a + i)));
+    }
+    absScalar(a + i, out + i, n - i);
+}
+
+void scaleSse2(const double* a, double k, double* out, std::size_t n) {
+    auto factor = _mm_set1_pd(k);
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), factor));
+    }
+    scaleScalar(a + i, k, out + i, n - i);
+}
+
+/********
+ * AVX2 *
+ ********/
+
+// Only AVX instructions are used, but AVX2 is the level the tokenizer
+// already detects.
+
+TARGET_AVX2 double horizontalSum(__m256d s) {
+    auto pair = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+TARGET_AVX2 double sumAvx2(const double* a, std::size_t n) {
+    auto s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+        s2 = _mm256_add_pd(s2, _mm256_loadu_pd(a + i + 8));
+        s3 = _mm256_add_pd(s3, _mm256_loadu_pd(a + i + 12));
+    }
+    auto sum = horizontalSum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    return sum + sumScalar(a + i, n - i);
+}
+
+TARGET_AVX2 double dotAvx2(const double* a, const double* b, std::size_t n) {
+    auto s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+    std::size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(
+            s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+        s2 = _mm256_add_pd(
+            s2, _mm256_mul_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8)));
+        s3 = _mm256_add_pd(
+            s3, _mm256_mul_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12)));
+    }
+    auto sum = horizontalSum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+    return sum + dotScalar(a + i, b + i, n - i);
+}
+
+TARGET_AVX2 __m256d addAvx2(__m256d a, __m256d b) {
+    return _mm256_add_pd(a, b);
+}
+
+TARGET_AVX2 __m256d subtractAvx2(__m256d a, __m256d b) {
+    return _mm256_sub_pd(a, b);
+}
+
+TARGET_AVX2 __m256d multiplyAvx2(__m256d a, __m256d b) {
+    return _mm256_mul_pd(a, b);
+}
+
+TARGET_AVX2 __m256d divideAvx2(__m256d a, __m256d b) {
+    return _mm256_div_pd(a, b);
+}
+
+template <__m256d (*OP)(__m256d, __m256d), double (*SCALAR)(double, double)>
+TARGET_AVX2 void binaryAvx2(const double* a, const double* b, double* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, OP(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    binaryScalar<SCALAR>(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 void absAvx2(const double* a, double* out, std::size_t n) {
+    auto sign = _mm256_set1_pd(-0.0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_andnot_pd(sign, _mm256_loadu_pd(a + i)));
+    }
+    absScalar(a + i, out + i, n - i);
+}
+
+TARGET_AVX2 void scaleAvx2(const double* a, double k, double* out, std::size_t n) {
+    auto factor = _mm256_set1_pd(k);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factor));
+    }
+    scaleScalar(a + i, k, out + i, n - i);
+}
+
+#endif
+
+const VectorKernels SCALAR_KERNELS{
+    ScanLevel::SCALAR,
+    sumScalar,
+    dotScalar,
+    binaryScalar<addScalar>,
+    binaryScalar<subtractScalar>,
+    binaryScalar<multiplyScalar>,
+    binaryScalar<divideScalar>,
+    absScalar,
+    scaleScalar,
+};
+
+#ifdef MINI_LISP_VECTOR_X86
+const VectorKernels SSE2_KERNELS{
+    ScanLevel::SSE2,
+    sumSse2,
+    dotSse2,
+    binarySse2<addSse2, addScalar>,
+    binarySse2<subtractSse2, subtractScalar>,
+    binarySse2<multiplySse2, multiplyScalar>,
+    binarySse2<divideSse2, divideScalar>,
+    absSse2,
+    scaleSse2,
+};
+
+const VectorKernels AVX2_KERNELS{
+    ScanLevel::AVX2,
+    sumAvx2,
+    dotAvx2,
+    binaryAvx2<addAvx2, addScalar>,
+    binaryAvx2<subtractAvx2, subtractScalar>,
+    binaryAvx2<multiplyAvx2, multiplyScalar>,
+    binaryAvx2<divideAvx2, divideScalar>,
+    absAvx2,
+    scaleAvx2,
+};
+#endif
+
+const VectorKernels& kernelsFor(ScanLevel level) {
+    switch (level) {
+#ifdef MINI_LISP_VECTOR_X86
+        case ScanLevel::AVX2: return AVX2_KERNELS;
+        case ScanLevel::SSE2: return SSE2_KERNELS;
+#endif
+        default: return SCALAR_KERNELS;
+    }
+}
+
+std::atomic<const VectorKernels*> currentKernels{nullptr};
+
+}  // namespace
+
+const VectorKernels& vectorKernels() {
+    auto kernels = currentKernels.load(std::memory_order_relaxed);
+    if (!kernels) {
+        kernels = &kernelsFor(detectScanLevel());
+        currentKernels.store(kernels, std::memory_order_relaxed);
+    }
+    return *kernels;
+}
+
+ScanLevel setVectorLevel(ScanLevel level) {
+    if (level > detectScanLevel()) {
+        level = detectScanLevel();
+    }
+    auto& kernels = kernelsFor(level);
+    currentKernels.store(&kernels, std::memory_order_relaxed);
+    return kernels.level;
+}
+
+ArithmeticKernel::ArithmeticKernel(std::vector<Instruction> code) : code{std::move(code)} {
+    std::size_t depth = 0;
+    for (auto& instruction : this->code) {
+        switch (instruction.op) {
+            case Op::INPUT:
+            case Op::CONSTANT: depth++; break;
+            case Op::ABS: break;
+            default: depth--; break;
+        }
+        maxDepth = std::max(maxDepth, depth);
+    }
+}
+
+// Each stack entry points at a block of elements: a slice of an input, a
+// block filled with a constant, or its own block of the stack. An operation
+// stores into the block of the lower entry, which neither operand can be
+// unless it is that entry itself.
+void ArithmeticKernel::run(const double* const* inputs, double* out, std::size_t n) const {
+    auto& kernels = vectorKernels();
+    std::vector<double> blocks(maxDepth * BLOCK_SIZE);
+    std::vector<double> constants;
+    for (auto& instruction : code) {
+        if (instruction.op == Op::CONSTANT) {
+            constants.insert(constants.end(), BLOCK_SIZE, instruction.constant);
+        }
+    }
+    std::vector<const double*> stack(maxDepth);
+    for (std::size_t start = 0; start < n; start += BLOCK_SIZE) {
+        auto size = std::min(BLOCK_SIZE, n - start);
+        std::size_t depth = 0;
+        auto constant = constants.data();
+        for (auto& instruction : code) {
+            switch (instruction.op) {
+                case Op::INPUT: stack[depth++] = inputs[instruction.input] + start; break;
+                case Op::CONSTANT:
+                    stack[depth++] = constant;
+                    constant += BLOCK_SIZE;
+                    break;
+                case Op::ABS: {
+                    auto top = blocks.data() + (depth - 1) * BLOCK_SIZE;
+                    kernels.abs(stack[depth - 1], top, size);
+                    stack[depth - 1] = top;
+                    break;
+                }
+                default: {
+                    auto lower = blocks.data() + (depth - 2) * BLOCK_SIZE;
+                    auto a = stack[depth - 2];
+                    auto b = stack[depth - 1];
+                    switch (instruction.op) {
+                        case Op::ADD: kernels.add(a, b, lower, size); break;
+                        case Op::SUBTRACT: kernels.subtract(a, b, lower, size); break;
+                        case Op::MULTIPLY: kernels.multiply(a, b, lower, size); break;
+                        default: kernels.divide(a, b, lower, size); break;
+                    }
+                    stack[depth - 2] = lower;
+                    depth--;
+                    break;
+                }
+            }
+        }
+        std::copy_n(stack[0], size, out + start);
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "./char_class.h"
+
+// Loops over arrays of n doubles, vectorized for their level. Arrays in the
+// heap move to any 8-byte boundary, so they are loaded and stored unaligned.
+// out may be one of the inputs.
+struct VectorKernels {
+    ScanLevel level;
+    // Both sum in no particular order, so the result may differ in the last
+    // bits from a sum taken left to right.
+    double (*sum)(const double* a, std::size_t n);
+    double (*dot)(const double* a, const double* b, std::size_t n);
+    void (*add)(const double* a, const double* b, double* out, std::size_t n);
+    void (*subtract)(const double* a, const double* b, double* out, std::size_t n);
+    void (*multiply)(const double* a, const double* b, double* out, std::size_t n);
+    void (*divide)(const double* a, const double* b, double* out, std::size_t n);
+    void (*abs)(const double* a, double* out, std::size_t n);
+    void (*scale)(const double* a, double k, double* out, std::size_t n);
+};
+
+// The kernels for the best level the CPU supports, unless another has been
+// selected.
+const VectorKernels& vectorKernels();
+
+// Selects the kernels used from now on, clamped to what the CPU supports.
+// Returns the level actually selected.
+ScanLevel setVectorLevel(ScanLevel level);
+
+// An arithmetic expression over one element of each of some input arrays, as
+// code for a stack machine. It is run over a block of elements at a time,
+// each instruction with the kernels above, so that the stack stays in cache.
+class ArithmeticKernel {
+public:
+    enum class Op : std::uint8_t {
+        // Pushes the element of input.
+        INPUT,
+        // Pushes constant.
+        CONSTANT,
+        // Replace the top two with the result.
+        ADD,
+        SUBTRACT,
+        MULTIPLY,
+        DIVIDE,
+        // Replaces the top with its absolute value.
+        ABS,
+    };
+
+    struct Instruction {
+        Op op;
+        std::uint32_t input{0};
+        double constant{0};
+    };
+
+private:
+    static constexpr std::size_t BLOCK_SIZE = 256;
+
+    std::vector<Instruction> code;
+    std::size_t maxDepth{0};
+
+public:
+    // code must leave exactly one value on the stack.
+    explicit ArithmeticKernel(std::vector<Instruction> code);
+
+    // Sets out[i] to the expression of inputs[0][i], inputs[1][i], and so on,
+    // for each i below n.
+    void run(const double* const* inputs, double* out, std::size_t n) const;
+};
+
+#endif
@@ -0,0 +1,605 @@
+#include "./vm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#include "./builtins.h"
+#include "./error.h"
+#include "./interpreter.h"
+
+// GCC and Clang can jump straight from one instruction to the next through a
+// table of label addresses, which predicts better than a single switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define MINI_LISP_COMPUTED_GOTO
+#endif
+
+namespace {
+
+// The inline cases of the arithmetic instructions, which give the same
+// results as the builtins. Each returns false to leave the operands to the
+// builtin, which also reports any errors.
+bool addNumbers(Value a, Value b, Value& result) {
+    if (a.isInteger() && b.isInteger()) {
+        auto sum = a.asInteger() + b.asInteger();
+        if (sum < Value::FIXNUM_MIN || sum > Value::FIXNUM_MAX) {
+            return false;
+        }
+        result = Value::fromInteger(sum);
+        return true;
+    }
+    if (!a.isNumber() || !b.isNumber()) {
+        return false;
+    }
+    // The builtin starts its sum from an exact 0.
+    result = Value::fromNumber(0.0 + a.asDouble() + b.asDouble());
+    return true;
+}
+
+bool subtractNumbers(Value a, Value b, Value& result) {
+    if (a.isInteger() && b.isInteger()) {
+        result = Value::fromInteger(a.asInteger() - b.asInteger());
+        return true;
+    }
+    if (!a.isNumber() || !b.isNumber()) {
+        return false;
+    }
+    result = Value::fromNumber(a.asDouble() - b.asDouble());
+    return true;
+}
+
+bool multiplyNumbers(Value a, Value b, Value& result) {
+    if (a.isInteger() && b.isInteger()) {
+        // Fixnums are exact as doubles, so this bounds the product safely.
+        if (std::fabs(a.asDouble() * b.asDouble()) > static_cast<double>(Value::FIXNUM_MAX)) {
+            return false;
+        }
+        result = Value::fromInteger(a.asInteger() * b.asInteger());
+        return true;
+    }
+    if (!a.isNumber() || !b.isNumber()) {
+        return false;
+    }
+    result = Value::fromNumber(a.asDouble() * b.asDouble());
+    return true;
+}
+
+bool divideNumbers(Value a, Value b, Value& result) {
+    if (!a.isNumber() || !b.isNumber() || (b.isInteger() && b.asInteger() == 0)) {
+        return false;
+    }
+    if (a.isInteger() && b.isInteger() && a.asInteger() % b.asInteger() == 0) {
+        result = Value::fromInteger(a.asInteger() / b.asInteger());
+        return true;
+    }
+    result = Value::fromNumber(a.asDouble() / b.asDouble());
+    return true;
+}
+
+template <typename Compare>
+bool compareNumbers(Value a, Value b, Value& result) {
+    if (a.isInteger() && b.isInteger()) {
+        result = Value::fromBoolean(Compare()(a.asInteger(), b.asInteger()));
+        return true;
+    }
+    if (!a.isNumber() || !b.isNumber()) {
+        return false;
+    }
+    result = Value::fromBoolean(Compare()(a.asDouble(), b.asDouble()));
+    return true;
+}
+
+}  // namespace
+
+VM::VM(Interpreter& interpreter) : interpreter{interpreter}, jit{interpreter.code} {}
+
+Value VM::execute(const Prototype* prototype, Value env) {
+    Interpreter::StackMark mark{interpreter, interpreter.stackSize};
+    interpreter.push(env);
+    for (std::uint32_t i = 0; i < prototype->stackSlots; i++) {
+        interpreter.push(Value::unbound());
+    }
+    return start(prototype, mark.base);
+}
+
+Value VM::call(Closure* closure, const Value* args, std::size_t count) {
+    Interpreter::StackMark mark{interpreter, interpreter.stackSize};
+    interpreter.push(Value::fromObject(closure));
+    for (std::size_t i = 0; i < count; i++) {
+        interpreter.push(args[i]);
+    }
+    return start(enterClosure(mark.base, count), mark.base);
+}
+
+// An exception drops every activation pushed since.
+Value VM::start(const Prototype* prototype, std::size_t base) {
+    auto entry = activations.size();
+    activations.push_back({prototype, prototype->code.data(), base});
+    try {
+        return run(entry);
+    } catch (...) {
+        activations.resize(entry);
+        throw;
+    }
+}
+
+// The parameters start out in the stack slots, then move to a frame if the
+// prototype has one.
+const Prototype* VM::enterClosure(std::size_t callee, std::size_t count) {
+    auto stack = interpreter.stack.get();
+    auto& top = interpreter.stackSize;
+    auto prototype = static_cast<Closure*>(stack[callee].asObject())->prototype;
+    // Counting stops at the threshold, so that the count cannot wrap round to
+    // it and compile the prototype again.
+    if (prototype->calls < JIT_THRESHOLD && ++prototype->calls == JIT_THRESHOLD &&
+        interpreter.jitEnabled) {
+        prototype->native = jit.compile(*prototype);
+    }
+    auto required = prototype->required;
+    if (count < required) {
+        throw LispError("Too few arguments");
+    }
+    if (!prototype->variadic && count > required) {
+        throw LispError("Too many arguments");
+    }
+    auto slots = callee + 1;
+    auto params = required + (prototype->variadic ? 1 : 0);
+    if (slots + std::max(params, prototype->stackSlots) > Interpreter::STACK_CAPACITY) {
+        throw LispError("Stack overflow");
+    }
+    if (prototype->variadic) {
+        Root rest(interpreter.heap);
+        for (auto i = count; i > required; i--) {
+            rest = interpreter.cons(stack[slots + i - 1], rest);
+        }
+        stack[slots + required] = rest;
+    }
+    top = slots + params;
+    if (prototype->frameSize > 0) {
+        auto memory = interpreter.heap.allocate(Frame::sizeOf(prototype->frameSize));
+        auto parent = static_cast<Closure*>(stack[callee].asObject())->env;
+        auto frame = new (memory) Frame(parent, prototype->frameSize);
+        std::copy_n(&stack[slots], params, frame->slots());
+        stack[callee] = Value::fromObject(frame);
+        top = slots;
+    } else {
+        stack[callee] = static_cast<Closure*>(stack[callee].asObject())->env;
+    }
+    for (; top < slots + prototype->stackSlots; top++) {
+        stack[top] = Value::unbound();
+    }
+    return prototype;
+}
+
+std::uint32_t VM::spreadApply(std::size_t callee, std::uint32_t count) {
+    auto stack = interpreter.stack.get();
+    while (count == 2 && stack[callee].isObject(ObjectType::BUILTIN) &&
+           static_cast<Builtin*>(stack[callee].asObject())->function == applyProcedure) {
+        auto list = stack[callee + 2];
+        stack[callee] = stack[callee + 1];
+        interpreter.stackSize = callee + 1;
+        for (count = 0; list.isPair(); list = list.asPair()->cdr, count++) {
+            interpreter.push(list.asPair()->car);
+        }
+        if (!list.isNil()) {
+            throw LispError("apply: expected a list");
+        }
+    }
+    return count;
+}
+
+const Prototype* VM::prepareCall(std::size_t callee, std::uint32_t count, CallSite* site) {
+    auto stack = interpreter.stack.get();
+    if (site && site->epoch == interpreter.globalEpoch && stack[callee] == *site->cell) {
+        if (site->prototype) {
+            return enterClosure(callee, count);
+        }
+        stack[callee] = site->builtin(interpreter, &stack[callee + 1], count);
+        return nullptr;
+    }
+    auto spread = spreadApply(callee, count);
+    auto proc = stack[callee];
+    bool cacheable = site && spread == count && proc == *site->cell;
+    if (!proc.isObject(ObjectType::CLOSURE)) {
+        if (cacheable && proc.isObject(ObjectType::BUILTIN)) {
+            *site = {site->cell, interpreter.globalEpoch, nullptr,
+                     static_cast<Builtin*>(proc.asObject())->function};
+        }
+        stack[callee] = interpreter.apply(proc, &stack[callee + 1], spread);
+        return nullptr;
+    }
+    auto prototype = static_cast<Closure*>(proc.asObject())->prototype;
+    if (cacheable && !prototype->variadic && prototype->required == count) {
+        *site = {site->cell, interpreter.globalEpoch, prototype, nullptr};
+    }
+    return enterClosure(callee, spread);
+}
+
+// Native code keeps the top of the stack to itself, so hooks update the
+// interpreter's before anything can collect.
+const void* VM::nativeCall(NativeContext* context, std::uint32_t count, std::uint32_t site,
+                           std::uint32_t next, bool tail) {
+    auto& run = static_cast<NativeRun&>(*context);
+    auto& self = *run.vm;
+    auto& interpreter = self.interpreter;
+    auto stack = interpreter.stack.get();
+    auto callee = static_cast<std::size_t>(run.top - stack) - count - 1;
+    auto caller = self.activations.back();
+    if (site == NO_CALL_SITE) {
+        return nullptr;
+    }
+    auto& cache = caller.prototype->callSites[site];
+    if (cache.epoch != interpreter.globalEpoch || stack[callee] != *cache.cell) {
+        return nullptr;
+    }
+    try {
+        if (auto prototype = cache.prototype) {
+            if (!prototype->native || (!tail && self.activations.size() == MAX_ACTIVATIONS)) {
+                return nullptr;
+            }
+            interpreter.stackSize = run.top - stack;
+            self.enterClosure(callee, count);
+            auto base = callee;
+            if (tail) {
+                base = caller.base;
+                std::copy(&stack[callee], &stack[interpreter.stackSize], &stack[base]);
+                interpreter.stackSize -= callee - base;
+                self.activations.back() = {prototype, prototype->code.data(), base};
+            } else {
+                self.activations.back().ip = caller.prototype->code.data() + next;
+                self.activations.push_back({prototype, prototype->code.data(), callee});
+            }
+            run.base = &stack[base];
+            run.top = &stack[interpreter.stackSize];
+            return prototype->native->addresses[0];
+        }
+        if (tail && !self.canReturnNatively(run)) {
+            return nullptr;
+        }
+        interpreter.stackSize = run.top - stack;
+        stack[callee] = cache.builtin(interpreter, &stack[callee + 1], count);
+        interpreter.stackSize = callee + 1;
+        run.top = &stack[callee + 1];
+        return tail ? self.returnNatively(run) : caller.prototype->native->addresses[next];
+    } catch (...) {
+        self.nativeException = std::current_exception();
+        return nullptr;
+    }
+}
+
+const void* VM::nativeReturn(NativeContext* context) {
+    auto& run = static_cast<NativeRun&>(*context);
+    return run.vm->canReturnNatively(run) ? run.vm->returnNatively(run) : nullptr;
+}
+
+bool VM::canReturnNatively(const NativeRun& run) const {
+    return activations.size() - 1 > run.entry &&
+           activations[activations.size() - 2].prototype->native;
+}
+
+const void* VM::returnNatively(NativeRun& run) {
+    auto stack = interpreter.stack.get();
+    auto base = activations.back().base;
+    stack[base] = run.top[-1];
+    activations.pop_back();
+    auto& caller = activations.back();
+    run.base = &stack[caller.base];
+    run.top = &stack[base + 1];
+    interpreter.stackSize = base + 1;
+    return caller.prototype->native->addresses[caller.ip - caller.prototype->code.data()];
+}
+
+Value VM::callArithmetic(const GlobalRef& global, std::size_t args) {
+    auto proc = *global.cell;
+    if (proc.isUnbound()) {
+        proc = interpreter.lookup(global.name, nullptr);
+    }
+    return interpreter.apply(proc, &interpreter.stack[args], 2);
+}
+
+Value VM::run(std::size_t entry) {
+    auto stack = interpreter.stack.get();
+    auto& top = interpreter.stackSize;
+    auto& heap = interpreter.heap;
+    auto activation = activations.back();
+    auto ip = activation.ip;
+
+    auto push = [&](Value value) {
+        if (top == Interpreter::STACK_CAPACITY) {
+            throw LispError("Stack overflow");
+        }
+        stack[top++] = value;
+    };
+    auto operand = [&] {
+        auto value = readOperand<std::uint32_t>(ip);
+        ip += sizeof(std::uint32_t);
+        return value;
+    };
+    auto callSite = [&](std::uint32_t index) {
+        return index == NO_CALL_SITE ? nullptr : &activation.prototype->callSites[index];
+    };
+    // Runs natively from ip, if the current activation has native code, until
+    // an instruction it leaves to the interpreter.
+    auto runNative = [&] {
+        auto native = activation.prototype->native;
+        if (!native) {
+            return;
+        }
+        NativeRun context{{&stack[activation.base], &stack[top],
+                           &stack[Interpreter::STACK_CAPACITY], 0, nativeCall, nativeReturn},
+                          this,
+                          entry};
+        native->entry(&context, native->addresses[ip - activation.prototype->code.data()]);
+        top = context.top - stack;
+        if (nativeException) {
+            std::rethrow_exception(std::exchange(nativeException, nullptr));
+        }
+        activation = activations.back();
+        ip = activation.prototype->code.data() + context.exit;
+    };
+    auto frameAt = [&](std::uint32_t depth) {
+        auto frame = static_cast<Frame*>(stack[activation.base].asObject());
+        for (; depth > 0; depth--) {
+            frame = static_cast<Frame*>(frame->parent.asObject());
+        }
+        return frame;
+    };
+
+    runNative();
+#ifdef MINI_LISP_COMPUTED_GOTO
+#define MINI_LISP_LABEL_ADDRESS(name) &&do_##name,
+    static const void* const LABELS[] = {MINI_LISP_OPCODES(MINI_LISP_LABEL_ADDRESS)};
+#undef MINI_LISP_LABEL_ADDRESS
+#define INSTRUCTION(name) do_##name:
+#define DISPATCH() goto* LABELS[*ip++]
+    DISPATCH();
+#else
+#define INSTRUCTION(name) case Opcode::name:
+#define DISPATCH() continue
+    for (;;) {
+        switch (static_cast<Opcode>(*ip++)) {
+#endif
+
+    INSTRUCTION(CONSTANT) {
+        push(activation.prototype->constants[operand()]);
+        DISPATCH();
+    }
+    INSTRUCTION(NIL) {
+        push(Value());
+        DISPATCH();
+    }
+    INSTRUCTION(LOAD_LOCAL) {
+        auto frame = frameAt(operand());
+        auto value = frame->slots()[operand()];
+        auto name = operand();
+        if (value.isUnbound()) {
+            throw LispError("Variable " + std::string(SymbolTable::global().name(name)) +
+                            " is not defined");
+        }
+        push(value);
+        DISPATCH();
+    }
+    INSTRUCTION(LOAD_STACK) {
+        auto value = stack[activation.base + 1 + operand()];
+        auto name = operand();
+        if (value.isUnbound()) {
+            throw LispError("Variable " + std::string(SymbolTable::global().name(name)) +
+                            " is not defined");
+        }
+        push(value);
+        DISPATCH();
+    }
+    INSTRUCTION(LOAD_GLOBAL) {
+        auto& global = activation.prototype->globals[operand()];
+        auto value = *global.cell;
+        push(value.isUnbound() ? interpreter.lookup(global.name, nullptr) : value);
+        DISPATCH();
+    }
+    INSTRUCTION(DEFINE_LOCAL) {
+        auto frame = frameAt(0);
+        auto slot = &frame->slots()[operand()];
+        *slot = stack[top - 1];
+        heap.writeBarrier(frame, slot);
+        stack[top - 1] = Value();
+        DISPATCH();
+    }
+    INSTRUCTION(DEFINE_STACK) {
+        stack[activation.base + 1 + operand()] = stack[top - 1];
+        stack[top - 1] = Value();
+        DISPATCH();
+    }
+    INSTRUCTION(DEFINE_GLOBAL) {
+        interpreter.define(operand(), stack[top - 1], nullptr);
+        stack[top - 1] = Value();
+        DISPATCH();
+    }
+    INSTRUCTION(POP) {
+        top--;
+        DISPATCH();
+    }
+    INSTRUCTION(JUMP) {
+        auto offset = readOperand<std::int32_t>(ip);
+        ip += sizeof(offset) + offset;
+        DISPATCH();
+    }
+    INSTRUCTION(JUMP_IF_FALSE) {
+        auto offset = readOperand<std::int32_t>(ip);
+        ip += sizeof(offset);
+        if (stack[--top].isFalse()) {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    INSTRUCTION(JUMP_IF_FALSE_OR_POP) {
+        auto offset = readOperand<std::int32_t>(ip);
+        ip += sizeof(offset);
+        if (stack[top - 1].isFalse()) {
+            ip += offset;
+        } else {
+            top--;
+        }
+        DISPATCH();
+    }
+    INSTRUCTION(JUMP_IF_TRUE_OR_POP) {
+        auto offset = readOperand<std::int32_t>(ip);
+        ip += sizeof(offset);
+        if (!stack[top - 1].isFalse()) {
+            ip += offset;
+        } else {
+            top--;
+        }
+        DISPATCH();
+    }
+    INSTRUCTION(CLOSURE) {
+        auto child = activation.prototype->children[operand()];
+        push(interpreter.makeClosure(child, stack[activation.base]));
+        DISPATCH();
+    }
+    INSTRUCTION(CALL) {
+        auto count = operand();
+        auto callee = top - count - 1;
+        auto prototype = prepareCall(callee, count, callSite(operand()));
+        if (!prototype) {
+            top = callee + 1;
+            DISPATCH();
+        }
+        if (activations.size() == MAX_ACTIVATIONS) {
+            throw LispError("Maximum recursion depth exceeded");
+        }
+        // The callee's slot, now holding its frame, is the base of its
+        // activation, and its stack slots are already above it.
+        activations.back().ip = ip;
+        activation = {prototype, prototype->code.data(), callee};
+        activations.push_back(activation);
+        ip = activation.ip;
+        runNative();
+        DISPATCH();
+    }
+    INSTRUCTION(TAIL_CALL) {
+        auto count = operand();
+        auto callee = top - count - 1;
+        auto prototype = prepareCall(callee, count, callSite(operand()));
+        if (!prototype) {
+            top = callee + 1;
+            goto leave;
+        }
+        // Moves the new activation's base and stack slots down over this one.
+        std::copy(&stack[callee], &stack[top], &stack[activation.base]);
+        top = activation.base + (top - callee);
+        activation.prototype = prototype;
+        activations.back() = activation;
+        ip = prototype->code.data();
+        runNative();
+        DISPATCH();
+    }
+    INSTRUCTION(RETURN) {
+    leave:
+        auto result = stack[top - 1];
+        top = activation.base;
+        activations.pop_back();
+        if (activations.size() == entry) {
+            return result;
+        }
+        activation = activations.back();
+        ip = activation.ip;
+        stack[top++] = result;
+        runNative();
+        DISPATCH();
+    }
+    INSTRUCTION(ENTER) {
+        auto count = operand();
+        auto size = operand();
+        auto memory = heap.allocate(Frame::sizeOf(size));
+        auto frame = new (memory) Frame(stack[activation.base], size);
+        std::copy_n(&stack[top - count], count, frame->slots());
+        top -= count;
+        stack[activation.base] = Value::fromObject(frame);
+        DISPATCH();
+    }
+    INSTRUCTION(LEAVE) {
+        stack[activation.base] = frameAt(0)->parent;
+        DISPATCH();
+    }
+    INSTRUCTION(ENTER_STACK) {
+        auto slots = &stack[activation.base + 1 + operand()];
+        auto count = operand();
+        auto size = operand();
+        std::copy_n(&stack[top - count], count, slots);
+        std::fill(slots + count, slots + size, Value::unbound());
+        top -= count;
+        DISPATCH();
+    }
+    INSTRUCTION(LIST) {
+        auto count = operand();
+        for (std::uint32_t i = 0; i < count; i++) {
+            stack[top - 2 - i] = interpreter.cons(stack[top - 2 - i], stack[top - 1 - i]);
+        }
+        top -= count;
+        DISPATCH();
+    }
+
+// Runs the inline case while the global still holds the builtin, and the
+// global's procedure otherwise.
+#define MINI_LISP_ARITHMETIC(name, function)                     \
+    INSTRUCTION(name) {                                          \
+        auto& global = activation.prototype->globals[operand()]; \
+        Value result;                                            \
+        if (*global.cell != global.expected ||                   \
+            !function(stack[top - 2], stack[top - 1], result)) { \
+            result = callArithmetic(global, top - 2);            \
+        }                                                        \
+        top--;                                                   \
+        stack[top - 1] = result;                                 \
+        DISPATCH();                                              \
+    }
+#define MINI_LISP_BRANCH(name, function)                         \
+    INSTRUCTION(name) {                                          \
+        auto& global = activation.prototype->globals[operand()]; \
+        auto offset = readOperand<std::int32_t>(ip);             \
+        ip += sizeof(offset);                                    \
+        Value result;                                            \
+        if (*global.cell != global.expected ||                   \
+            !function(stack[top - 2], stack[top - 1], result)) { \
+            result = callArithmetic(global, top - 2);            \
+        }                                                        \
+        top -= 2;                                                \
+        if (result.isFalse()) {                                  \
+            ip += offset;                                        \
+        }                                                        \
+        DISPATCH();                                              \
+    }
+
+    MINI_LISP_ARITHMETIC(ADD, addNumbers)
+    MINI_LISP_ARITHMETIC(SUBTRACT, subtractNumbers)
+    MINI_LISP_ARITHMETIC(MULTIPLY, multiplyNumbers)
+    MINI_LISP_ARITHMETIC(DIVIDE, divideNumbers)
+    MINI_LISP_ARITHMETIC(LESS, compareNumbers<std::less<>>)
+    MINI_LISP_ARITHMETIC(GREATER, compareNumbers<std::greater<>>)
+    MINI_LISP_ARITHMETIC(NUMBER_EQUAL, compareNumbers<std::equal_to<>>)
+    MINI_LISP_ARITHMETIC(LESS_EQUAL, compareNumbers<std::less_equal<>>)
+    MINI_LISP_ARITHMETIC(GREATER_EQUAL, compareNumbers<std::greater_equal<>>)
+    MINI_LISP_BRANCH(JUMP_UNLESS_LESS, compareNumbers<std::less<>>)
+    MINI_LISP_BRANCH(JUMP_UNLESS_GREATER, compareNumbers<std::greater<>>)
+    MINI_LISP_BRANCH(JUMP_UNLESS_NUMBER_EQUAL, compareNumbers<std::equal_to<>>)
+    MINI_LISP_BRANCH(JUMP_UNLESS_LESS_EQUAL, compareNumbers<std::less_equal<>>)
+    MINI_LISP_BRANCH(JUMP_UNLESS_GREATER_EQUAL, compareNumbers<std::greater_equal<>>)
+#undef MINI_LISP_ARITHMETIC
+#undef MINI_LISP_BRANCH
+    INSTRUCTION(JUMP_UNLESS_GLOBAL) {
+        auto& global = activation.prototype->globals[operand()];
+        auto offset = readOperand<std::int32_t>(ip);
+        ip += sizeof(offset);
+        if (*global.cell != global.expected) {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+
+#ifndef MINI_LISP_COMPUTED_GOTO
+        }
+    }
+#endif
+#undef INSTRUCTION
+#undef DISPATCH
+}
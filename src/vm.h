@@ -0,0 +1,83 @@
+#ifndef VM_H
+#define VM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+#include "./bytecode.h"
+#include "./jit.h"
+#include "./value.h"
+
+class Interpreter;
+
+// Runs bytecode on the interpreter's value stack. Each activation owns the
+// stack from its base slot, which holds its current Frame or (), up to the
+// top. Just above the base are its stack slots, for the variables no closure
+// can capture; a call's arguments are already in place there.
+// Calls from one closure to another push an activation instead of recursing
+// natively; only calls through builtins, such as map, re-enter run().
+//
+// Once a prototype has been called often enough, and unless the interpreter
+// has the JIT disabled, it is compiled to native code. Activations of it
+// then run natively whenever they start or are returned to, until an
+// instruction needs the interpreter.
+class VM {
+private:
+    static constexpr std::size_t MAX_ACTIVATIONS = 1 << 18;
+    static constexpr std::uint32_t JIT_THRESHOLD = 1000;
+
+    struct Activation {
+        const Prototype* prototype;
+        const std::uint8_t* ip;
+        std::size_t base;
+    };
+
+    // A run of native code, with what its hooks need to know.
+    struct NativeRun : NativeContext {
+        VM* vm;
+        // The activation run() returns from.
+        std::size_t entry;
+    };
+
+    Interpreter& interpreter;
+    std::vector<Activation> activations;
+    Jit jit;
+    // Thrown by a procedure native code called, for run() to rethrow.
+    std::exception_ptr nativeException;
+
+    // Turns the call of the closure at callee with the count arguments above
+    // it into the start of its activation, and returns its prototype.
+    const Prototype* enterClosure(std::size_t callee, std::size_t count);
+    // Pushes an activation for prototype at base, and runs it.
+    Value start(const Prototype* prototype, std::size_t base);
+    // Turns a call of apply at callee into a call of its procedure with the
+    // list's items, returning the new argument count.
+    std::uint32_t spreadApply(std::size_t callee, std::uint32_t count);
+    // Sets up the call at callee, through site's cache if it has one. For a
+    // closure, enters it and returns its prototype; otherwise calls the
+    // procedure, leaves the result in its place and returns null.
+    const Prototype* prepareCall(std::size_t callee, std::uint32_t count, CallSite* site);
+    // Calls the procedure an arithmetic instruction stands for, when its
+    // inline case does not apply, on the two operands at args.
+    Value callArithmetic(const GlobalRef& global, std::size_t args);
+    // The hooks of native code. Calls only go through those caches that hold
+    // a builtin, or a closure with native code.
+    static const void* nativeCall(NativeContext* context, std::uint32_t count, std::uint32_t site,
+                                  std::uint32_t next, bool tail);
+    static const void* nativeReturn(NativeContext* context);
+    bool canReturnNatively(const NativeRun& run) const;
+    const void* returnNatively(NativeRun& run);
+    // Runs until the activation at index entry returns.
+    Value run(std::size_t entry);
+
+public:
+    explicit VM(Interpreter& interpreter);
+
+    // Runs prototype in a new activation whose frame is env.
+    Value execute(const Prototype* prototype, Value env);
+    Value call(Closure* closure, const Value* args, std::size_t count);
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <deque>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "./interpreter.h"
+#include "./reader.h"
+#include "./token_stream.h"
+#include "./tokenizer.h"
+
+// Minimal assertions for the test executables. A failed check is reported
+// and the test goes on; main returns checkFailures() as its exit status.
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" \
+                      << std::endl;                                                      \
+            checkFailures()++;                                                           \
+        }                                                                                \
+    } while (0)
+
+// Evaluates each datum of source in turn, giving the printed value of the
+// last one, or the message of the first error thrown.
+inline std::string run(Interpreter& interpreter, std::string_view source) {
+    try {
+        TokenRange tokens(source);
+        Reader reader(interpreter.getCodeArena());
+        std::string result;
+        while (tokens.begin() != tokens.end()) {
+            result = interpreter.eval(reader.read(tokens)).toString();
+        }
+        return result;
+    } catch (std::runtime_error& e) {
+        return std::string("Error: ") + e.what();
+    }
+}
+
+#define CHECK_RUN(interpreter, source, expected)                                       \
+    do {                                                                               \
+        auto actual = run(interpreter, source);                                        \
+        if (actual != (expected)) {                                                    \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " << (source) << " gave " \
+                      << actual << ", expected " << (expected) << std::endl;           \
+            checkFailures()++;                                                         \
+        }                                                                              \
+    } while (0)
+
+// The tokens tokenize() gives, one per line, with the offset and length of
+// each for a TokenStream; or the message of the error it throws.
+template <typename Tokenize>
+std::string describeTokens(Tokenize tokenize) {
+    try {
+        auto tokens = tokenize();
+        std::string result;
+        if constexpr (std::is_same_v<decltype(tokens), TokenStream>) {
+            for (std::size_t i = 0; i < tokens.size(); i++) {
+                result += std::to_string(tokens.offset(i)) + "+" +
+                          std::to_string(tokens.length(i)) + " " + tokens.toString(i) + "\n";
+            }
+        } else {
+            for (auto& token : tokens) {
+                result += token->toString() + "\n";
+            }
+        }
+        return result;
+    } catch (std::runtime_error& e) {
+        return std::string("Error: ") + e.what();
+    }
+}
+
+#endif
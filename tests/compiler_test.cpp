@@ -0,0 +1,102 @@
+// Tests of where the compiler keeps each scope, and that procedures mixing
+// stack and frame scopes, or defining names, run the same on every engine.
+
+#include <string_view>
+
+#include "./bytecode.h"
+#include "./check.h"
+#include "./compiler.h"
+#include "./interpreter.h"
+#include "./reader.h"
+#include "./tokenizer.h"
+
+namespace {
+
+// The prototype of the procedure source defines, at top level.
+const Prototype* compileProcedure(Interpreter& interpreter, std::string_view source) {
+    TokenRange tokens(source);
+    Reader reader(interpreter.getCodeArena());
+    return Compiler::compileTopLevel(interpreter, reader.read(tokens))->children[0];
+}
+
+void testScopes() {
+    Interpreter interpreter;
+    // The lambda refers only to its own parameter, so l needs no frame.
+    auto f = compileProcedure(interpreter, "(define (f l) (map (lambda (x) (* x x)) l))");
+    CHECK(f->frameSize == 0);
+    CHECK(f->children[0]->frameSize == 0);
+    auto sq = compileProcedure(interpreter, "(define (g n) (define (sq y) (* y y)) (sq n))");
+    CHECK(sq->frameSize == 0);
+    // A lambda that binds the name again does not capture the outer one.
+    auto shadow = compileProcedure(interpreter, "(define (g x) (map (lambda (x) x) (list x)))");
+    CHECK(shadow->frameSize == 0);
+
+    auto captured = compileProcedure(interpreter, "(define (g a) (lambda () a))");
+    CHECK(captured->frameSize == 1);
+    auto recursive = compileProcedure(
+        interpreter, "(define (g n) (define (loop i) (if (= i n) i (loop (+ i 1)))) (loop 0))");
+    CHECK(recursive->frameSize == 2);
+    auto delayed = compileProcedure(interpreter, "(define (g x) (delay x))");
+    CHECK(delayed->frameSize == 1);
+    auto nested = compileProcedure(interpreter, "(define (g a) (lambda () (lambda () a)))");
+    CHECK(nested->frameSize == 1);
+}
+
+void testMixedScopes(Interpreter::Engine engine, bool jit) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    interpreter.setJit(jit);
+    run(interpreter,
+        "(define (g a) (let ((b (* a 2))) (lambda () b)))"
+        "(define (h a) (define (inner b) (lambda () (+ a b))) ((inner 1)))"
+        "(define (k a) (let ((b 2)) (let ((c 3)) (lambda () (list a b c)))))"
+        "(define (m x) (let ((x 5)) (lambda () x)))"
+        "(define (q a) (map (lambda (y) `(,a ,y)) '(1 2)))"
+        "(define (s n) (cons-stream n (s (+ n 1))))");
+    // Enough calls for the JIT to compile them.
+    run(interpreter,
+        "(define (repeat n thunk) (if (= n 1) (thunk) (begin (thunk) (repeat (- n 1) thunk))))");
+    CHECK_RUN(interpreter, "(repeat 2000 (lambda () ((g 3))))", "6");
+    CHECK_RUN(interpreter, "(repeat 2000 (lambda () (h 5)))", "6");
+    CHECK_RUN(interpreter, "(repeat 2000 (lambda () ((k 1))))", "(1 2 3)");
+    CHECK_RUN(interpreter, "(repeat 2000 (lambda () ((m 1))))", "5");
+    CHECK_RUN(interpreter, "(repeat 2000 (lambda () (q 'z)))", "((z 1) (z 2))");
+    CHECK_RUN(interpreter, "(repeat 2000 (lambda () (stream-head (s 3) 3)))", "(3 4 5)");
+}
+
+// A name a body defines is bound from the start of the body, and is an
+// error until its define runs, even when an outer scope binds it too.
+void testInternalDefines(Interpreter::Engine engine) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    run(interpreter,
+        "(define x 5)"
+        "(define (f) (define x (+ x 1)) x)"
+        "(define (g) (display x) (define x 2) x)"
+        "(define (h) (define x (+ x 1)) (lambda () x))"
+        "(define (k) (let ((y 1)) (define x (+ x y)) x))"
+        "(define (m x) (define x (+ x 1)) x)"
+        "(define (n) (define (get) x) (define a (get)) (define x 2) a)"
+        "(define (p) (define (get) x) (define x 2) (get))");
+    CHECK_RUN(interpreter, "(f)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "(g)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "(h)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "(k)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "(n)", "Error: Variable x is not defined");
+    // A parameter is bound already; its define only replaces the value.
+    CHECK_RUN(interpreter, "(m 1)", "2");
+    CHECK_RUN(interpreter, "(p)", "2");
+    CHECK_RUN(interpreter, "x", "5");
+}
+
+}  // namespace
+
+int main() {
+    testScopes();
+    testMixedScopes(Interpreter::Engine::VM, true);
+    testMixedScopes(Interpreter::Engine::VM, false);
+    testMixedScopes(Interpreter::Engine::TREE, false);
+    testInternalDefines(Interpreter::Engine::VM);
+    testInternalDefines(Interpreter::Engine::TREE);
+    return checkFailures();
+}
@@ -0,0 +1,162 @@
+// Collector tests, on a nursery small enough that every few allocations
+// collect, run under both engines.
+
+#include <cstddef>
+#include <string>
+
+#include "./check.h"
+#include "./heap.h"
+#include "./interpreter.h"
+#include "./value.h"
+
+namespace {
+
+// Small enough that anything over a kilobyte starts in the old space.
+constexpr std::size_t NURSERY_SIZE = 4096;
+
+// Defines (build n '()), which allocates a list of n items.
+void setUp(Interpreter& interpreter, Interpreter::Engine engine) {
+    interpreter.setEngine(engine);
+    run(interpreter, "(define (build n acc) (if (= n 0) acc (build (- n 1) (cons n acc))))");
+}
+
+// Allocates and drops lists until a major collection has happened. Each
+// list is live while it is built, so it is promoted, and the old space
+// grows until it passes the threshold.
+void collectMajor(Interpreter& interpreter) {
+    auto& stats = interpreter.getHeap().getStats();
+    auto before = stats.majorCollections;
+    while (stats.majorCollections == before) {
+        run(interpreter, "(build 10000 '())");
+    }
+}
+
+void testRootAcrossAllocation() {
+    Heap heap(NURSERY_SIZE);
+    Root list(heap);
+    for (int i = 1; i <= 1000; i++) {
+        list = heap.cons(Value::fromInteger(i), list);
+    }
+    CHECK(heap.getStats().minorCollections > 0);
+    std::int64_t sum = 0;
+    std::size_t length = 0;
+    for (Value item = list; item.isPair(); item = item.asPair()->cdr) {
+        sum += item.asPair()->car.asInteger();
+        length++;
+    }
+    CHECK(length == 1000);
+    CHECK(sum == 500500);
+}
+
+void testOldToYoung(Interpreter::Engine engine) {
+    Interpreter interpreter(NURSERY_SIZE);
+    setUp(interpreter, engine);
+    run(interpreter, "(define p (list 1))");
+    collectMajor(interpreter);
+    // p is old now; its cdr is the only reference to a young list.
+    run(interpreter, "(set-cdr! p (list 2 3))");
+    run(interpreter, "(build 1000 '())");
+    CHECK_RUN(interpreter, "p", "(1 2 3)");
+    collectMajor(interpreter);
+    CHECK_RUN(interpreter, "p", "(1 2 3)");
+}
+
+void testLargeObject(Interpreter::Engine engine) {
+    Interpreter interpreter(NURSERY_SIZE);
+    setUp(interpreter, engine);
+    auto& heap = interpreter.getHeap();
+    auto& stats = heap.getStats();
+    Root vector(heap, interpreter.makeF64Vector(1000));
+    auto data = static_cast<F64Vector*>(vector.get().asObject())->data();
+    for (int i = 0; i < 1000; i++) {
+        data[i] = i;
+    }
+    // Minor collections leave it where it is, as they do everything old.
+    auto minor = stats.minorCollections;
+    auto major = stats.majorCollections;
+    run(interpreter, "(build 1000 '())");
+    CHECK(stats.minorCollections > minor);
+    CHECK(stats.majorCollections == major);
+    CHECK(static_cast<F64Vector*>(vector.get().asObject())->data() == data);
+    collectMajor(interpreter);
+    data = static_cast<F64Vector*>(vector.get().asObject())->data();
+    double sum = 0;
+    for (int i = 0; i < 1000; i++) {
+        sum += data[i];
+    }
+    CHECK(sum == 499500);
+
+    // A frame of 200 variables starts old, and a closure keeps it. The
+    // defines after the collection in the middle store young lists into it.
+    std::string big = "(define (big)";
+    for (int i = 0; i < 200; i++) {
+        if (i == 100) {
+            big += " (build 1000 '())";
+        }
+        big += " (define x" + std::to_string(i) + " (list " + std::to_string(i) + "))";
+    }
+    big += " (lambda () (list x0 x100 x199)))";
+    run(interpreter, big);
+    run(interpreter, "(define g (big))");
+    run(interpreter, "(build 1000 '())");
+    CHECK_RUN(interpreter, "(g)", "((0) (100) (199))");
+    collectMajor(interpreter);
+    CHECK_RUN(interpreter, "(g)", "((0) (100) (199))");
+}
+
+// An object of 128 MiB or more has a card table bigger than the first
+// CHUNK_SIZE of its chunk, which must not push the object out of it.
+void testHugeObject() {
+    Interpreter interpreter(NURSERY_SIZE);
+    setUp(interpreter, Interpreter::Engine::VM);
+    auto& heap = interpreter.getHeap();
+    constexpr std::size_t LENGTH = 17'000'000;
+    Root vector(heap, interpreter.makeF64Vector(LENGTH));
+    CHECK(heap.contains(vector.get().asPointer()));
+    auto data = static_cast<F64Vector*>(vector.get().asObject())->data();
+    for (std::size_t i = 0; i < LENGTH; i += 4096) {
+        data[i] = static_cast<double>(i);
+    }
+    data[LENGTH - 1] = -1;
+    auto before = data;
+    collectMajor(interpreter);
+    data = static_cast<F64Vector*>(vector.get().asObject())->data();
+    CHECK(data != before);
+    bool intact = data[LENGTH - 1] == -1;
+    for (std::size_t i = 0; i < LENGTH; i += 4096) {
+        intact = intact && data[i] == static_cast<double>(i);
+    }
+    CHECK(intact);
+}
+
+void testCodeRoots(Interpreter::Engine engine) {
+    Interpreter interpreter(NURSERY_SIZE);
+    setUp(interpreter, engine);
+    // eval copies the datum into code; the closure in it is kept only there.
+    run(interpreter, "(define h (eval (list 'lambda '() (list 'quote (list (lambda () 42))))))");
+    collectMajor(interpreter);
+    CHECK_RUN(interpreter, "((car (h)))", "42");
+
+    // The call of sq is inlined under a guard holding sq's closure.
+    run(interpreter, "(define (sq x) (* x x))");
+    run(interpreter, "(define (f y) (+ (sq y) 1))");
+    collectMajor(interpreter);
+    CHECK_RUN(interpreter, "(f 5)", "26");
+    // Now the guard holds the only reference to the old closure.
+    run(interpreter, "(define (sq x) x)");
+    collectMajor(interpreter);
+    CHECK_RUN(interpreter, "(f 5)", "6");
+}
+
+}  // namespace
+
+int main() {
+    testRootAcrossAllocation();
+    testHugeObject();
+    for (auto engine : {Interpreter::Engine::VM, Interpreter::Engine::TREE}) {
+        testOldToYoung(engine);
+        testLargeObject(engine);
+        testCodeRoots(engine);
+    }
+    return checkFailures();
+}
@@ -0,0 +1,87 @@
+// Tests of procedures called often enough for the VM to compile them, run
+// into each of the guards that send native code back to the interpreter.
+// Every result is compared with the tree engine's.
+
+#include <initializer_list>
+#include <string>
+
+#include "./bytecode.h"
+#include "./check.h"
+#include "./interpreter.h"
+#include "./jit.h"
+#include "./value.h"
+
+namespace {
+
+// Whether the procedure in the global name has native code.
+bool isCompiled(Interpreter& interpreter, const char* name) {
+    auto proc = *interpreter.globalCell(SymbolTable::global().intern(name));
+    return proc.isObject(ObjectType::CLOSURE) &&
+           static_cast<Closure*>(proc.asObject())->prototype->native;
+}
+
+// Runs definitions, then hot 2000 times, then each of exprs, on the VM with
+// the JIT and on the tree engine. The optimizer is off, so that calls are
+// not inlined away.
+void check(const char* definitions, const char* hot, std::initializer_list<const char*> procs,
+           std::initializer_list<const char*> exprs) {
+    Interpreter jit;
+    Interpreter tree;
+    tree.setEngine(Interpreter::Engine::TREE);
+    for (auto interpreter : {&jit, &tree}) {
+        interpreter->setOptimizations({false, false, false, false});
+        run(*interpreter, definitions);
+        run(*interpreter, std::string("(define (warm n) (if (> n 0) (begin ") + hot +
+                              " (warm (- n 1)))))");
+        run(*interpreter, "(warm 2000)");
+    }
+#ifdef MINI_LISP_JIT
+    for (auto proc : procs) {
+        CHECK(isCompiled(jit, proc));
+    }
+#else
+    static_cast<void>(procs);
+#endif
+    for (auto expr : exprs) {
+        CHECK_RUN(jit, expr, run(tree, expr));
+    }
+}
+
+void testFixnumOverflow() {
+    check("(define (add a b) (+ a b))"
+          "(define (sub a b) (- a b))"
+          "(define (mul a b) (* a b))",
+          "(add 1 2) (sub 1 2) (mul 3 4)", {"add", "sub", "mul"},
+          {"(add 140737488355327 1)", "(add -140737488355328 -1)", "(sub -140737488355328 1)",
+           "(sub 140737488355327 -1)", "(mul 140737488355327 2)", "(mul 16777216 16777216)",
+           "(mul -16777216 16777216)", "(add 1.5 2)", "(mul 0.5 3)", "(sub 1 (/ 0.0 0.0))"});
+}
+
+void testCompares() {
+    check("(define (lt a b) (< a b))"
+          "(define (ge a b) (>= a b))"
+          "(define (pick a b) (if (< a b) 'lt 'ge))"
+          "(define (same a b) (if (= a b) 'eq 'ne))",
+          "(lt 1 2) (ge 1 2) (pick 1 2) (pick 2 1) (same 1 1) (same 1 2)",
+          {"lt", "ge", "pick", "same"},
+          {"(lt 1.5 2)", "(lt 2 1.5)", "(ge 0.25 0.5)", "(pick 0.5 0.25)", "(same 1 1.0)",
+           "(lt (/ 0.0 0.0) 1)", "(ge (/ 0.0 0.0) (/ 0.0 0.0))", "(pick (/ 0.0 0.0) 1)",
+           "(pick 1 (/ 0.0 0.0))", "(same (/ 0.0 0.0) (/ 0.0 0.0))", "(lt 'a 1)"});
+}
+
+void testRedefinedBuiltins() {
+    check("(define (add a b) (+ a b))"
+          "(define (down n) (if (< n 3) n (down (- n 1))))",
+          "(add 1 2) (down 5)", {"add", "down"},
+          {"(add 5 3)", "(down 10)", "(define (+ a b) (* a b))", "(add 5 3)",
+           "(define (< a b) (> a b))", "(down 10)"});
+}
+
+}  // namespace
+
+int main() {
+    testFixnumOverflow();
+    testCompares();
+    testRedefinedBuiltins();
+    return checkFailures();
+}
@@ -0,0 +1,145 @@
+// Tests of the Optimizer: what each pass rewrites, and that its guarded
+// rewrites give way when a name they relied on is redefined or shadowed.
+
+#include <string>
+#include <string_view>
+
+#include "./check.h"
+#include "./interpreter.h"
+#include "./optimizer.h"
+#include "./reader.h"
+#include "./tokenizer.h"
+
+namespace {
+
+// The datum of source as the optimizer rewrites it with options.
+std::string optimized(Interpreter& interpreter, std::string_view source,
+                      const Optimizer::Options& options = {}) {
+    TokenRange tokens(source);
+    Reader reader(interpreter.getCodeArena());
+    return Optimizer(interpreter, options).optimize(reader.read(tokens)).toString();
+}
+
+// Each pass, and that turning it off leaves its forms alone.
+void testPasses() {
+    Interpreter interpreter;
+    run(interpreter, "(define (square x) (* x x))");
+    Optimizer::Options noFold;
+    noFold.fold = false;
+    Optimizer::Options noBranches;
+    noBranches.branches = false;
+    Optimizer::Options noInlining;
+    noInlining.inlining = false;
+    Optimizer::Options noLambdaCalls;
+    noLambdaCalls.lambdaCalls = false;
+
+    CHECK(optimized(interpreter, "(* 2 7)") == "(#%guard ((* . #<procedure>)) 14 (* 2 7))");
+    CHECK(optimized(interpreter, "(+ 2.7 10)") ==
+          "(#%guard ((+ . #<procedure>)) 12.7 (+ 2.7 10))");
+    CHECK(optimized(interpreter, "(* 2 7)", noFold) == "(* 2 7)");
+    // Errors are left for the call to report when it runs.
+    CHECK(optimized(interpreter, "(/ 1 0)") == "(/ 1 0)");
+    CHECK(optimized(interpreter, "(+ 1 x)") == "(+ 1 x)");
+
+    CHECK(optimized(interpreter, "(if #t 1 2)") == "1");
+    CHECK(optimized(interpreter, "(if #f 1)") == "(quote ())");
+    CHECK(optimized(interpreter, "(cond (#f 2) (#t 3))") == "(begin 3)");
+    CHECK(optimized(interpreter, "(cond (x 1) (#f 2) (#t 3) (else 4))") ==
+          "(cond (x 1) (else 3))");
+    CHECK(optimized(interpreter, "(if #t 1 2)", noBranches) == "(if #t 1 2)");
+    CHECK(optimized(interpreter, "(cond (#f 2) (#t 3))", noBranches) == "(cond (#f 2) (#t 3))");
+    // A test folded from a global is as guarded as the fold.
+    CHECK(optimized(interpreter, "(if (< 1 2) 'a 'b)") ==
+          "(#%guard ((< . #<procedure>)) (quote a) "
+          "(if (#%guard ((< . #<procedure>)) #t (< 1 2)) (quote a) (quote b)))");
+
+    CHECK(optimized(interpreter, "(square 5)") ==
+          "(#%guard ((square . #<procedure>)) (let ((x 5)) (* x x)) (square 5))");
+    CHECK(optimized(interpreter, "(square 5)", noInlining) == "(square 5)");
+    CHECK(optimized(interpreter, "(square 1 2)") == "(square 1 2)");
+
+    CHECK(optimized(interpreter, "((lambda (x y) (+ x y)) 1 2)") ==
+          "(let ((x 1) (y 2)) (+ x y))");
+    CHECK(optimized(interpreter, "((lambda (x y) (+ x y)) 1 2)", noLambdaCalls) ==
+          "((lambda (x y) (+ x y)) 1 2)");
+    CHECK(optimized(interpreter, "((lambda (x . y) y) 1 2)") == "((lambda (x . y) y) 1 2)");
+}
+
+// A procedure optimized before a name it relied on was redefined sees the
+// new definition, even once it has been compiled to native code.
+void testRedefinition(Interpreter::Engine engine, bool jit) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    interpreter.setJit(jit);
+    run(interpreter,
+        "(define (square x) (* x x))"
+        "(define (f) (square 3))"
+        "(define (g) (* 2 7))"
+        "(define (h) (if (< 1 2) 'less 'more))"
+        "(define (repeat n thunk) (if (= n 1) (thunk) (begin (thunk) (repeat (- n 1) thunk))))");
+    CHECK_RUN(interpreter, "(repeat 2000 f)", "9");
+    CHECK_RUN(interpreter, "(repeat 2000 g)", "14");
+    CHECK_RUN(interpreter, "(repeat 2000 h)", "less");
+    run(interpreter, "(define (square x) (+ x x))");
+    CHECK_RUN(interpreter, "(repeat 2000 f)", "6");
+    run(interpreter, "(define (* a b) (+ a b))");
+    CHECK_RUN(interpreter, "(repeat 2000 g)", "9");
+    CHECK_RUN(interpreter, "(square 5)", "10");
+    run(interpreter, "(define (< a b) #f)");
+    CHECK_RUN(interpreter, "(repeat 2000 h)", "more");
+    run(interpreter, "(define square 'no-longer-a-procedure)");
+    CHECK_RUN(interpreter, "(f)", "Error: Not a procedure: no-longer-a-procedure");
+}
+
+// A name bound locally is not the global the optimizer would inline or fold.
+void testShadowing(Interpreter::Engine engine) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    run(interpreter, "(define (square x) (* x x))");
+    CHECK(optimized(interpreter, "(lambda (square) (square 3))") ==
+          "(lambda (square) (square 3))");
+    CHECK(optimized(interpreter, "(lambda (*) (* 2 7))") == "(lambda (*) (* 2 7))");
+    CHECK_RUN(interpreter, "((lambda (square) (square 3)) -)", "-3");
+    CHECK_RUN(interpreter, "(let ((square car)) (square '(1 2)))", "1");
+    CHECK_RUN(interpreter, "(let ((* +)) (* 2 7))", "9");
+    CHECK_RUN(interpreter, "((lambda () (define (square x) x) (square 4)))", "4");
+    CHECK_RUN(interpreter, "((lambda () (square 4) (define (* a b) (- a b)) (square 4)))", "16");
+    // Nor is a procedure inlined where a global its body uses is bound.
+    run(interpreter, "(define (add-x y) (+ x y)) (define x 10)");
+    CHECK_RUN(interpreter, "(let ((x 1)) (add-x 2))", "12");
+}
+
+// Dropping a branch with a define in it would change which names its body
+// binds, so the branch is kept, and the name stays local.
+void testDroppedDefines(Interpreter::Engine engine) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    run(interpreter, "(define x 5)");
+    CHECK(optimized(interpreter, "(cond (#f (define x 1)) (else 2))") ==
+          "(cond (#f (define x 1)) (else 2))");
+    CHECK(optimized(interpreter, "(cond (#t 1) (else (define x 2)))") ==
+          "(cond (#t 1) (else (define x 2)))");
+    CHECK(optimized(interpreter, "(if #f (define x 1) 2)") == "(if #f (define x 1) 2)");
+    run(interpreter,
+        "(define (f) (cond (#f (define x 1)) (else 2)) x)"
+        "(define (g) (cond (#t 1) (else (define x 2))) x)"
+        "(define (h) (if #f (define x 1)) x)");
+    CHECK_RUN(interpreter, "(f)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "(g)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "(h)", "Error: Variable x is not defined");
+    CHECK_RUN(interpreter, "x", "5");
+}
+
+}  // namespace
+
+int main() {
+    testPasses();
+    testRedefinition(Interpreter::Engine::VM, true);
+    testRedefinition(Interpreter::Engine::VM, false);
+    testRedefinition(Interpreter::Engine::TREE, false);
+    testShadowing(Interpreter::Engine::VM);
+    testShadowing(Interpreter::Engine::TREE);
+    testDroppedDefines(Interpreter::Engine::VM);
+    testDroppedDefines(Interpreter::Engine::TREE);
+    return checkFailures();
+}
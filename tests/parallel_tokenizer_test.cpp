@@ -0,0 +1,131 @@
+// Tests that ParallelTokenizer splits only between top-level forms, never in
+// a string, comment or open list, and that its tokens and errors are the
+// serial Tokenizer's on every thread count.
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "./char_class.h"
+#include "./check.h"
+#include "./corpus.h"
+#include "./parallel_tokenizer.h"
+#include "./tokenizer.h"
+
+namespace {
+
+// Whitespace inside strings, comments and lists, where splitting would be
+// wrong, and between forms, where it is right.
+constexpr std::string_view FORMS =
+    "(define (f x)\n  \"a string ( with ) ; a paren\n and lines\"\n  x) "
+    "; a comment with \"a quote and ( a paren\n"
+    "\"escaped \\\" quote ; (\" "
+    "#t #f 'sym `(a ,b) "
+    "(a (b \"c ) \" ; d )\n e)) "
+    "\"\\\" ) ( \\\" \" \"\\\\\" ( \")\" ) "
+    "12 -3.5e2 . \n\n";
+
+// Checks that each split of input is at whitespace outside any token or
+// list, and that tokenizing the pieces apart gives the tokens of the whole.
+// With a chunkSize of 1, whitespace after each top-level list must be split
+// at too.
+void checkSplits(std::string_view input, std::size_t chunkSize) {
+    auto starts = ParallelTokenizer::splitTopLevel(input, chunkSize);
+    CHECK(!starts.empty() && starts[0] == 0);
+    auto whole = Tokenizer::tokenizeFlat(input);
+    std::string pieces;
+    for (std::size_t i = 0; i < starts.size(); i++) {
+        auto start = starts[i];
+        auto end = i + 1 < starts.size() ? starts[i + 1] : input.size();
+        CHECK(start < end);
+        CHECK(i == 0 || isSpace(input[start]));
+        int depth = 0;
+        for (std::size_t j = 0; j < whole.size() && whole.offset(j) < start; j++) {
+            CHECK(whole.offset(j) + whole.length(j) <= start);
+            if (whole.type(j) == TokenType::LEFT_PAREN) {
+                depth++;
+            } else if (whole.type(j) == TokenType::RIGHT_PAREN && depth > 0) {
+                depth--;
+            }
+        }
+        CHECK(depth == 0);
+        pieces += describeTokens(
+            [&] { return Tokenizer::tokenizeBorrowed(input.substr(start, end - start)); });
+    }
+    CHECK(pieces == describeTokens([&] { return Tokenizer::tokenizeBorrowed(input); }));
+    if (chunkSize > 1) {
+        return;
+    }
+    int depth = 0;
+    for (std::size_t j = 0; j < whole.size(); j++) {
+        if (whole.type(j) == TokenType::LEFT_PAREN) {
+            depth++;
+        } else if (whole.type(j) == TokenType::RIGHT_PAREN && depth > 0 && --depth == 0) {
+            auto after = whole.offset(j) + 1;
+            CHECK(after == input.size() || !isSpace(input[after]) ||
+                  std::find(starts.begin(), starts.end(), after) != starts.end());
+        }
+    }
+}
+
+void testSplits() {
+    std::string input;
+    for (int i = 0; i < 20; i++) {
+        input += FORMS;
+    }
+    for (std::size_t chunkSize : {1, 2, 3, 7, 16, 64, 1000}) {
+        checkSplits(input, chunkSize);
+    }
+    // A list left open is never split, and one closed too often does not
+    // keep the rest from being split.
+    checkSplits("(a b" + input, 16);
+    checkSplits(")) a b" + input, 16);
+    auto unbalanced = ParallelTokenizer::splitTopLevel("(a b" + input, 16);
+    CHECK(unbalanced.size() == 1);
+}
+
+// Compares each way of tokenizing input in parallel with the serial one.
+void checkParallel(const std::string& input) {
+    auto owned = describeTokens([&] { return Tokenizer::tokenize(input); });
+    auto borrowed = describeTokens([&] { return Tokenizer::tokenizeBorrowed(input); });
+    auto flat = describeTokens([&] { return Tokenizer::tokenizeFlat(input); });
+    for (unsigned threads : {2, 5}) {
+        CHECK(describeTokens([&] { return ParallelTokenizer::tokenize(input, threads); }) ==
+              owned);
+        CHECK(describeTokens([&] {
+                  return ParallelTokenizer::tokenizeBorrowed(input, threads);
+              }) == borrowed);
+        CHECK(describeTokens([&] { return ParallelTokenizer::tokenizeFlat(input, threads); }) ==
+              flat);
+    }
+}
+
+// Inputs of several chunks, so that they are split.
+void testEquivalence() {
+    std::string input;
+    while (input.size() < 2 * ParallelTokenizer::MIN_CHUNK_SIZE) {
+        input += FORMS;
+    }
+    CHECK(ParallelTokenizer::splitTopLevel(input, ParallelTokenizer::MIN_CHUNK_SIZE).size() >= 2);
+    auto middle = input.size() / 2;
+    checkParallel(input);
+    checkParallel("(open " + input);
+    checkParallel(")) " + input);
+    // The first error is the serial one, wherever the chunks end.
+    checkParallel(input.substr(0, middle) + " #x " + input.substr(middle) + " #y");
+    checkParallel(input + "\"unterminated");
+    // A stray quote turns the strings after it inside out.
+    checkParallel(input.substr(0, middle) + " \"stray " + input.substr(middle));
+    for (auto kind : ALL_CORPORA) {
+        checkParallel(generateCorpus(kind, 2 * ParallelTokenizer::MIN_CHUNK_SIZE, 3));
+    }
+}
+
+}  // namespace
+
+int main() {
+    testSplits();
+    testEquivalence();
+    return checkFailures();
+}
@@ -0,0 +1,138 @@
+// Tests of the Reader: the datums it builds from each kind of token source,
+// its errors on malformed lists, nesting deeper than the C++ stack would
+// allow, and that what it builds lives in its arena.
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+
+#include "./arena.h"
+#include "./check.h"
+#include "./reader.h"
+#include "./symbol_table.h"
+#include "./tokenizer.h"
+
+namespace {
+
+enum class Source { DEQUE, STREAM, RANGE };
+
+// The datums of source, one per line, read in turn from the given kind of
+// token source; or the message of the first error thrown.
+std::string readAll(std::string_view source, Source kind) {
+    try {
+        Arena arena;
+        Reader reader(arena);
+        std::string result;
+        if (kind == Source::DEQUE) {
+            auto tokens = Tokenizer::tokenizeBorrowed(source);
+            while (!tokens.empty()) {
+                result += reader.read(tokens).toString() + "\n";
+            }
+        } else if (kind == Source::STREAM) {
+            auto tokens = Tokenizer::tokenizeFlat(source);
+            std::size_t pos = 0;
+            while (pos < tokens.size()) {
+                result += reader.read(tokens, pos).toString() + "\n";
+            }
+        } else {
+            TokenRange tokens(source);
+            while (tokens.begin() != tokens.end()) {
+                result += reader.read(tokens).toString() + "\n";
+            }
+        }
+        return result;
+    } catch (std::runtime_error& e) {
+        return std::string("Error: ") + e.what();
+    }
+}
+
+// Checks that every kind of source reads source as expected.
+void checkRead(std::string_view source, const std::string& expected) {
+    for (auto kind : {Source::DEQUE, Source::STREAM, Source::RANGE}) {
+        auto actual = readAll(source, kind);
+        if (actual != expected) {
+            std::cerr << "reading " << source << " from source " << static_cast<int>(kind)
+                      << " gave " << actual << ", expected " << expected << std::endl;
+            checkFailures()++;
+        }
+    }
+}
+
+void testDatums() {
+    checkRead("", "");
+    checkRead("x 42 -1.5 #t #f \"s\\\"q\" ()", "x\n42\n-1.5\n#t\n#f\n\"s\\\"q\"\n()\n");
+    checkRead("(a (b . c) (d . (e f)) (g . ()) ((h) . i))",
+              "(a (b . c) (d e f) (g) ((h) . i))\n");
+    checkRead("'a `(b ,c) ''d '(e . f)",
+              "(quote a)\n(quasiquote (b (unquote c)))\n(quote (quote d))\n(quote (e . f))\n");
+    checkRead("(define (f x) ; comment\n  x)\n(f 1)", "(define (f x) x)\n(f 1)\n");
+}
+
+void testErrors() {
+    checkRead("(a", "Error: Unexpected end of input");
+    checkRead("(a (b c)", "Error: Unexpected end of input");
+    checkRead("'", "Error: Unexpected end of input");
+    checkRead("(a . ", "Error: Unexpected end of input");
+    checkRead(")", "Error: Unexpected token");
+    checkRead(".", "Error: Unexpected token");
+    checkRead("(. a)", "Error: Unexpected token");
+    checkRead("(a .)", "Error: Unexpected token");
+    checkRead("(a . b c)", "Error: Expected ')'");
+    checkRead("(a . b . c)", "Error: Expected ')'");
+    // The datums before the error are read; the error comes at it.
+    checkRead("(a) b )", "Error: Unexpected token");
+}
+
+// Nesting and lengths that would overflow the C++ stack if reading or
+// printing recursed on them.
+void testDepth() {
+    constexpr std::size_t DEPTH = 1000000;
+    auto nested = std::string(DEPTH, '(') + "x" + std::string(DEPTH, ')');
+    checkRead(nested, nested + "\n");
+    std::string quoted;
+    for (std::size_t i = 0; i < DEPTH; i++) {
+        quoted += "(quote ";
+    }
+    quoted += "x" + std::string(DEPTH, ')');
+    checkRead(std::string(DEPTH, '\'') + "x", quoted + "\n");
+    std::string list = "(";
+    for (std::size_t i = 0; i < DEPTH; i++) {
+        list += "(a . b) ";
+    }
+    list.back() = ')';
+    checkRead(list, list + "\n");
+    checkRead(std::string(DEPTH, '('), "Error: Unexpected end of input");
+}
+
+// Pairs and strings are allocated from the arena, so a datum outlives the
+// source text and tokens it was read from.
+void testArena() {
+    Arena arena;
+    Reader reader(arena);
+    Value datum;
+    {
+        std::string source = "(name \"plain\" \"esc\\\"aped\")";
+        auto tokens = Tokenizer::tokenizeBorrowed(source);
+        datum = reader.read(tokens);
+        tokens.clear();
+        source.assign(source.size(), '?');
+    }
+    CHECK(arena.bytesUsed() > 0);
+    CHECK(datum.toString() == "(name \"plain\" \"esc\\\"aped\")");
+    auto first = datum.asPair();
+    CHECK(first->car.isSymbol());
+    CHECK(first->car.asSymbol() == SymbolTable::global().intern("name"));
+    auto second = first->cdr.asPair();
+    CHECK(second->car.isString() && second->car.asString()->text == "plain");
+}
+
+}  // namespace
+
+int main() {
+    testDatums();
+    testErrors();
+    testDepth();
+    testArena();
+    return checkFailures();
+}
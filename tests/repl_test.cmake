@@ -0,0 +1,17 @@
+# Feeds the REPL a datum with a tokenizer error in the middle, then two
+# more, which must still be evaluated.
+#
+# Usage: cmake -DMINI_LISP=<path> -DINPUT=<scratch file> -P repl_test.cmake
+
+file(WRITE ${INPUT} "(define x\n#q)\n(+ 1 2)\n(+ 3 4)\n")
+execute_process(
+  COMMAND ${MINI_LISP}
+  INPUT_FILE ${INPUT}
+  OUTPUT_VARIABLE output
+  ERROR_VARIABLE errors)
+if(NOT errors MATCHES "Error: ")
+  message(FATAL_ERROR "No error reported:\n${errors}")
+endif()
+if(NOT output MATCHES ">>> 3\n>>> 7\n")
+  message(FATAL_ERROR "Unexpected output:\n${output}")
+endif()
@@ -0,0 +1,134 @@
+// Tests that the SSE2 and AVX2 scan kernels tokenize exactly as the scalar
+// ones do: the same tokens at the same offsets, and the same errors, with
+// each kind of token starting and ending at every position within the
+// blocks the kernels load.
+
+#include <cstddef>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "./char_class.h"
+#include "./check.h"
+#include "./corpus.h"
+#include "./tokenizer.h"
+
+namespace {
+
+const char* levelName(ScanLevel level) {
+    switch (level) {
+        case ScanLevel::SCALAR: return "scalar";
+        case ScanLevel::SSE2: return "sse2";
+        default: return "avx2";
+    }
+}
+
+// Past a 32-byte block either side of INLINE_SCAN_BYTES.
+constexpr std::size_t MAX_LENGTH = 72;
+
+enum Piece {
+    SPACE,
+    IDENTIFIER,
+    NUMBER,
+    STRING,
+    ESCAPED_STRING,
+    COMMENT,
+    HASH,
+    PIECE_COUNT,
+};
+
+// A run of length characters scanned by one kernel, and what ends it.
+// Bytes of 0x80 and above are included, as signed compares get them wrong.
+std::string piece(Piece kind, std::size_t length) {
+    auto fill = [length](std::string_view chars) {
+        std::string text;
+        for (std::size_t i = 0; i < length; i++) {
+            text += chars[i % chars.size()];
+        }
+        return text;
+    };
+    switch (kind) {
+        case SPACE: return "a" + fill(" \t\n\v\f\r") + "b";
+        case IDENTIFIER: return fill("ab-?.\x80\xff!0#;") + "(";
+        case NUMBER: return "1" + fill("0123456789") + ")";
+        case STRING: return '"' + fill("x (;'\x80\xff#") + "\" ";
+        // The escape is where the kernel stops early.
+        case ESCAPED_STRING: return '"' + fill("x\\\"y\\n\\\\") + "\\\"\"";
+        case COMMENT: return ';' + fill("c \"(\x80\t") + "\nd";
+        default: return "#t#f";
+    }
+}
+
+// Tokenizes source at every level and checks each against the scalar one.
+// The source is copied to a buffer of its exact size, so that a kernel
+// reading past the end is caught under a sanitizer.
+void check(std::string_view source) {
+    std::vector<char> buffer(source.begin(), source.end());
+    std::string_view input(buffer.data(), buffer.size());
+    std::string expected[2];
+    for (auto level : {ScanLevel::SCALAR, ScanLevel::SSE2, ScanLevel::AVX2}) {
+        if (setScanLevel(level) != level) {
+            continue;
+        }
+        std::string actual[]{
+            describeTokens([input] { return Tokenizer::tokenizeBorrowed(input); }),
+            describeTokens([input] { return Tokenizer::tokenizeFlat(input); }),
+        };
+        for (int i = 0; i < 2; i++) {
+            if (level == ScanLevel::SCALAR) {
+                expected[i] = actual[i];
+            } else if (actual[i] != expected[i]) {
+                std::cerr << levelName(level) << " differs from scalar on \"" << source
+                          << "\":\n" << actual[i] << "instead of\n" << expected[i];
+                checkFailures()++;
+            }
+        }
+    }
+}
+
+// Each piece of each length, after each amount of padding.
+void testAlignment() {
+    for (std::size_t pad = 0; pad <= 64; pad++) {
+        for (int kind = 0; kind < PIECE_COUNT; kind++) {
+            for (std::size_t length = 0; length <= MAX_LENGTH; length++) {
+                auto text = piece(static_cast<Piece>(kind), length);
+                check(std::string(pad, '(') + text + " x");
+                // And ending the input, where some are errors.
+                check(std::string(pad, ' ') + text.substr(0, text.size() - 1));
+            }
+        }
+    }
+}
+
+// Pieces run together in random order, with errors at the end of some.
+void testRandom() {
+    const char* errors[]{"", "", "\"open", "\"escape at end\\", "#x", "#"};
+    std::mt19937 random(7);
+    for (int i = 0; i < 2000; i++) {
+        std::string source;
+        for (auto count = random() % 40; count > 0; count--) {
+            auto kind = static_cast<Piece>(random() % PIECE_COUNT);
+            auto text = piece(kind, random() % MAX_LENGTH);
+            source += text.substr(0, text.size() - random() % 2);
+        }
+        check(source + errors[random() % std::size(errors)]);
+    }
+}
+
+void testCorpora() {
+    for (auto kind : ALL_CORPORA) {
+        check(generateCorpus(kind, 64 * 1024, 1));
+    }
+}
+
+}  // namespace
+
+int main() {
+    testAlignment();
+    testRandom();
+    testCorpora();
+    setScanLevel(detectScanLevel());
+    return checkFailures();
+}
@@ -0,0 +1,116 @@
+// Tests that promises run their expression once however often they are
+// forced, that stream operations force each element once, and that a long
+// pipeline runs on a tiny nursery, on either engine.
+
+#include <cstddef>
+
+#include "./check.h"
+#include "./interpreter.h"
+
+namespace {
+
+// Small enough that a pipeline collects every few elements.
+constexpr std::size_t NURSERY_SIZE = 4096;
+
+// Defines (tick!), which counts its calls in (count).
+void setUp(Interpreter& interpreter, Interpreter::Engine engine, bool jit) {
+    interpreter.setEngine(engine);
+    interpreter.setJit(jit);
+    run(interpreter,
+        "(define counter (list 0))"
+        "(define (tick!) (set-car! counter (+ (car counter) 1)))"
+        "(define (count) (car counter))"
+        "(define (reset!) (set-car! counter 0))");
+}
+
+void testPromises(Interpreter::Engine engine, bool jit) {
+    Interpreter interpreter;
+    setUp(interpreter, engine, jit);
+    run(interpreter, "(define p (delay (begin (tick!) 42)))");
+    CHECK_RUN(interpreter, "(count)", "0");
+    CHECK_RUN(interpreter, "(promise? p)", "#t");
+    CHECK_RUN(interpreter, "(list (force p) (force p) (force p))", "(42 42 42)");
+    CHECK_RUN(interpreter, "(count)", "1");
+    // Each evaluation of delay makes a promise of its own.
+    CHECK_RUN(interpreter,
+              "(define (make) (delay (begin (tick!) 'made)))"
+              "(let ((a (make)) (b (make))) (force a) (force a) (force b) (count))",
+              "3");
+    CHECK_RUN(interpreter, "(force (make-promise 5))", "5");
+    CHECK_RUN(interpreter, "(force 5)", "5");
+
+    // The rest of a stream is a promise too.
+    run(interpreter,
+        "(reset!)"
+        "(define s (cons-stream 1 (begin (tick!) (cons-stream 2 '()))))");
+    CHECK_RUN(interpreter, "(count)", "0");
+    CHECK_RUN(interpreter, "(eq? (stream-cdr s) (stream-cdr s))", "#t");
+    CHECK_RUN(interpreter, "(stream-car (stream-cdr s))", "2");
+    CHECK_RUN(interpreter, "(count)", "1");
+}
+
+// The operations call their procedure once per element forced, and no more
+// when an element is forced again.
+void testStreamOperations(Interpreter::Engine engine, bool jit) {
+    Interpreter interpreter;
+    setUp(interpreter, engine, jit);
+    run(interpreter,
+        "(define (traced x) (tick!) (* x x))"
+        "(define (traced-even? x) (tick!) (even? x))"
+        "(define squares (stream-map traced (stream-enumerate-interval 1 1000000000)))");
+    // As in SICP, the first element is worked out when the stream is made.
+    CHECK_RUN(interpreter, "(count)", "1");
+    CHECK_RUN(interpreter, "(stream-ref squares 9)", "100");
+    CHECK_RUN(interpreter, "(count)", "10");
+    CHECK_RUN(interpreter, "(stream-head squares 10)", "(1 4 9 16 25 36 49 64 81 100)");
+    CHECK_RUN(interpreter, "(stream-ref squares 4)", "25");
+    CHECK_RUN(interpreter, "(count)", "10");
+
+    run(interpreter,
+        "(reset!)"
+        "(define evens (stream-filter traced-even? (stream-enumerate-interval 1 1000000000)))");
+    CHECK_RUN(interpreter, "(count)", "2");
+    CHECK_RUN(interpreter, "(stream-ref evens 4)", "10");
+    CHECK_RUN(interpreter, "(count)", "10");
+    CHECK_RUN(interpreter, "(stream-head evens 5)", "(2 4 6 8 10)");
+    CHECK_RUN(interpreter, "(count)", "10");
+
+    CHECK_RUN(interpreter,
+              "(stream->list (stream-map + squares (stream-enumerate-interval 1 3)))",
+              "(2 6 12)");
+    CHECK_RUN(interpreter, "(stream-head (stream-enumerate-interval 1 3) 5)",
+              "Error: stream-head: expected a pair, got ()");
+}
+
+// The pipelines collect many times over on the tiny nursery, with each
+// element garbage once they have gone past it.
+void testLongPipeline(Interpreter::Engine engine, bool jit) {
+    Interpreter interpreter(NURSERY_SIZE);
+    setUp(interpreter, engine, jit);
+    CHECK_RUN(interpreter,
+              "(stream-ref (stream-filter even? (stream-map (lambda (x) (* x 3))"
+              "                                             (stream-enumerate-interval 1 1e9)))"
+              "            100000)",
+              "600006");
+    CHECK_RUN(interpreter,
+              "(define (ints n) (cons-stream n (ints (+ n 1))))"
+              "(define (smap f s) (cons-stream (f (stream-car s)) (smap f (stream-cdr s))))"
+              "(stream-ref (smap (lambda (x) (+ x 1)) (ints 0)) 100000)",
+              "100001");
+    CHECK(interpreter.getHeap().getStats().majorCollections > 0);
+}
+
+}  // namespace
+
+int main() {
+    testPromises(Interpreter::Engine::VM, true);
+    testPromises(Interpreter::Engine::VM, false);
+    testPromises(Interpreter::Engine::TREE, false);
+    testStreamOperations(Interpreter::Engine::VM, true);
+    testStreamOperations(Interpreter::Engine::VM, false);
+    testStreamOperations(Interpreter::Engine::TREE, false);
+    testLongPipeline(Interpreter::Engine::VM, true);
+    testLongPipeline(Interpreter::Engine::VM, false);
+    testLongPipeline(Interpreter::Engine::TREE, false);
+    return checkFailures();
+}
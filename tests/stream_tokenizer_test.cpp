@@ -0,0 +1,114 @@
+// Tests that StreamTokenizer gives the serial Tokenizer's tokens and errors
+// however its input is cut into chunks, in push and pull mode.
+
+#include <cstddef>
+#include <deque>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "./check.h"
+#include "./stream_tokenizer.h"
+#include "./tokenizer.h"
+
+namespace {
+
+constexpr std::string_view SOURCE =
+    "(define (f x) ; a comment \"with a quote\n"
+    "  (display \"a (string)\\n with \\\"escapes\\\"\" 'x `(,x . -1.5e3)))\n"
+    "#t #f 123456789012345678901234567890 identifier-spanning-chunks \"\"";
+
+// Tokens of source fed in chunks of the given sizes, repeating the last.
+std::deque<TokenPtr> feedChunks(std::string_view source,
+                                std::initializer_list<std::size_t> sizes) {
+    StreamTokenizer tokenizer;
+    std::deque<TokenPtr> tokens;
+    auto size = sizes.begin();
+    while (!source.empty()) {
+        auto chunk = source.substr(0, *size);
+        tokenizer.feed(chunk, tokens);
+        source.remove_prefix(chunk.size());
+        if (size + 1 != sizes.end()) {
+            size++;
+        }
+    }
+    tokenizer.finish(tokens);
+    return tokens;
+}
+
+// Every split of each source into two chunks, and chunks of a few sizes.
+void testChunks() {
+    for (std::string_view source : {SOURCE, std::string_view("\"open"), std::string_view("#"),
+                                    std::string_view("a #x b"), std::string_view("word")}) {
+        auto expected = describeTokens([&] { return Tokenizer::tokenizeBorrowed(source); });
+        for (std::size_t split = 0; split <= source.size(); split++) {
+            CHECK(describeTokens([&] { return feedChunks(source, {split, source.size()}); }) ==
+                  expected);
+        }
+        for (std::size_t size : {1, 2, 3, 7, 64}) {
+            CHECK(describeTokens([&] { return feedChunks(source, {size}); }) == expected);
+        }
+    }
+}
+
+void testState() {
+    StreamTokenizer tokenizer;
+    std::deque<TokenPtr> tokens;
+    CHECK(tokenizer.isIdle());
+    tokenizer.feed("(abc", tokens);
+    CHECK(!tokenizer.isIdle());
+    CHECK(tokens.size() == 1);
+    tokenizer.feed("def) ; comment", tokens);
+    CHECK(tokenizer.isIdle());
+    CHECK(tokens.size() == 3);
+    CHECK(static_cast<const IdentifierToken&>(*tokens[1]).getName() == "abcdef");
+    tokenizer.feed("\n\"a string", tokens);
+    CHECK(!tokenizer.isIdle());
+
+    // After an error, reset() drops the partial token and the next chunk
+    // starts afresh.
+    tokens.clear();
+    tokenizer.reset();
+    tokenizer.feed("#", tokens);
+    CHECK(describeTokens([&] {
+              tokenizer.feed("x", tokens);
+              return std::move(tokens);
+          }) == "Error: Unexpected character after #");
+    tokenizer.reset();
+    tokens.clear();
+    tokenizer.feed("(ok)", tokens);
+    tokenizer.finish(tokens);
+    CHECK(tokens.size() == 3);
+}
+
+// Tokens pulled with next() from a stream read through a buffer of size.
+std::deque<TokenPtr> pull(std::string_view source, std::size_t size) {
+    std::istringstream in{std::string(source)};
+    StreamTokenizer tokenizer(in, size);
+    std::deque<TokenPtr> tokens;
+    while (auto token = tokenizer.next()) {
+        tokens.push_back(std::move(token));
+    }
+    CHECK(!tokenizer.next());
+    return tokens;
+}
+
+void testPull() {
+    auto expected = describeTokens([] { return Tokenizer::tokenizeBorrowed(SOURCE); });
+    const std::size_t sizes[]{1, 5, 64, StreamTokenizer::DEFAULT_BUFFER_SIZE};
+    for (auto size : sizes) {
+        CHECK(describeTokens([&] { return pull(SOURCE, size); }) == expected);
+    }
+    CHECK(describeTokens([] { return pull("(a \"open", 4); }) ==
+          "Error: Unexpected end of string literal");
+}
+
+}  // namespace
+
+int main() {
+    testChunks();
+    testState();
+    testPull();
+    return checkFailures();
+}
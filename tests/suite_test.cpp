@@ -0,0 +1,61 @@
+// Runs the rjsj_test suites against one configuration of the interpreter.
+//
+// Usage: mini_lisp_suite_test [--engine=vm|tree] [--no-jit] [--no-optimize]
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "./interpreter.h"
+#include "./reader.h"
+#include "./rjsj_test.hpp"
+#include "./tokenizer.h"
+
+namespace {
+
+struct Options {
+    Interpreter::Engine engine{Interpreter::Engine::VM};
+    bool jit{true};
+    Optimizer::Options optimizations;
+};
+
+Options options;
+
+// Each suite gets a fresh environment.
+struct TestEnv {
+    std::unique_ptr<Interpreter> interpreter = [] {
+        auto interpreter = std::make_unique<Interpreter>();
+        interpreter->setEngine(options.engine);
+        interpreter->setJit(options.jit);
+        interpreter->setOptimizations(options.optimizations);
+        return interpreter;
+    }();
+
+    std::string eval(const std::string& input) {
+        TokenRange tokens(input);
+        Reader reader(interpreter->getCodeArena());
+        return interpreter->eval(reader.read(tokens)).toString();
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    for (int arg = 1; arg < argc; arg++) {
+        std::string_view option = argv[arg];
+        if (option == "--engine=vm") {
+            options.engine = Interpreter::Engine::VM;
+        } else if (option == "--engine=tree") {
+            options.engine = Interpreter::Engine::TREE;
+        } else if (option == "--no-jit") {
+            options.jit = false;
+        } else if (option == "--no-optimize") {
+            options.optimizations = {false, false, false, false};
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+    RJSJ_TEST(TestEnv, Lv2, Lv3, Lv4, Lv5, Lv5Extra, Lv6, Lv7, Lv7Lib, Sicp);
+}
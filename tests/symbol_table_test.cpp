@@ -0,0 +1,111 @@
+// Tests of SymbolTable: dense ids, names that stay put as the table grows,
+// and interning from several threads at once.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "./check.h"
+#include "./symbol_table.h"
+#include "./tokenizer.h"
+
+namespace {
+
+void testIntern() {
+    SymbolTable table;
+    CHECK(table.size() == 0);
+    CHECK(table.intern("car") == 0);
+    CHECK(table.intern("cdr") == 1);
+    CHECK(table.intern("car") == 0);
+    CHECK(table.size() == 2);
+    CHECK(table.find("cdr") == 1);
+    CHECK(!table.find("cons"));
+    CHECK(table.size() == 2);
+
+    // Names are copied, and may hold any bytes.
+    std::string name("with\0nul\xff", 9);
+    auto id = table.intern(name);
+    name[0] = '?';
+    CHECK(table.name(id) == std::string_view("with\0nul\xff", 9));
+    CHECK(table.intern("") == 3);
+    CHECK(table.name(3).empty());
+}
+
+// Past several index doublings, pages of ids and blocks of names, with
+// names too long to share a block.
+void testGrowth() {
+    SymbolTable table;
+    std::vector<std::string_view> first;
+    for (int i = 0; i < 100; i++) {
+        first.push_back(table.name(table.intern("name" + std::to_string(i))));
+    }
+    std::string longName(40000, 'x');
+    for (int i = 100; i < 100000; i++) {
+        auto id = table.intern(i % 10000 == 0 ? longName + std::to_string(i)
+                                              : "name" + std::to_string(i));
+        CHECK(id == static_cast<SymbolId>(i));
+    }
+    CHECK(table.size() == 100000);
+    bool same = true;
+    for (int i = 0; i < 100000; i++) {
+        auto text = i % 10000 == 0 && i > 0 ? longName + std::to_string(i)
+                                            : "name" + std::to_string(i);
+        same = same && table.find(text) == static_cast<SymbolId>(i) &&
+               table.name(static_cast<SymbolId>(i)) == text;
+    }
+    CHECK(same);
+    for (int i = 0; i < 100; i++) {
+        CHECK(table.name(static_cast<SymbolId>(i)).data() == first[i].data());
+    }
+}
+
+// Threads intern the same names in different orders; each name gets one id.
+void testThreads() {
+    SymbolTable table(true);
+    constexpr int NAMES = 20000;
+    constexpr int THREADS = 4;
+    std::vector<std::vector<SymbolId>> ids(THREADS, std::vector<SymbolId>(NAMES));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&, t] {
+            for (int j = 0; j < NAMES; j++) {
+                auto i = t % 2 == 0 ? j : NAMES - 1 - j;
+                ids[t][i] = table.intern("symbol" + std::to_string(i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(table.size() == NAMES);
+    bool same = true;
+    for (int i = 0; i < NAMES; i++) {
+        for (int t = 1; t < THREADS; t++) {
+            same = same && ids[t][i] == ids[0][i];
+        }
+        same = same && table.name(ids[0][i]) == "symbol" + std::to_string(i);
+    }
+    CHECK(same);
+}
+
+// The tokenizer interns identifiers in the global table.
+void testGlobal() {
+    auto tokens = Tokenizer::tokenizeBorrowed("(a-symbol-of-this-test)");
+    auto& identifier = static_cast<const IdentifierToken&>(*tokens[1]);
+    CHECK(identifier.getSymbol() == SymbolTable::global().intern("a-symbol-of-this-test"));
+    CHECK(identifier.getName().data() ==
+          SymbolTable::global().name(identifier.getSymbol()).data());
+    CHECK(IdentifierToken("a-symbol-of-this-test").getSymbol() == identifier.getSymbol());
+}
+
+}  // namespace
+
+int main() {
+    testIntern();
+    testGrowth();
+    testThreads();
+    testGlobal();
+    return checkFailures();
+}
@@ -0,0 +1,45 @@
+// Tests that calls in tail position take no native stack on either engine,
+// through each form that passes tail position on to an operand.
+
+#include "./check.h"
+#include "./interpreter.h"
+
+namespace {
+
+void testTailCalls(Interpreter::Engine engine, bool jit) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    interpreter.setJit(jit);
+    run(interpreter,
+        "(define (loop n acc) (if (= n 0) acc (loop (- n 1) (+ acc 1))))"
+        "(define (ints n) (cons-stream n (ints (+ n 1))))"
+        "(define (drop s n) (if (= n 0) (stream-car s) (drop (stream-cdr s) (- n 1))))"
+        "(define (even? n) (if (= n 0) #t (odd? (- n 1))))"
+        "(define (odd? n) (if (= n 0) #f (even? (- n 1))))"
+        "(define (forms n)"
+        "  (cond ((= n 0) 'done)"
+        "        (else (let ((m (- n 1)))"
+        "                (define k m)"
+        "                (begin (and #t (or #f (forms k))))))))"
+        "(define (deep n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))");
+    CHECK_RUN(interpreter, "(loop 10000000 0)", "10000000");
+    CHECK_RUN(interpreter, "(drop (ints 0) 3000000)", "3000000");
+    CHECK_RUN(interpreter, "(even? 1000001)", "#f");
+    CHECK_RUN(interpreter, "(forms 1000000)", "done");
+    CHECK_RUN(interpreter,
+              "((lambda (f) (f f 1000000)) (lambda (f n) (if (= n 0) 'ok (f f (- n 1)))))", "ok");
+    // A tail call still checks its arguments.
+    CHECK_RUN(interpreter, "(define (bad n) (loop n)) (bad 1)", "Error: Too few arguments");
+    // Calls outside tail position still nest.
+    CHECK_RUN(interpreter, "(deep 10000000)", "Error: Maximum recursion depth exceeded");
+    CHECK_RUN(interpreter, "(deep 1000)", "1000");
+}
+
+}  // namespace
+
+int main() {
+    testTailCalls(Interpreter::Engine::VM, true);
+    testTailCalls(Interpreter::Engine::VM, false);
+    testTailCalls(Interpreter::Engine::TREE, false);
+    return checkFailures();
+}
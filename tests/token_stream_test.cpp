@@ -0,0 +1,117 @@
+// Tests of the flat TokenStream: what it records for each token, that it
+// gives the same tokens as the deque of Token objects, and that streams
+// joined with append() keep the text of their escaped literals.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include "./check.h"
+#include "./symbol_table.h"
+#include "./token_stream.h"
+#include "./tokenizer.h"
+
+namespace {
+
+constexpr std::string_view SOURCE =
+    "(define x 42) ; comment\n"
+    "'(1.5 . \"plain\") `(,y \"esc\\\"aped\") #t #f -7 1e400 \"a\\nb\"";
+
+void testFields() {
+    auto tokens = Tokenizer::tokenizeFlat(SOURCE);
+    CHECK(tokens.size() == 22);
+    CHECK(tokens.getSource().data() == SOURCE.data());
+
+    CHECK(tokens.type(1) == TokenType::IDENTIFIER);
+    CHECK(tokens.offset(1) == 1);
+    CHECK(tokens.length(1) == 6);
+    CHECK(tokens.symbol(1) == SymbolTable::global().intern("define"));
+    CHECK(tokens.text(1) == "define");
+    CHECK(tokens.type(3) == TokenType::INTEGER_LITERAL);
+    CHECK(tokens.integer(3) == 42);
+    CHECK(tokens.type(7) == TokenType::NUMERIC_LITERAL);
+    CHECK(tokens.number(7) == 1.5);
+    CHECK(tokens.type(8) == TokenType::DOT);
+
+    // A plain literal spans its contents in the source; an escaped one
+    // keeps its decoded text apart.
+    CHECK(tokens.type(9) == TokenType::STRING_LITERAL);
+    CHECK(tokens.text(9) == "plain");
+    CHECK(tokens.text(9).data() == SOURCE.data() + tokens.offset(9));
+    CHECK(tokens.text(15) == "esc\"aped");
+    CHECK(tokens.length(15) == 9);
+
+    CHECK(tokens.type(17) == TokenType::BOOLEAN_LITERAL && tokens.boolean(17));
+    CHECK(tokens.type(18) == TokenType::BOOLEAN_LITERAL && !tokens.boolean(18));
+    CHECK(tokens.integer(19) == -7);
+    CHECK(tokens.type(20) == TokenType::NUMERIC_LITERAL);
+    CHECK(tokens.number(20) > 1e308);
+    CHECK(tokens.text(21) == "a\nb");
+}
+
+void testSameTokens() {
+    auto flat = Tokenizer::tokenizeFlat(SOURCE);
+    auto tokens = Tokenizer::tokenizeBorrowed(SOURCE);
+    CHECK(flat.size() == tokens.size());
+    for (std::size_t i = 0; i < flat.size() && i < tokens.size(); i++) {
+        CHECK(flat.type(i) == tokens[i]->getType());
+        CHECK(flat.toString(i) == tokens[i]->toString());
+        CHECK(flat.toToken(i)->toString() == tokens[i]->toString());
+    }
+}
+
+// A stream scanned from a prefix, then one pushed by hand for the rest of
+// the source, appended to an empty stream over it.
+void testAppend() {
+    auto whole = Tokenizer::tokenizeFlat(SOURCE);
+    auto split = SOURCE.find("#t");
+    auto prefix = Tokenizer::tokenizeFlat(SOURCE.substr(0, split));
+    TokenStream rest(SOURCE);
+    for (auto i = prefix.size(); i < whole.size(); i++) {
+        Lexeme lexeme{whole.type(i), whole.offset(i), whole.length(i)};
+        auto text = whole.text(i);
+        switch (lexeme.type) {
+            case TokenType::NUMERIC_LITERAL: lexeme.number = whole.number(i); break;
+            case TokenType::INTEGER_LITERAL: lexeme.integer = whole.integer(i); break;
+            case TokenType::IDENTIFIER: lexeme.symbol = whole.symbol(i); break;
+            case TokenType::BOOLEAN_LITERAL: lexeme.boolean = whole.boolean(i); break;
+            case TokenType::STRING_LITERAL:
+                lexeme.escaped = text.data() != SOURCE.data() + whole.offset(i);
+                break;
+            default: break;
+        }
+        rest.push(lexeme, text);
+    }
+    TokenStream joined(SOURCE);
+    joined.reserve(whole.size());
+    joined.append(prefix);
+    joined.append(rest);
+    CHECK(joined.size() == whole.size());
+    for (std::size_t i = 0; i < joined.size() && i < whole.size(); i++) {
+        CHECK(joined.offset(i) == whole.offset(i));
+        CHECK(joined.toString(i) == whole.toString(i));
+    }
+    CHECK(joined.text(15) == "esc\"aped");
+    CHECK(joined.text(21) == "a\nb");
+}
+
+// Nothing is allocated per token beyond its place in the arrays.
+void testMemory() {
+    std::string source;
+    for (int i = 0; i < 10000; i++) {
+        source += "(f x \"s\") ";
+    }
+    auto tokens = Tokenizer::tokenizeFlat(source);
+    CHECK(tokens.size() == 50000);
+    CHECK(tokens.memoryUsage() <= 2 * tokens.size() * 17);
+}
+
+}  // namespace
+
+int main() {
+    testFields();
+    testSameTokens();
+    testAppend();
+    testMemory();
+    return checkFailures();
+}
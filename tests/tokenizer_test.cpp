@@ -0,0 +1,189 @@
+// Tests of the serial Tokenizer: which string literals borrow their text
+// from the source and which own it, which words are numbers, and how a
+// TokenRange scans on demand.
+
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "./arena.h"
+#include "./check.h"
+#include "./reader.h"
+#include "./token.h"
+#include "./tokenizer.h"
+
+namespace {
+
+const StringLiteralToken& literal(const TokenPtr& token) {
+    return static_cast<const StringLiteralToken&>(*token);
+}
+
+// Whether text lies within source.
+bool within(std::string_view text, std::string_view source) {
+    return text.data() >= source.data() &&
+           text.data() + text.size() <= source.data() + source.size();
+}
+
+void testBorrowed() {
+    std::string_view source = "(f \"plain\" \"say \\\"hi\\\"\" \"\" \"a\\nb\" \"back\\\\slash\" x)";
+    auto tokens = Tokenizer::tokenizeBorrowed(source);
+    CHECK(tokens.size() == 9);
+    // Escape-free literals are slices of the source, after the quote.
+    auto& plain = literal(tokens[2]);
+    CHECK(plain.isBorrowed());
+    CHECK(plain.getValue() == "plain");
+    CHECK(plain.getValue().data() == source.data() + source.find("plain"));
+    CHECK(literal(tokens[4]).getValue().empty());
+    // Literals with escapes are decoded into text of their own, each kept
+    // apart from the others decoded through the same scratch buffer.
+    auto& quoted = literal(tokens[3]);
+    CHECK(!quoted.isBorrowed());
+    CHECK(quoted.getValue() == "say \"hi\"");
+    CHECK(!within(quoted.getValue(), source));
+    CHECK(literal(tokens[5]).getValue() == "a\nb");
+    CHECK(literal(tokens[6]).getValue() == "back\\slash");
+    CHECK(static_cast<const IdentifierToken&>(*tokens[7]).getName() == "x");
+}
+
+// Tokens from tokenize() own all their text, and outlive the input.
+void testOwned() {
+    std::deque<TokenPtr> tokens;
+    {
+        std::string source = "\"plain\" \"esc\\\"aped\" name";
+        tokens = Tokenizer::tokenize(source);
+        for (auto& token : tokens) {
+            if (token->getType() == TokenType::STRING_LITERAL) {
+                CHECK(!literal(token).isBorrowed());
+            }
+        }
+        source.assign(source.size(), '?');
+    }
+    CHECK(tokens.size() == 3);
+    CHECK(literal(tokens[0]).getValue() == "plain");
+    CHECK(literal(tokens[1]).getValue() == "esc\"aped");
+    CHECK(static_cast<const IdentifierToken&>(*tokens[2]).getName() == "name");
+}
+
+// The single token text scans to.
+TokenPtr scanOne(std::string_view text) {
+    auto tokens = Tokenizer::tokenizeBorrowed(text);
+    CHECK(tokens.size() == 1);
+    return tokens.empty() ? nullptr : std::move(tokens[0]);
+}
+
+bool isInteger(std::string_view text, std::int64_t value) {
+    auto token = scanOne(text);
+    return token && token->getType() == TokenType::INTEGER_LITERAL &&
+           static_cast<const IntegerLiteralToken&>(*token).getValue() == value;
+}
+
+bool isNumber(std::string_view text, double value) {
+    auto token = scanOne(text);
+    return token && token->getType() == TokenType::NUMERIC_LITERAL &&
+           static_cast<const NumericLiteralToken&>(*token).getValue() == value;
+}
+
+bool isIdentifier(std::string_view text) {
+    auto token = scanOne(text);
+    return token && token->getType() == TokenType::IDENTIFIER &&
+           static_cast<const IdentifierToken&>(*token).getName() == text;
+}
+
+void testNumbers() {
+    // Integers are exact while they fit in 64 bits.
+    CHECK(isInteger("0", 0));
+    CHECK(isInteger("-0", 0));
+    CHECK(isInteger("+17", 17));
+    CHECK(isInteger("007", 7));
+    CHECK(isInteger("9007199254740993", 9007199254740993));
+    CHECK(isInteger("9223372036854775807", std::numeric_limits<std::int64_t>::max()));
+    CHECK(isInteger("-9223372036854775808", std::numeric_limits<std::int64_t>::min()));
+    CHECK(isNumber("9223372036854775808", 9223372036854775808.0));
+
+    CHECK(isNumber("1.", 1));
+    CHECK(isNumber(".5", 0.5));
+    CHECK(isNumber("-.5", -0.5));
+    CHECK(isNumber("+1.25", 1.25));
+    CHECK(isNumber("1e3", 1000));
+    CHECK(isNumber("1E+3", 1000));
+    CHECK(isNumber("25e-2", 0.25));
+    // Out of range saturates instead of failing.
+    CHECK(isNumber("1e400", HUGE_VAL));
+    CHECK(isNumber("-1e400", -HUGE_VAL));
+    CHECK(isNumber("1e-400", 0));
+
+    for (auto text : {"+", "-", "...", "1e", "e3", "1e+", "1.2.3", "inf", "-nan", "0x10", "1+",
+                      "+-1", "--1", "1_000", ".e1", "1..", "12a"}) {
+        CHECK(isIdentifier(text));
+    }
+    CHECK(scanOne(".")->getType() == TokenType::DOT);
+}
+
+void testErrors() {
+    CHECK(describeTokens([] { return Tokenizer::tokenizeBorrowed("\"open"); }) ==
+          "Error: Unexpected end of string literal");
+    CHECK(describeTokens([] { return Tokenizer::tokenizeBorrowed("\"escape at end\\"); }) ==
+          "Error: Unexpected end of string literal");
+    CHECK(describeTokens([] { return Tokenizer::tokenizeBorrowed("#q"); }) ==
+          "Error: Unexpected character after #");
+}
+
+// The tokens of a range, iterated to the end.
+std::deque<TokenPtr> collect(TokenRange& range) {
+    std::deque<TokenPtr> tokens;
+    for (auto it = range.begin(); it != range.end(); ++it) {
+        tokens.push_back(std::move(*it));
+    }
+    return tokens;
+}
+
+void testRange() {
+    std::string_view source = "(f \"plain\" \"esc\\\"aped\" 1.5 #t) 'x";
+    auto expected = describeTokens([&] { return Tokenizer::tokenizeBorrowed(source); });
+    CHECK(describeTokens([&] {
+              TokenRange range(source);
+              return collect(range);
+          }) == expected);
+
+    // Each begin() resumes where the last iteration stopped.
+    TokenRange range(source);
+    std::deque<TokenPtr> tokens;
+    for (auto it = range.begin(); it != range.end() && tokens.size() < 3; ++it) {
+        tokens.push_back(std::move(*it));
+    }
+    CHECK(tokens.size() == 3);
+    auto rest = collect(range);
+    CHECK(rest.size() == 6);
+    CHECK(range.begin() == range.end());
+    for (auto& token : rest) {
+        tokens.push_back(std::move(token));
+    }
+    CHECK(literal(tokens[2]).isBorrowed());
+    CHECK(literal(tokens[2]).getValue().data() == source.data() + source.find("plain"));
+    CHECK(!literal(tokens[3]).isBorrowed());
+    CHECK(describeTokens([&] { return std::move(tokens); }) == expected);
+
+    // Nothing after the last token looked at is scanned, so a form before a
+    // syntax error is read, and the error is thrown when reaching it.
+    TokenRange lazy("(a b) #x");
+    Arena arena;
+    Reader reader(arena);
+    CHECK(reader.read(lazy).toString() == "(a b)");
+    CHECK(describeTokens([&] { return collect(lazy); }) ==
+          "Error: Unexpected character after #");
+}
+
+}  // namespace
+
+int main() {
+    testBorrowed();
+    testOwned();
+    testNumbers();
+    testErrors();
+    testRange();
+    return checkFailures();
+}
@@ -0,0 +1,176 @@
+// Tests of the f64vector kernels at each level against plain loops, and of
+// the vector builtins against the same computations written element by
+// element in Lisp.
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "./check.h"
+#include "./interpreter.h"
+#include "./vector_kernels.h"
+
+namespace {
+
+// Around each multiple of the vector widths, and past a kernel block.
+const std::size_t LENGTHS[]{0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 65, 257, 1001};
+
+// Multiples of 1/4 small enough that sums and products of them are exact,
+// so the order the kernels add in cannot change the result.
+double first(std::size_t i) {
+    return static_cast<double>(i * 7 % 13) - 6 + 0.25 * static_cast<double>(i % 4);
+}
+
+double second(std::size_t i) {
+    return static_cast<double>(i * 5 % 11) - 5.5;
+}
+
+// With the kernels of the level selected.
+void testKernels() {
+    auto& kernels = vectorKernels();
+    for (auto n : LENGTHS) {
+        // One element in, so that the arrays are only 8-byte aligned, as in
+        // the heap.
+        std::vector<double> a(n + 1), b(n + 1), out(n + 1);
+        double sum = 0;
+        double dot = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            a[i + 1] = first(i);
+            b[i + 1] = second(i);
+            sum += a[i + 1];
+            dot += a[i + 1] * b[i + 1];
+        }
+        auto x = a.data() + 1;
+        auto y = b.data() + 1;
+        auto z = out.data() + 1;
+        CHECK(kernels.sum(x, n) == sum);
+        CHECK(kernels.dot(x, y, n) == dot);
+
+        auto same = [&](auto expected) {
+            for (std::size_t i = 0; i < n; i++) {
+                if (z[i] != expected(x[i], y[i])) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        kernels.add(x, y, z, n);
+        CHECK(same([](double p, double q) { return p + q; }));
+        kernels.subtract(x, y, z, n);
+        CHECK(same([](double p, double q) { return p - q; }));
+        kernels.multiply(x, y, z, n);
+        CHECK(same([](double p, double q) { return p * q; }));
+        kernels.divide(x, y, z, n);
+        CHECK(same([](double p, double q) { return p / q; }));
+        kernels.abs(x, z, n);
+        CHECK(same([](double p, double) { return std::fabs(p); }));
+        kernels.scale(x, -1.5, z, n);
+        CHECK(same([](double p, double) { return p * -1.5; }));
+    }
+}
+
+// ((a * 2) + |b|) / 3 - a, in the order the kernel evaluates it.
+void testArithmeticKernel() {
+    using Op = ArithmeticKernel::Op;
+    ArithmeticKernel kernel({
+        {Op::INPUT, 0},
+        {Op::CONSTANT, 0, 2},
+        {Op::MULTIPLY},
+        {Op::INPUT, 1},
+        {Op::ABS},
+        {Op::ADD},
+        {Op::CONSTANT, 0, 3},
+        {Op::DIVIDE},
+        {Op::INPUT, 0},
+        {Op::SUBTRACT},
+    });
+    for (auto n : LENGTHS) {
+        std::vector<double> a(n), b(n), out(n);
+        for (std::size_t i = 0; i < n; i++) {
+            a[i] = first(i);
+            b[i] = second(i);
+        }
+        const double* inputs[]{a.data(), b.data()};
+        kernel.run(inputs, out.data(), n);
+        bool same = true;
+        for (std::size_t i = 0; i < n; i++) {
+            same = same && out[i] == (a[i] * 2 + std::fabs(b[i])) / 3 - a[i];
+        }
+        CHECK(same);
+    }
+}
+
+void testBuiltins(Interpreter::Engine engine) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    run(interpreter,
+        "(define (make n f)"
+        "  (define v (make-f64vector n 0))"
+        "  (define (fill i) (if (< i n) (begin (f64vector-set! v i (f i)) (fill (+ i 1)))))"
+        "  (fill 0)"
+        "  v)"
+        "(define (first i) (+ (- (modulo (* i 7) 13) 6) (* 0.25 (modulo i 4))))"
+        "(define (second i) (- (modulo (* i 5) 11) 5.5))"
+        "(define (fold v w f acc)"
+        "  (define (loop i acc)"
+        "    (if (= i (f64vector-length v)) acc"
+        "        (loop (+ i 1) (f (f64vector-ref v i) (f64vector-ref w i) acc))))"
+        "  (loop 0 acc))"
+        // Whether result holds (f v[i] w[i]) at each i.
+        "(define (elementwise? result v w f)"
+        "  (define (loop i)"
+        "    (or (= i (f64vector-length v))"
+        "        (and (= (f64vector-ref result i) (f (f64vector-ref v i) (f64vector-ref w i)))"
+        "             (loop (+ i 1)))))"
+        "  (loop 0))"
+        "(define (kernel x y) (- (/ (+ (* x 2) (abs y)) 3) x))"
+        "(define (clamp x y) (if (< x y) y x))");
+    for (auto n : LENGTHS) {
+        auto length = std::to_string(n);
+        run(interpreter, "(define v (make " + length + " first))");
+        run(interpreter, "(define w (make " + length + " second))");
+        CHECK_RUN(interpreter, "(= (vector-sum v) (fold v w (lambda (x y acc) (+ acc x)) 0))",
+                  "#t");
+        CHECK_RUN(interpreter,
+                  "(= (vector-dot v w) (fold v w (lambda (x y acc) (+ acc (* x y))) 0))", "#t");
+        CHECK_RUN(interpreter, "(elementwise? (vector-add v w) v w +)", "#t");
+        CHECK_RUN(interpreter,
+                  "(elementwise? (vector-scale v -1.5) v w (lambda (x y) (* x -1.5)))", "#t");
+        // kernel compiles to an ArithmeticKernel; clamp, with its if, does not.
+        CHECK_RUN(interpreter, "(elementwise? (vector-map kernel v w) v w kernel)", "#t");
+        CHECK_RUN(interpreter, "(elementwise? (vector-map clamp v w) v w clamp)", "#t");
+        CHECK_RUN(interpreter,
+                  "(elementwise? (vector-map (lambda (x) (* x x)) v) v w (lambda (x y) (* x x)))",
+                  "#t");
+    }
+}
+
+// Larger than 128 MiB, where a chunk's card table once pushed the data out
+// of the part of the chunk the collector could find.
+void testHugeVector(Interpreter::Engine engine) {
+    Interpreter interpreter;
+    interpreter.setEngine(engine);
+    run(interpreter, "(define v (make-f64vector 17000000 1.5))");
+    run(interpreter, "(define s (vector-scale v 2))");
+    CHECK_RUN(interpreter, "(f64vector-ref v 0)", "1.5");
+    CHECK_RUN(interpreter, "(f64vector-ref s 16999999)", "3");
+    CHECK_RUN(interpreter, "(vector-dot v s)", "76500000");
+}
+
+}  // namespace
+
+int main() {
+    for (auto level : {ScanLevel::SCALAR, ScanLevel::SSE2, ScanLevel::AVX2}) {
+        if (setVectorLevel(level) == level) {
+            testKernels();
+            testArithmeticKernel();
+        }
+    }
+    setVectorLevel(detectScanLevel());
+    for (auto engine : {Interpreter::Engine::VM, Interpreter::Engine::TREE}) {
+        testBuiltins(engine);
+        testHugeVector(engine);
+    }
+    return checkFailures();
+}